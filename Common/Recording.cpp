@@ -0,0 +1,232 @@
+#include "Recording.hpp"
+
+#include <cstdio>
+
+namespace Common {
+
+    namespace {
+
+        void WriteVarint(std::vector<uint8_t>& out, uint64_t value)
+        {
+            while (value >= 0x80)
+            {
+                out.push_back((uint8_t)(value | 0x80));
+                value >>= 7;
+            }
+
+            out.push_back((uint8_t)value);
+        }
+
+        void WriteFixed(std::vector<uint8_t>& out, uint64_t value, int bytes)
+        {
+            for (auto i = 0; i < bytes; i++)
+                out.push_back((uint8_t)(value >> (8 * i)));
+        }
+
+        // Shifted unsigned: left-shifting a negative int is undefined, and mouse coordinates 
+        // go negative once the pointer leaves the window.
+        inline uint64_t ZigZag(int32_t value) { return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31); }
+        inline int32_t UnZigZag(uint64_t value) { return (int32_t)((uint32_t)(value >> 1) ^ (0U - (uint32_t)(value & 1))); }
+
+        class Reader
+        {
+        private:
+            const std::vector<uint8_t>& m_Data;
+            size_t m_Offset = 0;
+            bool m_Ok = true;
+
+        public:
+            Reader(const std::vector<uint8_t>& data) : m_Data(data) {}
+
+            inline bool Ok() const { return m_Ok; }
+            inline size_t Remaining() const { return m_Data.size() - m_Offset; }
+
+            uint64_t Varint()
+            {
+                uint64_t value = 0;
+                for (auto shift = 0; shift < 64; shift += 7)
+                {
+                    if (m_Offset >= m_Data.size())
+                        break;
+
+                    auto byte = m_Data[m_Offset++];
+                    value |= (uint64_t)(byte & 0x7F) << shift;
+
+                    if ((byte & 0x80) == 0)
+                        return value;
+                }
+
+                m_Ok = false;
+                return 0;
+            }
+
+            uint64_t Fixed(int bytes)
+            {
+                if (Remaining() < (size_t)bytes)
+                {
+                    m_Ok = false;
+                    return 0;
+                }
+
+                uint64_t value = 0;
+                for (auto i = 0; i < bytes; i++)
+                    value |= (uint64_t)m_Data[m_Offset++] << (8 * i);
+
+                return value;
+            }
+
+            bool Bytes(std::vector<uint8_t>& out, size_t size)
+            {
+                if (Remaining() < size)
+                    return m_Ok = false;
+
+                out.assign(m_Data.begin() + m_Offset, m_Data.begin() + m_Offset + size);
+                m_Offset += size;
+                return true;
+            }
+        };
+    }
+
+    void Recording::Clear(uint64_t seed)
+    {
+        m_Seed = seed;
+        m_ElapsedMS.clear();
+        m_Checksums.clear();
+        m_EventsEnd.clear();
+        m_Events.clear();
+        m_Keyframes.clear();
+    }
+
+    const InputEvent* Recording::Events(uint32_t frame, uint32_t* outCount) const
+    {
+        auto begin = frame > 0 ? m_EventsEnd[frame - 1] : 0;
+        *outCount = m_EventsEnd[frame] - begin;
+        return m_Events.data() + begin;
+    }
+
+    const Keyframe* Recording::FindKeyframe(uint32_t frame) const
+    {
+        const Keyframe* found = nullptr;
+        for (auto& keyframe : m_Keyframes)
+        {
+            if (keyframe.Frame > frame)
+                break;
+            found = &keyframe;
+        }
+        return found;
+    }
+
+    void Recording::AddEvent(const InputEvent& event)
+    {
+        m_Events.push_back(event);
+    }
+
+    void Recording::EndFrame(uint32_t elapsedMS, uint64_t checksum)
+    {
+        m_ElapsedMS.push_back(elapsedMS);
+        m_Checksums.push_back(checksum);
+        m_EventsEnd.push_back((uint32_t)m_Events.size());
+    }
+
+    void Recording::AddKeyframe(std::vector<uint8_t>&& state)
+    {
+        m_Keyframes.push_back({ FrameCount(), std::move(state) });
+    }
+
+    bool Recording::Save(const std::string& path) const
+    {
+        std::vector<uint8_t> out;
+        out.reserve(64 + m_ElapsedMS.size() * 12 + m_Events.size() * 4);
+
+        WriteFixed(out, Magic, 4);
+        WriteFixed(out, Version, 4);
+        WriteFixed(out, m_Seed, 8);
+        WriteVarint(out, FrameCount());
+        WriteVarint(out, KeyframeCount());
+
+        for (auto frame = 0U; frame < FrameCount(); frame++)
+        {
+            uint32_t count;
+            auto events = Events(frame, &count);
+
+            WriteVarint(out, m_ElapsedMS[frame]);
+            WriteVarint(out, count);
+            WriteFixed(out, m_Checksums[frame], 8);
+
+            for (auto i = 0U; i < count; i++)
+            {
+                out.push_back((uint8_t)events[i].Type);
+                WriteVarint(out, ZigZag(events[i].A));
+                WriteVarint(out, ZigZag(events[i].B));
+            }
+        }
+
+        for (auto& keyframe : m_Keyframes)
+        {
+            WriteVarint(out, keyframe.Frame);
+            WriteVarint(out, keyframe.State.size());
+            out.insert(out.end(), keyframe.State.begin(), keyframe.State.end());
+        }
+
+        auto file = fopen(path.c_str(), "wb");
+        if (!file)
+            return false;
+
+        auto written = fwrite(out.data(), 1, out.size(), file);
+        fclose(file);
+
+        return written == out.size();
+    }
+
+    bool Recording::Load(const std::string& path)
+    {
+        auto file = fopen(path.c_str(), "rb");
+        if (!file)
+            return false;
+
+        std::vector<uint8_t> data;
+        uint8_t buffer[64 * 1024];
+        size_t read;
+        while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+            data.insert(data.end(), buffer, buffer + read);
+        fclose(file);
+
+        Reader reader(data);
+
+        if (reader.Fixed(4) != Magic || reader.Fixed(4) != Version)
+            return false;
+
+        Clear(reader.Fixed(8));
+
+        auto frames = reader.Varint();
+        auto keyframes = reader.Varint();
+
+        for (auto frame = 0ULL; frame < frames && reader.Ok(); frame++)
+        {
+            auto elapsedMS = (uint32_t)reader.Varint();
+            auto count = reader.Varint();
+            auto checksum = reader.Fixed(8);
+
+            for (auto i = 0ULL; i < count && reader.Ok(); i++)
+            {
+                InputEvent event;
+                event.Type = (InputType)reader.Fixed(1);
+                event.A = UnZigZag(reader.Varint());
+                event.B = UnZigZag(reader.Varint());
+                AddEvent(event);
+            }
+
+            EndFrame(elapsedMS, checksum);
+        }
+
+        for (auto i = 0ULL; i < keyframes && reader.Ok(); i++)
+        {
+            Keyframe keyframe;
+            keyframe.Frame = (uint32_t)reader.Varint();
+            reader.Bytes(keyframe.State, reader.Varint());
+            m_Keyframes.push_back(std::move(keyframe));
+        }
+
+        return reader.Ok();
+    }
+}
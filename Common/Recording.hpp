@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Common {
+
+    // Input as SDLGame::Run hands it to the game.
+    enum class InputType : uint8_t
+    {
+        KeyDown,
+        KeyUp,
+        MouseMove,
+        MouseDown,  // Left button.
+        WindowSize
+    };
+
+    struct InputEvent
+    {
+        InputType Type;
+        int32_t A; // Key code, mouse x or window width.
+        int32_t B; // Mouse y or window height.
+    };
+
+    // Game state before a frame's input and update, from SDLGame::SaveState.
+    struct Keyframe
+    {
+        uint32_t Frame;
+        std::vector<uint8_t> State;
+    };
+
+    /*
+        A session: the seed, then per frame the elapsed milliseconds, the input events
+        and a checksum of the state after the update, plus keyframes to seek to.
+
+        File layout, little-endian, counts and values as LEB128 varints (zigzag if signed):
+
+            Magic u32, Version u32, Seed u64, FrameCount, KeyframeCount
+            FrameCount x { ElapsedMS, EventCount, Checksum u64, EventCount x { Type u8, A, B } }
+            KeyframeCount x { Frame, Size, Size bytes }
+    */
+    class Recording
+    {
+    public:
+        static const uint32_t Magic = 0x43455253; // "SREC"
+        static const uint32_t Version = 1;
+
+    private:
+        uint64_t m_Seed = 0;
+        std::vector<uint32_t> m_ElapsedMS;
+        std::vector<uint64_t> m_Checksums;
+        std::vector<uint32_t> m_EventsEnd; // Per frame, end offset into m_Events.
+        std::vector<InputEvent> m_Events;
+        std::vector<Keyframe> m_Keyframes; // Ascending by frame.
+
+    public:
+        void Clear(uint64_t seed);
+
+        inline uint64_t Seed() const { return m_Seed; }
+        inline uint32_t FrameCount() const { return (uint32_t)m_ElapsedMS.size(); }
+        inline uint32_t ElapsedMS(uint32_t frame) const { return m_ElapsedMS[frame]; }
+        inline uint64_t Checksum(uint32_t frame) const { return m_Checksums[frame]; }
+        inline uint32_t KeyframeCount() const { return (uint32_t)m_Keyframes.size(); }
+
+        const InputEvent* Events(uint32_t frame, uint32_t* outCount) const;
+
+        // The latest keyframe at or before frame, or nullptr.
+        const Keyframe* FindKeyframe(uint32_t frame) const;
+
+        // Recording. Events go to the frame that EndFrame closes.
+        void AddEvent(const InputEvent& event);
+        void EndFrame(uint32_t elapsedMS, uint64_t checksum);
+        void AddKeyframe(std::vector<uint8_t>&& state);
+
+        bool Save(const std::string& path) const;
+        bool Load(const std::string& path);
+    };
+}
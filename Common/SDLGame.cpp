@@ -1,4 +1,5 @@
 #include "SDLGame.hpp"
+#include "Recording.hpp"
 
 #include <wrl\wrappers\corewrappers.h>
 #pragma comment(lib, "RuntimeObject.lib")
@@ -7,6 +8,94 @@
 #include <SDL_events.h>
 //#include <SDL_image.h>
 
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+    struct Options
+    {
+        std::string RecordPath;
+        std::string ReplayPath;
+        bool Headless = false;
+        bool MaxSpeed = false;
+        uint64_t Seed = 0;
+        uint32_t Seek = 0;
+        uint32_t KeyframeInterval = 600;
+    };
+
+    //  --record <file>     Record the seed, frame times and input; written on quit.
+    //  --replay <file>     Play a recording back instead of reading input.
+    //  --headless          With --replay: no window, no rendering.
+    //  --max-speed         With --replay: don't wait for the recorded frame times.
+    //  --seek <frame>      With --replay: start from the nearest keyframe, report from <frame>.
+    //  --keyframes <n>     With --record: snapshot the game state every n frames, 0 for none.
+    //  --seed <n>          Seed for a live session; 0 otherwise, the fixed starting board.
+    Options ParseOptions(int argc, char** argv)
+    {
+        Options options;
+
+        for (auto i = 1; i < argc; i++)
+        {
+            auto hasValue = i + 1 < argc;
+
+            if (0 == strcmp(argv[i], "--record") && hasValue)
+                options.RecordPath = argv[++i];
+            else if (0 == strcmp(argv[i], "--replay") && hasValue)
+                options.ReplayPath = argv[++i];
+            else if (0 == strcmp(argv[i], "--headless"))
+                options.Headless = true;
+            else if (0 == strcmp(argv[i], "--max-speed"))
+                options.MaxSpeed = true;
+            else if (0 == strcmp(argv[i], "--seek") && hasValue)
+                options.Seek = (uint32_t)strtoul(argv[++i], nullptr, 10);
+            else if (0 == strcmp(argv[i], "--keyframes") && hasValue)
+                options.KeyframeInterval = (uint32_t)strtoul(argv[++i], nullptr, 10);
+            else if (0 == strcmp(argv[i], "--seed") && hasValue)
+                options.Seed = strtoull(argv[++i], nullptr, 10);
+            else
+                SDL_Log("Ignoring argument '%s'", argv[i]);
+        }
+
+        // Without a recording there is no input and no way to quit.
+        if (options.ReplayPath.empty())
+            options.Headless = false;
+
+        return options;
+    }
+
+    void Dispatch(SDLGame& game, const Common::InputEvent& input)
+    {
+        switch (input.Type)
+        {
+            case Common::InputType::KeyDown:
+                game.OnKeyDown(input.A);
+                break;
+
+            case Common::InputType::KeyUp:
+                game.OnKeyUp(input.A);
+                break;
+
+            case Common::InputType::MouseMove:
+                game.OnMouseMove(input.A, input.B);
+                break;
+
+            case Common::InputType::MouseDown:
+                game.OnMouseDown(input.A, input.B);
+                break;
+
+            case Common::InputType::WindowSize:
+                game.OnWindowSize(input.A, input.B);
+                break;
+        }
+    }
+
+    double ElapsedMS(uint64_t begin)
+    {
+        return (SDL_GetPerformanceCounter() - begin) * 1000.0 / SDL_GetPerformanceFrequency();
+    }
+}
+
 int SDLGame::Run(int argc, char** argv)
 {
 #if (_WIN32_WINNT >= 0x0A00 /*_WIN32_WINNT_WIN10*/)
@@ -30,65 +119,218 @@ int SDLGame::Run(int argc, char** argv)
     //if (IMG_INIT_PNG != (flags & IMG_INIT_PNG))
     //    SDL_Log("Failed to load **png** module");
 
-    auto [width, height] = GetDesiredWindowSize();
+    auto options = ParseOptions(argc, argv);
+    auto replaying = !options.ReplayPath.empty();
+
+    Common::Recording recording;
+
+    if (replaying)
+    {
+        if (!recording.Load(options.ReplayPath))
+        {
+            SDL_Log("Failed to load recording '%s'", options.ReplayPath.c_str());
+            SDL_Quit();
+            return 1;
+        }
+
+        m_Seed = recording.Seed();
+    }
+    else
+    {
+        m_Seed = options.Seed;
+        recording.Clear(m_Seed);
+    }
 
-    m_Window = SDL_CreateWindow(
-        "Bejeweled Clone",
-        SDL_WINDOWPOS_CENTERED,
-        SDL_WINDOWPOS_CENTERED,
-        width, height,
-        SDL_WINDOW_RESIZABLE | SDL_WINDOW_SHOWN);
+    m_Headless = options.Headless;
+    m_Recording = !replaying && !options.RecordPath.empty();
 
-    SDL_assert_release(nullptr != m_Window);
+    if (!m_Headless)
+    {
+        auto [width, height] = GetDesiredWindowSize();
+
+        m_Window = SDL_CreateWindow(
+            "Bejeweled Clone",
+            SDL_WINDOWPOS_CENTERED,
+            SDL_WINDOWPOS_CENTERED,
+            width, height,
+            SDL_WINDOW_RESIZABLE | SDL_WINDOW_SHOWN);
+
+        SDL_assert_release(nullptr != m_Window);
+
+        m_D3D11.Init(m_Window, true);
+    }
 
-    m_D3D11.Init(m_Window, true);
     OnCreate();
 
     bool quit = false;
     SDL_Event event = {};
-    uint32_t lastMS = 0;
 
-    while (!quit)
+    if (replaying)
+    {
+        uint32_t frame = 0;
+
+        if (options.Seek > 0)
+        {
+            auto keyframe = recording.FindKeyframe(options.Seek);
+            if (keyframe && LoadState(keyframe->State))
+                frame = keyframe->Frame;
+        }
+
+        uint32_t mismatches = 0;
+        uint32_t reported = 0;
+        double totalUpdateMS = 0.0;
+        auto nextFrameMS = (double)SDL_GetTicks();
+
+        for (; frame < recording.FrameCount() && !quit; frame++)
+        {
+            while (!m_Headless && SDL_PollEvent(&event))
+            {
+                if (SDL_QUIT == event.type)
+                    quit = true;
+            }
+
+            auto elapsedMS = recording.ElapsedMS(frame);
+            auto seeking = frame < options.Seek;
+
+            if (!seeking && !options.MaxSpeed)
+            {
+                nextFrameMS += elapsedMS;
+                auto now = (double)SDL_GetTicks();
+                if (nextFrameMS > now)
+                    SDL_Delay((uint32_t)(nextFrameMS - now));
+            }
+
+            uint32_t count;
+            auto events = recording.Events(frame, &count);
+
+            auto begin = SDL_GetPerformanceCounter();
+            for (auto i = 0U; i < count; i++)
+                Dispatch(*this, events[i]);
+            OnUpdate(elapsedMS / 1000.0);
+            auto updateMS = ElapsedMS(begin);
+
+            auto checksum = GetStateChecksum();
+            auto match = checksum == recording.Checksum(frame);
+            mismatches += match ? 0 : 1;
+
+            if (seeking)
+                continue;
+
+            reported++;
+            totalUpdateMS += updateMS;
+            SDL_Log("frame %u checksum %016llx update %.3f ms%s",
+                frame, (unsigned long long)checksum, updateMS, match ? "" : " MISMATCH");
+
+            if (!m_Headless)
+            {
+                int w, h;
+                SDL_GetWindowSize(m_Window, &w, &h);
+                OnRender(w, h);
+            }
+        }
+
+        SDL_Log("replayed %u frames, %u checksum mismatches, %.3f ms average update",
+            reported, mismatches, reported > 0 ? totalUpdateMS / reported : 0.0);
+    }
+    else
     {
-        while (SDL_PollEvent(&event))
+        auto recordInput = m_Recording;
+        uint32_t lastMS = 0;
+        int windowWidth = 0;
+        int windowHeight = 0;
+
+        auto handle = [&](const Common::InputEvent& input)
+        {
+            Dispatch(*this, input);
+            if (recordInput)
+                recording.AddEvent(input);
+        };
+
+        while (!quit)
         {
-            if (SDL_QUIT == event.type)
+            // Keyframes hold the state before the frame's input, which is where a replay resumes.
+            if (recordInput && options.KeyframeInterval > 0 && 
+                recording.FrameCount() % options.KeyframeInterval == 0)
             {
-                quit = true;
-                break;
+                std::vector<uint8_t> state;
+                if (SaveState(state))
+                    recording.AddKeyframe(std::move(state));
             }
 
-            switch (event.type)
+            int w, h;
+            SDL_GetWindowSize(m_Window, &w, &h);
+            if (w != windowWidth || h != windowHeight)
             {
-                case SDL_KEYDOWN: 
-                    OnKeyDown(event.key.keysym.sym); 
-                    break;
+                windowWidth = w;
+                windowHeight = h;
+                handle({ Common::InputType::WindowSize, w, h });
+            }
 
-                case SDL_KEYUP: 
-                    OnKeyUp(event.key.keysym.sym); 
+            while (SDL_PollEvent(&event))
+            {
+                if (SDL_QUIT == event.type)
+                {
+                    quit = true;
                     break;
+                }
 
-                case SDL_MOUSEMOTION: 
-                    OnMouseMove(event.motion.x, event.motion.y);
-                    break;
+                Common::InputEvent input = {};
+
+                switch (event.type)
+                {
+                    case SDL_KEYDOWN: 
+                        if (OnToolKeyDown(event.key.keysym.sym))
+                            continue;
+
+                        input = { Common::InputType::KeyDown, event.key.keysym.sym, 0 };
+                        break;
+
+                    case SDL_KEYUP: 
+                        input = { Common::InputType::KeyUp, event.key.keysym.sym, 0 };
+                        break;
+
+                    case SDL_MOUSEMOTION: 
+                        input = { Common::InputType::MouseMove, event.motion.x, event.motion.y };
+                        break;
+
+                    case SDL_MOUSEBUTTONDOWN: 
+                        if (event.button.button != SDL_BUTTON_LEFT)
+                            continue;
+
+                        input = { Common::InputType::MouseDown, event.button.x, event.button.y };
+                        break;
+
+                    default:
+                        continue;
+                }
+
+                handle(input);
             }
-        }
 
-        if (quit)
-            break;
+            if (quit)
+                break;
+
+            auto currentMS = SDL_GetTicks();
+            auto elapsedMS = currentMS - lastMS;
+            lastMS = currentMS;
+            OnUpdate(elapsedMS / 1000.0);
 
-        auto currentMS = SDL_GetTicks();
-        auto elapsedMS = currentMS - lastMS;
-        lastMS = currentMS;
-        OnUpdate(elapsedMS / 1000.0);
+            if (recordInput)
+                recording.EndFrame(elapsedMS, GetStateChecksum());
 
-        int w, h;
-        SDL_GetWindowSize(m_Window, &w, &h);
-        OnRender(w, h);
+            SDL_GetWindowSize(m_Window, &w, &h);
+            OnRender(w, h);
+        }
+
+        // Input after the last completed frame is dropped with it; replay ends on that frame.
+        if (recordInput && !recording.Save(options.RecordPath))
+            SDL_Log("Failed to save recording '%s'", options.RecordPath.c_str());
     }
 
     OnDestroy();
-    SDL_DestroyWindow(m_Window);
+
+    if (m_Window)
+        SDL_DestroyWindow(m_Window);
 
     return 0;
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <SDL.h>
 #include <string>
+#include <vector>
 
 #include "Direct3D11.hpp"
 
@@ -11,6 +12,14 @@ protected:
     Common::Direct3D11 m_D3D11;
     std::string m_ShadersPath;
     SDL_Window* m_Window = nullptr;
+
+    // Set by Run before OnCreate. A replay uses the recorded seed; headless runs have no 
+    // window or device, so OnCreate must not touch m_D3D11.
+    uint64_t m_Seed = 0;
+    bool m_Headless = false;
+
+    // Set by Run before OnCreate, when live input is being recorded.
+    bool m_Recording = false;
     
 public:
     virtual ~SDLGame() {};
@@ -27,6 +36,21 @@ public:
     virtual void OnKeyDown(SDL_Keycode keyCode) {};
     virtual void OnKeyUp(SDL_Keycode keyCode) {};
     virtual void OnMouseMove(int x, int y) {};
+    virtual void OnMouseDown(int x, int y) {};
+
+    // The window size is input like the mouse, so what a click hits replays the same, 
+    // headless too. Sent before the first frame and whenever it changes.
+    virtual void OnWindowSize(int width, int height) {};
+
+    // Keys that aren't game input, eg. debug save/load. Return true to take the key: 
+    // it is then neither recorded nor passed to OnKeyDown. Never called while replaying.
+    virtual bool OnToolKeyDown(SDL_Keycode keyCode) { return false; }
+
+    // Deterministic replay support. The checksum is printed and compared per frame; 
+    // the state is stored in keyframes so a replay can seek without running from frame 0.
+    virtual uint64_t GetStateChecksum() { return 0; }
+    virtual bool SaveState(std::vector<uint8_t>& out) { return false; }
+    virtual bool LoadState(const std::vector<uint8_t>& in) { return false; }
 };
 
 #define Game__(in_Game__)\
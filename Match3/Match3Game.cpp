@@ -3,22 +3,22 @@
 #include <SDLGame.hpp>
 
 #include "m3Board.hpp"
-#include "m3GemPool.hpp"
-#include "m3Match.hpp"
+#include "m3GemStore.hpp"
 #include "m3BoardView.hpp"
+#include "m3Simulation.hpp"
+#include "m3Serialize.hpp"
+#include "m3Snapshot.hpp"
 
 #include <EASTL\vector.h>
-#include <EASTL\hash_map.h>
 #include <EASTL\algorithm.h>
-#include <EASTL\hash_set.h>
-
-#include <random>
 
 void* __cdecl operator new[](size_t size, const char* name, int flags, unsigned debugFlags, const char* file, int line)
 {
     return new uint8_t[size];
 }
 
+// EASTL frees with a plain delete[], so the alignment can't be honoured here. Containers of
+// over-aligned elements use m3::CacheLineAllocator.
 void* __cdecl operator new[](size_t size, size_t align, size_t offset, const char* name, int flags, unsigned debugFlags, const char* file, int line)
 {
     return new uint8_t[size];
@@ -27,6 +27,9 @@ void* __cdecl operator new[](size_t size, size_t align, size_t offset, const cha
 static const auto BoardRows = 64;
 static const auto BoardCols = 64;
 static const auto SpriteSize = 16.0f;
+static const auto StartValidMoves = 3;
+static const auto ResortFraction = 4; // Re-sort gems once 1/N of them are out of place.
+static const char* const QuickSnapshotFile = "Match3.snapshot";
 
 struct CameraConstantsBuffer
 {
@@ -99,102 +102,127 @@ private:
     m3::BoardView m_BoardView;
 
     // Game data.
-    std::mt19937 m_RandGenerator;
-    std::uniform_int_distribution<uint16_t> m_ColorDistribution;
-    m3::GemPool m_GemPool;
+    // The simulation resolves a whole cascade up front, the events are then played back 
+    // a step at a time: despawn the cleared gems, then fall and spawn.
+    m3::Simulation m_Simulation;
+    m3::CascadeEvents m_Events;
+    uint32_t m_Step = 0;
     
     // Board data.
     // @Todo: Everything might benefit from this being column-major
     // We hardly iterate over a row, except when matching. But we iterate over columns a lot, 
-    // like when generating falls. So having the column be sequential would be better?
-    using Board = m3::Board<m3::GemId, BoardRows, BoardCols>;
+    // like when generating falls. The layout is a template parameter (m3::ColMajor, m3::Tiled8x8),
+    // see the "Board layouts" benchmark in m3Match.hpp before switching.
+    using Board = m3::DynamicBoard<m3::GemId>;
 
-    Board m_Board;
-    eastl::hash_map<m3::GemId, uint32_t> m_IdToIndex;
-    eastl::vector<m3::GemId> m_GemIds;
-    eastl::vector<m3::Row> m_GemRows;
-    eastl::vector<m3::Col> m_GemCols;
-    eastl::vector<m3::GemColor> m_GemColors;
+    Board m_Board; // Lags m_Simulation until the events are played back.
 
-    // Computed stuff.
-    eastl::vector<Vector2> m_GemPositions;
-    eastl::vector<Vector2> m_GemScales;
+    // Gem data, chunked SoA, see m3::GemComponent.
+    m3::GemStore m_Gems;
 
     // Tweens. 
     // Double-buffered to eliminate cost of erase for completed tweens.
     // We simply move incomplete tweens to the other vector and clear and swap.
     // @Todo: Begging to be abstracted to it's own class.
+    // Destinations are ids rather than indices, so they survive removals that reorder a chunk.
     eastl::vector<m3::GemId> m_DespawnGemIds;
-    eastl::vector<uint32_t> m_DespawnDstIndices;
-    eastl::vector<uint32_t> m_DespawnDstIndices_1;
+    eastl::vector<m3::GemId> m_DespawnDstIds;
+    eastl::vector<m3::GemId> m_DespawnDstIds_1;
     eastl::vector<Tween> m_DespawnTweens;
     eastl::vector<Tween> m_DespawnTweens_1;
 
     eastl::vector<m3::GemId> m_FallGemIds;
-    eastl::vector<uint32_t> m_FallDstIndices;
-    eastl::vector<uint32_t> m_FallDstIndices_1;
+    eastl::vector<m3::GemId> m_FallDstIds;
+    eastl::vector<m3::GemId> m_FallDstIds_1;
     eastl::vector<Tween> m_FallTweens;
     eastl::vector<Tween> m_FallTweens_1;
 
+    // Input. A click selects a gem, a click on a neighbour swaps the two. What a click hits
+    // depends on the window size, which comes in as input too, see OnWindowSize.
+    int m_ViewWidth = 0;
+    int m_ViewHeight = 0;
+    m3::Cell m_Selected = { -1, -1 };
+
+    // What SaveState writes, loaded to the side so it can be checked before anything 
+    // above changes, see LoadState and LoadSnapshot. The --seek replay path relies on a 
+    // failed load leaving the game as it was.
+    struct LoadedState
+    {
+        m3::Simulation::Colors m_Colors;
+        m3::Random m_Random;
+        m3::CascadeEvents m_Events;
+        uint32_t m_Step = 0;
+        Board m_Board;
+        m3::GemStore m_Gems;
+
+        eastl::vector<m3::GemId> m_DespawnGemIds;
+        eastl::vector<m3::GemId> m_DespawnDstIds;
+        eastl::vector<Tween> m_DespawnTweens;
+        eastl::vector<m3::GemId> m_FallGemIds;
+        eastl::vector<m3::GemId> m_FallDstIds;
+        eastl::vector<Tween> m_FallTweens;
+
+        int m_ViewWidth = 0;
+        int m_ViewHeight = 0;
+        m3::Cell m_Selected = { -1, -1 };
+    };
+
 private:
     std::tuple<int, int> GetDesiredWindowSize() override final
     {
         return 
         {
-            (int)(16.0f + SpriteSize * BoardCols), 
-            (int)(16.0f + SpriteSize * BoardRows) 
+            (int)(16.0f + SpriteSize * m_Board.Cols().m_I), 
+            (int)(16.0f + SpriteSize * m_Board.Rows().m_I) 
         };
     }
 
     void OnCreate() override final
     {
-        assert((BoardRows * BoardCols) < m3::InvalidGemId.Int());
-
-        m_CameraConstantsBuffer = m_D3D11.CreateConstantsBuffer<CameraConstantsBuffer>();
-        m_D3D11.SetDebugName(m_CameraConstantsBuffer.Get(), "CameraConstantsBuffer");
+        assert(m_Board.Count() <= m3::GemIdSlotMask + 1);
 
         auto rows = m_Board.Rows();
         auto cols = m_Board.Cols();
 
-        m_BoardView.Init(m_D3D11, m_ShadersPath);
-        m_BoardView.InitBackgroundBatch(rows.m_I, cols.m_I, SpriteSize);
+        // Until Run sends the real size.
+        auto [width, height] = GetDesiredWindowSize();
+        m_ViewWidth = width;
+        m_ViewHeight = height;
 
-        m_IdToIndex.reserve(m_Board.Count());
-
-        // Create and place random colored gems.
-        for (auto i = 0U; i < m_Board.Count(); i++)
+        if (!m_Headless)
         {
-            m3::Row r = i / cols.m_I;
-            m3::Col c = i % cols.m_I;
-            auto id = m_GemPool.GetOrCreateGem();
-            auto index = (uint32_t)m_GemRows.size();
-            auto color = RandomGemColor();
+            m_CameraConstantsBuffer = m_D3D11.CreateConstantsBuffer<CameraConstantsBuffer>();
+            m_D3D11.SetDebugName(m_CameraConstantsBuffer.Get(), "CameraConstantsBuffer");
 
-            m_Board(r, c) = id;
-            m_IdToIndex.insert(id);
-            m_IdToIndex[id] = index;
-            m_GemIds.emplace_back(id);
-            m_GemRows.emplace_back(r);
-            m_GemCols.emplace_back(c);
-            m_GemColors.emplace_back(color);
+            m_BoardView.Init(m_D3D11, m_ShadersPath);
+            m_BoardView.InitBackgroundBatch(rows.m_I, cols.m_I, SpriteSize);
         }
 
-        m_GemPositions.resize(m_GemRows.size());
-        m_GemScales.resize(m_GemRows.size());
+        // Create and place random colored gems, with no matches to start with.
+        // Everything random comes from m_Seed, so a replay gets the same board.
+        // Only tiny boards run short of moves; settle for one rather than a stuck board.
+        m_Simulation.Seed(m_Seed);
+        if (!m_Simulation.Generate(StartValidMoves))
+        {
+            SDL_Log("Generated board has fewer than %d valid moves", StartValidMoves);
+
+            auto generated = m_Simulation.Generate(1);
+            assert(generated && "No board with a valid move, the board is too small");
+            (void)generated;
+        }
 
-        // Init position and scale of all gems.
-        for (auto i = 0; i < m_GemPositions.size(); i++)
+        for (auto i = 0U; i < m_Board.Count(); i++)
         {
-            auto r = m_GemRows[i]; 
-            auto c = m_GemCols[i];
+            m3::Row r = i / cols.m_I;
+            m3::Col c = i % cols.m_I;
+            auto color = m_Simulation(r, c);
             auto position = Position(r, c, SpriteSize);
             auto scale = SpriteSize;
 
-            m_GemPositions[i] = position;
-            m_GemScales[i] = { scale, scale };
+            m_Board(r, c) = m_Gems.Add(r, c, color, position, { scale, scale });
         }
 
-        FindAndClearFromWholeBoard();
+        SortGems();
 
          // @Todo: Remove test. 
          // Despawn a few gems.
@@ -242,7 +270,7 @@ private:
 
         m_BoardView.BeginRender();
         m_BoardView.RenderBackground();
-        m_BoardView.RenderGems(m_GemPositions, m_GemScales, m_GemColors);
+        m_BoardView.RenderGems(m_Gems);
         m_BoardView.EndRender();
 
         m_D3D11.EndFrame();
@@ -252,136 +280,377 @@ private:
 
     void OnMouseMove(int x, int y) override final {}
 
-    // Internal functions.
-private: 
-    inline m3::GemColor RandomGemColor()
+    // Swaps are only taken between cascades. One that makes no match is refused, and 
+    // clicking elsewhere just moves the selection.
+    void OnMouseDown(int x, int y) override final
     {
-        return m3::GemColors[m_ColorDistribution(m_RandGenerator)];
+        if (m_Events.StepCount() > 0)
+            return;
+
+        m3::Cell cell;
+        if (!CellAt(x, y, &cell))
+        {
+            m_Selected = { -1, -1 };
+            return;
+        }
+
+        m3::Swap swap = { m_Selected.m_Row, m_Selected.m_Col, cell.m_Row, cell.m_Col };
+        if (m_Selected.m_Row < 0 || !swap.IsAdjacent())
+        {
+            m_Selected = cell;
+            return;
+        }
+
+        m_Selected = { -1, -1 };
+
+        if (m_Simulation.ApplySwap(swap, &m_Events))
+        {
+            SwapGems(swap);
+            PlayStep();
+        }
     }
 
-    inline Vector2 Position(m3::Row r, m3::Col c, float spriteSize)
+    void OnWindowSize(int width, int height) override final
     {
-        const auto cr = Vector2((float)BoardCols - 1, (float)BoardRows - 1);
-        const auto origin = -0.5f * spriteSize * cr;
-        return origin + spriteSize * Vector2((float)c.m_I, (float)r.m_I);
+        m_ViewWidth = width;
+        m_ViewHeight = height;
     }
 
-    inline float GemY(float ny, float spriteSize)
+    // F5 quick saves next to the executable, F9 loads it back. Outside the recorded input, 
+    // so replays don't depend on the file. Loading while recording would make the recording 
+    // diverge from its replay, so it is refused.
+    bool OnToolKeyDown(SDL_Keycode keyCode) override final
     {
-        const auto cr = (float)BoardRows - 1;
-        const auto origin = -0.5f * spriteSize * cr;
-        return origin + spriteSize * ny;
+        auto path = m_ShadersPath + QuickSnapshotFile;
+
+        if (keyCode == SDLK_F5)
+        {
+            if (!SaveSnapshot(path.c_str()))
+                SDL_Log("Failed to save snapshot '%s'", path.c_str());
+            return true;
+        }
+
+        if (keyCode == SDLK_F9)
+        {
+            if (m_Recording)
+                SDL_Log("Not loading a snapshot while recording");
+            else if (!LoadSnapshot(path.c_str()))
+                SDL_Log("Failed to load snapshot '%s'", path.c_str());
+            return true;
+        }
+
+        return false;
     }
 
-    m3::GemColor GetColor(m3::Row r, m3::Col c)
+    // Board and presentation both, so a replay that drifts shows up on the frame it happens.
+    uint64_t GetStateChecksum() override final
     {
-        auto id = m_Board(r, c);
-        if (id == m3::InvalidGemId)
-            return m3::InvalidColor;
+        auto& colors = m_Simulation.GetColors();
+        auto hash = m3::Fnv1a64(colors.Data(), colors.SizeInBytes());
+        hash = m3::Fnv1a64(&m_Step, sizeof(m_Step), hash);
+        hash = m3::Fnv1a64(&m_Selected, sizeof(m_Selected), hash);
+
+        m_Gems.ForEachChunk([&](uint32_t chunk, uint32_t count)
+        {
+            using namespace m3;
+            hash = Fnv1a64(m_Gems.Array<GemComponent::Color>(chunk), sizeof(GemColor) * count, hash);
+            hash = Fnv1a64(m_Gems.Array<GemComponent::Position>(chunk), sizeof(Vector2) * count, hash);
+            hash = Fnv1a64(m_Gems.Array<GemComponent::Scale>(chunk), sizeof(Vector2) * count, hash);
+        });
+
+        return hash;
+    }
+
+    // The double-buffer halves (_1) are empty between updates and aren't saved.
+    bool SaveState(std::vector<uint8_t>& out) override final
+    {
+        eastl::vector<uint8_t> bytes;
+        m3::BinaryWriter writer(&bytes);
+
+        m_Simulation.Save(writer);
+        m_Events.Save(writer);
+        writer.Write(m_Step);
+        m_Board.Save(writer);
+        m_Gems.Save(writer);
+
+        writer.WriteVector(m_DespawnGemIds);
+        writer.WriteVector(m_DespawnDstIds);
+        writer.WriteVector(m_DespawnTweens);
+        writer.WriteVector(m_FallGemIds);
+        writer.WriteVector(m_FallDstIds);
+        writer.WriteVector(m_FallTweens);
+
+        writer.Write(m_ViewWidth);
+        writer.Write(m_ViewHeight);
+        writer.Write(m_Selected);
+
+        out.assign(bytes.begin(), bytes.end());
+        return true;
+    }
+
+    // All or nothing.
+    bool LoadState(const std::vector<uint8_t>& in) override final
+    {
+        m3::BinaryReader reader(in.data(), in.size());
+        LoadedState state;
+
+        if (!m_Simulation.Read(reader, &state.m_Colors, &state.m_Random) || !state.m_Events.Load(reader))
+            return false;
+
+        state.m_Step = reader.Read<uint32_t>();
+
+        if (!state.m_Board.Load(reader) || !state.m_Gems.Load(reader))
+            return false;
+
+        reader.ReadVector(&state.m_DespawnGemIds);
+        reader.ReadVector(&state.m_DespawnDstIds);
+        reader.ReadVector(&state.m_DespawnTweens);
+        reader.ReadVector(&state.m_FallGemIds);
+        reader.ReadVector(&state.m_FallDstIds);
+        reader.ReadVector(&state.m_FallTweens);
+
+        state.m_ViewWidth = reader.Read<int>();
+        state.m_ViewHeight = reader.Read<int>();
+        state.m_Selected = reader.Read<m3::Cell>();
+
+        if (!reader.Ok() || reader.Remaining() != 0 || !IsLoadable(state))
+            return false;
+
+        ApplyState(state);
+        return true;
+    }
+
+    // Snapshot sections.
+    static constexpr uint32_t ColorsTag = m3::SnapshotTag("COLR");
+    static constexpr uint32_t RandomTag = m3::SnapshotTag("RAND");
+    static constexpr uint32_t EventsTag = m3::SnapshotTag("EVNT");
+    static constexpr uint32_t StepTag = m3::SnapshotTag("STEP");
+    static constexpr uint32_t BoardTag = m3::SnapshotTag("BORD");
+    static constexpr m3::GemStore::SectionTags GemTags = {
+        m3::SnapshotTag("GEMS"), m3::SnapshotTag("GSLT"), m3::SnapshotTag("GIDS"), m3::SnapshotTag("GROW"),
+        m3::SnapshotTag("GCOL"), m3::SnapshotTag("GCLR"), m3::SnapshotTag("GPOS"), m3::SnapshotTag("GSCL") };
+    static constexpr uint32_t DespawnGemIdsTag = m3::SnapshotTag("DGEM");
+    static constexpr uint32_t DespawnDstIdsTag = m3::SnapshotTag("DDST");
+    static constexpr uint32_t DespawnTweensTag = m3::SnapshotTag("DTWN");
+    static constexpr uint32_t FallGemIdsTag = m3::SnapshotTag("FGEM");
+    static constexpr uint32_t FallDstIdsTag = m3::SnapshotTag("FDST");
+    static constexpr uint32_t FallTweensTag = m3::SnapshotTag("FTWN");
 
-        auto index = m_IdToIndex.at(id);
-        return m_GemColors[index];
+public:
+    // Everything SaveState has, in the mapped snapshot format, see m3Snapshot.hpp.
+    bool SaveSnapshot(const char* path) const
+    {
+        m3::SnapshotWriter writer;
+
+        writer.AddBoard(ColorsTag, m_Simulation.GetColors());
+        writer.AddObject(RandomTag, m_Simulation.GetRandom());
+        writer.AddObject(EventsTag, m_Events);
+        writer.AddBytes(StepTag, &m_Step, sizeof(m_Step), sizeof(m_Step));
+        writer.AddBoard(BoardTag, m_Board);
+        m_Gems.AddSections(writer, GemTags);
+
+        writer.AddArray(DespawnGemIdsTag, m_DespawnGemIds);
+        writer.AddArray(DespawnDstIdsTag, m_DespawnDstIds);
+        writer.AddArray(DespawnTweensTag, m_DespawnTweens);
+        writer.AddArray(FallGemIdsTag, m_FallGemIds);
+        writer.AddArray(FallDstIdsTag, m_FallDstIds);
+        writer.AddArray(FallTweensTag, m_FallTweens);
+
+        return writer.Save(path);
     }
 
-    void FindAndClearFromWholeBoard()
+    // O(cells): the game owns its boards, so every board, gem chunk and tween array is 
+    // copied out of the mapping, then IsLoadable visits every cell. The copies are memcpys 
+    // rather than a parse, but only opening the snapshot is constant time; code that wants 
+    // that reads the sections in place, see m3::Snapshot. All or nothing like LoadState: 
+    // a missing section or another board size fails without changing anything.
+    bool LoadSnapshot(const char* path)
     {
-        /*
-                         c           
-                +------+------+------+
-                |      | cu   |      |
-                |      |      |      |
-                +------+------+------+
-              r | rl   |      | rr   |
-                |      |      |      |
-                +------+------+------+
-                |      | cd   |      |
-                |      |      |      |
-                +------+------+------+
-            0,0                       
-        */
-        eastl::hash_set<m3::GemId> idsToRemove;
-
-        for (auto i = 0; i < m_Board.Count(); i++)
+        m3::Snapshot snapshot;
+        if (!snapshot.Open(path))
+            return false;
+
+        auto colors = snapshot.Board<m3::GemColor>(ColorsTag);
+        auto board = snapshot.Board<m3::GemId>(BoardTag);
+        eastl::span<const uint32_t> step;
+
+        if (colors.Rows() != m_Board.Rows() || colors.Cols() != m_Board.Cols() || 
+            board.Rows() != m_Board.Rows() || board.Cols() != m_Board.Cols() || 
+            !snapshot.FindArray(StepTag, &step) || step.size() != 1)
+            return false;
+
+        // Input isn't in snapshots: the window is what it is, and the selection is dropped.
+        LoadedState state;
+        state.m_ViewWidth = m_ViewWidth;
+        state.m_ViewHeight = m_ViewHeight;
+        state.m_Colors.CopyFrom(colors);
+        state.m_Random = m_Simulation.GetRandom();
+        state.m_Step = step[0];
+        state.m_Board.CopyFrom(board);
+
+        auto randomReader = snapshot.Reader(RandomTag);
+        auto eventsReader = snapshot.Reader(EventsTag);
+
+        if (!state.m_Random.Load(randomReader) || randomReader.Remaining() != 0 || 
+            !state.m_Events.Load(eventsReader) || eventsReader.Remaining() != 0 ||
+            !state.m_Gems.LoadSections(snapshot, GemTags))
+            return false;
+
+        auto load = [&snapshot](uint32_t tag, auto& values)
         {
-            m3::Row r = i / m_Board.Cols().m_I;
-            m3::Col c = i % m_Board.Cols().m_I;
+            using T = typename eastl::remove_reference_t<decltype(values)>::value_type;
+            eastl::span<const T> mapped;
+            if (!snapshot.FindArray(tag, &mapped))
+                return false;
 
-            auto colors = [this](m3::Row r, m3::Col c) { return this->GetColor(r, c); };
-            auto color = colors(r, c);
-            if (color == m3::InvalidColor)
-                continue;
+            values.assign(mapped.begin(), mapped.end());
+            return true;
+        };
 
-            auto rl = m3::RowSpan { r, m3::GetMatchingColsInRow_L(r, c, color, colors), c };
-            auto rr = m3::RowSpan { r, c, m3::GetMatchingColsInRow_R(r, c, color, colors, m_Board.Cols() - 1) };
-            auto cu = m3::ColSpan { c, r, m3::GetMatchingRowsInCol_U(r, c, color, colors, m_Board.Rows() - 1) };
-            auto cd = m3::ColSpan { c, m3::GetMatchingRowsInCol_D(r, c, color, colors), r };
+        if (!load(DespawnGemIdsTag, state.m_DespawnGemIds) || !load(DespawnDstIdsTag, state.m_DespawnDstIds) ||
+            !load(DespawnTweensTag, state.m_DespawnTweens) || !load(FallGemIdsTag, state.m_FallGemIds) ||
+            !load(FallDstIdsTag, state.m_FallDstIds) || !load(FallTweensTag, state.m_FallTweens) ||
+            !IsLoadable(state))
+            return false;
 
-            const auto n = 3;
+        ApplyState(state);
+        return true;
+    }
 
-            if (rl.Count() >= n)
-            {
-                for (auto i = 0; i < rl.Count(); i++)
-                {
-                    auto r = rl.Row();
-                    auto c = rl[i];
-                    auto id = m_Board(r, c);
-                    idsToRemove.insert(id);
-                }
-            }
+    // Internal functions.
+private: 
+    // Same board size, every live gem is in the one cell its row and column name, every 
+    // id the tweens refer to is a live gem, and the selection is on the board, or none.
+    // RemoveGems and SortGems index m_Board with a gem's row and column, unchecked.
+    bool IsLoadable(const LoadedState& state) const
+    {
+        auto rows = m_Board.Rows();
+        auto cols = m_Board.Cols();
 
-            if (rr.Count() >= n)
-            {
-                for (auto i = 0; i < rr.Count(); i++)
-                {
-                    auto r = rr.Row();
-                    auto c = rr[i];
-                    auto id = m_Board(r, c);
-                    idsToRemove.insert(id);
-                }
-            }
+        if (state.m_Board.Rows() != rows || state.m_Board.Cols() != cols || 
+            state.m_Gems.Capacity() != m_Board.Count() ||
+            !state.m_Events.FitsBoard(rows, cols) || state.m_Step > state.m_Events.StepCount() ||
+            state.m_DespawnDstIds.size() != state.m_DespawnTweens.size() ||
+            state.m_FallDstIds.size() != state.m_FallTweens.size())
+            return false;
 
-            if (cu.Count() >= n)
-            {
-                for (auto i = 0; i < cu.Count(); i++)
-                {
-                    auto r = cu[i];
-                    auto c = cu.Col();
-                    auto id = m_Board(r, c);
-                    idsToRemove.insert(id);
-                }
-            }
+        auto& selected = state.m_Selected;
+        auto none = selected.m_Row == -1 && selected.m_Col == -1;
+        auto onBoard = selected.m_Row >= 0 && selected.m_Row < rows && selected.m_Col >= 0 && selected.m_Col < cols;
+        if (!none && !onBoard)
+            return false;
+
+        auto alive = [&state](const eastl::vector<m3::GemId>& ids)
+        {
+            return eastl::all_of(ids.begin(), ids.end(), [&state](m3::GemId id) { return state.m_Gems.Contains(id); });
+        };
 
-            if (cd.Count() >= n)
+        // A gem can only match the cell it names, so with as many full cells as live gems 
+        // no id is on the board twice.
+        auto occupied = 0U;
+        for (auto r = 0; r < rows.m_I; r++)
+        {
+            for (auto c = 0; c < cols.m_I; c++)
             {
-                for (auto i = 0; i < cd.Count(); i++)
-                {
-                    auto r = cd[i];
-                    auto c = cu.Col();
-                    auto id = m_Board(r, c);
-                    idsToRemove.insert(id);
-                }
+                auto id = state.m_Board(r, c);
+                if (id == m3::InvalidGemId)
+                    continue;
+
+                if (!state.m_Gems.Contains(id) || 
+                    state.m_Gems.Get<m3::GemComponent::Row>(id) != r || state.m_Gems.Get<m3::GemComponent::Col>(id) != c)
+                    return false;
+
+                occupied++;
             }
         }
 
-        if (idsToRemove.size() > 0)
+        return occupied == state.m_Gems.Count() && alive(state.m_DespawnGemIds) && alive(state.m_DespawnDstIds) && 
+            alive(state.m_FallGemIds) && alive(state.m_FallDstIds);
+    }
+
+    // After IsLoadable. Takes the state's buffers rather than copying them.
+    void ApplyState(LoadedState& state)
+    {
+        m_Simulation.SetColors(state.m_Colors);
+        m_Simulation.SetRandom(state.m_Random);
+        m_Events = eastl::move(state.m_Events);
+        m_Step = state.m_Step;
+        m_Board.Swap(state.m_Board);
+        m_Gems = eastl::move(state.m_Gems);
+
+        m_DespawnGemIds.swap(state.m_DespawnGemIds);
+        m_DespawnDstIds.swap(state.m_DespawnDstIds);
+        m_DespawnTweens.swap(state.m_DespawnTweens);
+        m_FallGemIds.swap(state.m_FallGemIds);
+        m_FallDstIds.swap(state.m_FallDstIds);
+        m_FallTweens.swap(state.m_FallTweens);
+
+        m_ViewWidth = state.m_ViewWidth;
+        m_ViewHeight = state.m_ViewHeight;
+        m_Selected = state.m_Selected;
+
+        m_DespawnDstIds_1.clear();
+        m_DespawnTweens_1.clear();
+        m_FallDstIds_1.clear();
+        m_FallTweens_1.clear();
+    }
+
+    inline Vector2 Position(m3::Row r, m3::Col c, float spriteSize)
+    {
+        const auto cr = Vector2((float)m_Board.Cols().m_I - 1, (float)m_Board.Rows().m_I - 1);
+        const auto origin = -0.5f * spriteSize * cr;
+        return origin + spriteSize * Vector2((float)c.m_I, (float)r.m_I);
+    }
+
+    inline float GemY(float ny, float spriteSize)
+    {
+        const auto cr = (float)m_Board.Rows().m_I - 1;
+        const auto origin = -0.5f * spriteSize * cr;
+        return origin + spriteSize * ny;
+    }
+
+    // Starts despawning the cells cleared in m_Step. Falls follow once they are gone.
+    void PlayStep()
+    {
+        if (m_Step == m_Events.StepCount())
         {
-            for (auto iter = idsToRemove.begin(); iter != idsToRemove.end(); iter++)
-            {
-                auto id = *iter;
-                auto idx = m_IdToIndex[id];
-                auto r = m_GemRows[idx];
-                auto c = m_GemCols[idx];
+            m_Events.Clear();
+            m_Step = 0;
+            return;
+        }
 
-                // @Todo: Compact to front?
-                DespawnGem(r, c);
-            }
+        for (auto& cell : m_Events.Cleared(m_Step))
+            DespawnGem(cell.m_Row, cell.m_Col);
+    }
+
+    // Moves and spawns of m_Step, once its despawns are done.
+    void PlayStepFalls()
+    {
+        for (auto& move : m_Events.Moves(m_Step))
+            MoveGem(move.m_Col, move.m_From, move.m_To);
+
+        // Spawns of a column are adjacent and bottom-up, new gems start stacked above the board.
+        auto spawns = m_Events.Spawns(m_Step);
+        auto dr = 0;
+        for (auto i = 0; i < spawns.size(); i++)
+        {
+            auto& spawn = spawns[i];
+            if (i == 0 || spawns[i - 1].m_Col != spawn.m_Col)
+                dr = (m_Board.Rows() - spawn.m_Row).m_I;
+
+            SpawnGem(spawn.m_Row, spawn.m_Col, spawn.m_Color, spawn.m_Row + dr);
+        }
+
+        if (m_FallGemIds.empty())
+        {
+            m_Step++;
+            PlayStep();
         }
     }
 
     void DespawnGem(m3::Row r, m3::Col c)
     {
         auto id = m_Board(r, c);
-        auto idx = m_IdToIndex[id];
         
         Tween despawnTween = {};
 
@@ -391,7 +660,7 @@ private:
         despawnTween.DurationMs = 200;
 
         m_DespawnGemIds.emplace_back(id);
-        m_DespawnDstIndices.emplace_back(idx);
+        m_DespawnDstIds.emplace_back(id);
         m_DespawnTweens.emplace_back(despawnTween);
     }
 
@@ -400,66 +669,33 @@ private:
         // Run scale animations and update gem scale.
         for (auto i = 0; i < m_DespawnTweens.size(); i++)
         {
-            auto dst = m_DespawnDstIndices[i];
+            auto dst = m_DespawnDstIds[i];
             auto& tween = m_DespawnTweens[i];
 
             auto scale = tween.Evaluate() * SpriteSize;
-            m_GemScales[dst] = { scale, scale };
+            m_Gems.Get<m3::GemComponent::Scale>(dst) = { scale, scale };
             m_DespawnTweens[i].ElapsedMs += dtSeconds * 1000.0f;
 
             if (!m_DespawnTweens[i].Completed())
             {
-                m_DespawnDstIndices_1.emplace_back(dst);
+                m_DespawnDstIds_1.emplace_back(dst);
                 m_DespawnTweens_1.emplace_back(tween);
             }
         }
 
-        m_DespawnDstIndices.clear();
+        m_DespawnDstIds.clear();
         m_DespawnTweens.clear();
 
-        eastl::swap(m_DespawnDstIndices, m_DespawnDstIndices_1);
+        eastl::swap(m_DespawnDstIds, m_DespawnDstIds_1);
         eastl::swap(m_DespawnTweens, m_DespawnTweens_1);
 
         if (m_DespawnGemIds.size() > 0 && m_DespawnTweens.size() == 0)
         {
-            // These are just for readability, and we want to avoid copying.
-            auto& despawnIds = m_DespawnGemIds;
-
-            // Destroy despawned gems.
-            // Also create a RowSpan above which gems are going to fall.
-            auto id = despawnIds[0];
-            auto idx = m_IdToIndex[id];
-            auto r = m_GemRows[idx];
-            auto c = m_GemCols[idx];
-            m3::RowSpan fallSpan = { r, c, c };
-
-            RemoveGemById(id);
-
-            for (auto i = 1; i < despawnIds.size(); i++)
-            {
-                id = despawnIds[i];
-                idx = m_IdToIndex[id];
-                r = m_GemRows[idx];
-                c = m_GemCols[idx];
-
-                fallSpan = 
-                {
-                    eastl::min(fallSpan.Row(), r),
-                    eastl::min(fallSpan.Col_0(), c),
-                    eastl::max(fallSpan.Col_1(), c)
-                };
-
-                RemoveGemById(id);
-            }
-
-            for (auto i = 0; i < fallSpan.Count(); i++)
-            {
-                auto r = fallSpan.Row();
-                auto c = fallSpan[i];
-                MakeGemsFall(r, c);
-            }
-
+            // Destroy despawned gems. What falls where was already decided by m_Simulation.
+            RemoveGems(m_DespawnGemIds);
             m_DespawnGemIds.clear();
+
+            PlayStepFalls();
         }
     }
 
@@ -468,111 +704,160 @@ private:
         // Run fall tweens and update gem position.
         for (auto i = 0; i < m_FallTweens.size(); i++)
         {
-            auto dst = m_FallDstIndices[i];
+            auto dst = m_FallDstIds[i];
             auto y = m_FallTweens[i].Evaluate();
 
-            m_GemPositions[dst].y = GemY(y, SpriteSize);
+            m_Gems.Get<m3::GemComponent::Position>(dst).y = GemY(y, SpriteSize);
             m_FallTweens[i].ElapsedMs += dtSeconds * 1000.0f;
 
             if (!m_FallTweens[i].Completed())
             {
                 // If the tween isn't completed tranfer it to the other vector.
                 m_FallTweens_1.emplace_back(m_FallTweens[i]);
-                m_FallDstIndices_1.emplace_back(m_FallDstIndices[i]);
+                m_FallDstIds_1.emplace_back(dst);
             }
         }
 
-        m_FallDstIndices.clear();
+        m_FallDstIds.clear();
         m_FallTweens.clear();
 
-        eastl::swap(m_FallDstIndices, m_FallDstIndices_1);
+        eastl::swap(m_FallDstIds, m_FallDstIds_1);
         eastl::swap(m_FallTweens, m_FallTweens_1);
 
         if (m_FallGemIds.size() > 0 && m_FallTweens.size() == 0)
         {
-            m_FallDstIndices.clear();
-            m_FallDstIndices_1.clear();
+            m_FallDstIds.clear();
+            m_FallDstIds_1.clear();
             m_FallTweens.clear();
             m_FallTweens_1.clear();
 
-            // @Todo: Ideally we should only be checking in the neighborhood of gems that fell into place.
-            FindAndClearFromWholeBoard();
-
-            // @Todo: We should only use these ids to check for matches. 
             // Right now this just helps signal completion of all fall tweens.
             m_FallGemIds.clear();
+
+            // Nothing is moving between steps, so maintenance goes here rather than per frame.
+            if (m_Gems.Unsorted() > m_Gems.Count() / ResortFraction)
+                SortGems();
+
+            m_Step++;
+            PlayStep();
         }
     }
 
-    void RemoveGemById(m3::GemId id)
+    // Window pixels to a cell: Position() run backwards through the camera in OnRender,
+    // which is centered with y up.
+    bool CellAt(int x, int y, m3::Cell* outCell) const
     {
-        auto index = m_IdToIndex.at(id);
-        auto r = m_GemRows[index];
-        auto c = m_GemCols[index];
+        auto rows = m_Board.Rows().m_I;
+        auto cols = m_Board.Cols().m_I;
+        auto c = (x - 0.5f * m_ViewWidth) / SpriteSize + 0.5f * cols;
+        auto r = (0.5f * m_ViewHeight - y) / SpriteSize + 0.5f * rows;
 
-        auto idBeingMoved = m_GemIds[m_GemIds.size() - 1];
-        m_IdToIndex[idBeingMoved] = index;
+        if (c < 0.0f || r < 0.0f || c >= cols || r >= rows)
+            return false;
 
-        m_Board(r, c) = m3::InvalidGemId;
+        *outCell = { (int)r, (int)c };
+        return true;
+    }
 
-        m_IdToIndex.erase(id);
-        m_GemIds.erase_unsorted(m_GemIds.begin() + index);
-        m_GemRows.erase_unsorted(m_GemRows.begin() + index);
-        m_GemCols.erase_unsorted(m_GemCols.begin() + index);
-        m_GemColors.erase_unsorted(m_GemColors.begin() + index);
+    // The presentation side of Simulation::ApplySwap, before the cascade plays.
+    void SwapGems(const m3::Swap& swap)
+    {
+        using namespace m3;
+
+        auto a = m_Board(swap.m_R0, swap.m_C0);
+        auto b = m_Board(swap.m_R1, swap.m_C1);
 
-        m_GemPositions.erase_unsorted(m_GemPositions.begin() + index);
-        m_GemScales.erase_unsorted(m_GemScales.begin() + index);
+        auto place = [this](GemId id, Row r, Col c)
+        {
+            m_Board(r, c) = id;
+            m_Gems.Get<GemComponent::Row>(id) = r;
+            m_Gems.Get<GemComponent::Col>(id) = c;
+            m_Gems.Get<GemComponent::Position>(id) = Position(r, c, SpriteSize);
+        };
+
+        place(a, swap.m_R1, swap.m_C1);
+        place(b, swap.m_R0, swap.m_C0);
     }
 
-    void MakeGemsFall(m3::Row r, m3::Col c)
+    // One pass, see GemChunks::RemoveN: survivors move at most once, within their own chunk.
+    void RemoveGems(eastl::span<const m3::GemId> ids)
     {
-        auto dr = 0;
-        for (; r < m_Board.Rows(); r = r + 1)
+        using namespace m3;
+
+        for (auto id : ids)
+            m_Board(m_Gems.Get<GemComponent::Row>(id), m_Gems.Get<GemComponent::Col>(id)) = InvalidGemId;
+
+        m_Gems.RemoveN(ids);
+    }
+
+    // Back into m_Board's order, so chunk iteration walks the board. Tweens hold ids, which
+    // survive the sort, so there is nothing to remap.
+    void SortGems()
+    {
+        using namespace m3;
+
+        m_Gems.SortBy([&](uint32_t chunk, uint32_t count, uint32_t* keys)
         {
-            auto id = m_Board(r, c);
-            
-            if (id == m3::InvalidGemId)
-                dr++;
-            else if (dr > 0)
-            {
-                auto index = m_IdToIndex[id];
+            auto rows = m_Gems.Array<GemComponent::Row>(chunk);
+            auto cols = m_Gems.Array<GemComponent::Col>(chunk);
 
-                m_Board(r - dr, c) = m_Board(r, c);
-                m_Board(r, c) = m3::InvalidGemId;
-                m_GemRows[index] = r - dr;
+            for (auto i = 0U; i < count; i++)
+                keys[i] = m_Board.Index(rows[i], cols[i]);
+        });
+    }
 
-                Tween fall = {};
+    void MoveGem(m3::Col c, m3::Row from, m3::Row to)
+    {
+        auto id = m_Board(from, c);
 
-                fall.Value_0 = r.m_I;
-                fall.Value_1 = (r - dr).m_I;
-                fall.DurationMs = dr * 100;
-                fall.EaseType = OutBounce;
+        m_Board(to, c) = id;
+        m_Board(from, c) = m3::InvalidGemId;
+        m_Gems.Get<m3::GemComponent::Row>(id) = to;
 
-                m_FallGemIds.emplace_back(id);
-                m_FallDstIndices.emplace_back(index);
-                m_FallTweens.emplace_back(fall);
-            }
-        }
+        FallGem(id, from, to);
+    }
+
+    // Places a new gem at (r, c), falling in from row rFrom.
+    void SpawnGem(m3::Row r, m3::Col c, m3::GemColor color, m3::Row rFrom)
+    {
+        auto id = m_Gems.Add(r, c, color, Position(rFrom, c, SpriteSize), { SpriteSize, SpriteSize });
+
+        m_Board(r, c) = id;
+
+        FallGem(id, rFrom, r);
+    }
+
+    void FallGem(m3::GemId id, m3::Row from, m3::Row to)
+    {
+        Tween fall = {};
+
+        fall.Value_0 = from.m_I;
+        fall.Value_1 = to.m_I;
+        fall.DurationMs = (from - to).m_I * 100;
+        fall.EaseType = OutBounce;
+
+        m_FallGemIds.emplace_back(id);
+        m_FallDstIds.emplace_back(id);
+        m_FallTweens.emplace_back(fall);
     }
 
 public:
-    Match3Game() :
-        m_Board(),
-        m_RandGenerator(0),
-        m_ColorDistribution(1, sizeof(m3::GemColors) - 1)
+    Match3Game(m3::Row rows = BoardRows, m3::Col cols = BoardCols) :
+        m_Simulation(rows, cols, 0),
+        m_Board(rows, cols),
+        m_Gems((uint32_t)rows.m_I * cols.m_I)
     {
         auto despawnReserve = m_Board.Count() / 4;
         m_DespawnGemIds.reserve(despawnReserve);
-        m_DespawnDstIndices.reserve(despawnReserve);
-        m_DespawnDstIndices_1.reserve(despawnReserve);
+        m_DespawnDstIds.reserve(despawnReserve);
+        m_DespawnDstIds_1.reserve(despawnReserve);
         m_DespawnTweens.reserve(despawnReserve);
         m_DespawnTweens_1.reserve(despawnReserve);
 
         auto fallReserve = m_Board.Count() / 2;
         m_FallGemIds.reserve(fallReserve);
-        m_FallDstIndices.reserve(fallReserve);
-        m_FallDstIndices_1.reserve(fallReserve);
+        m_FallDstIds.reserve(fallReserve);
+        m_FallDstIds_1.reserve(fallReserve);
         m_FallTweens.reserve(fallReserve);
         m_FallTweens_1.reserve(fallReserve);
     }
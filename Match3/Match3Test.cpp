@@ -1,13 +1,33 @@
 #ifdef Test__
 
 #define CATCH_CONFIG_RUNNER
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
 #define CatchAvailable__
 
 #include <SDL.h>
 #include <catch.hpp>
 
+#include "m3Serialize.hpp"
 #include "m3Board.hpp"
 #include "m3Match.hpp"
+#include "m3Bitboard.hpp"
+#include "m3RunScanner.hpp"
+#include "m3MatchGroups.hpp"
+#include "m3Gravity.hpp"
+#include "m3MatchKernel.hpp"
+#include "m3DirtyCells.hpp"
+#include "m3GemPool.hpp"
+#include "m3GemChunks.hpp"
+#include "m3Moves.hpp"
+#include "m3ThreadPool.hpp"
+#include "m3ParallelScan.hpp"
+#include "m3Random.hpp"
+#include "m3Generator.hpp"
+#include "m3Zobrist.hpp"
+#include "m3Simulation.hpp"
+#include "m3Snapshot.hpp"
+#include "m3Batch.hpp"
+#include "m3Solver.hpp"
 
 int main(int argc, char** argv) 
 {
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <EASTL\unique_ptr.h>
+#include <EASTL\vector.h>
+
+#include <chrono>
+
+#include "m3Simulation.hpp"
+#include "m3ThreadPool.hpp"
+
+namespace m3
+{
+    // Picks one of moves, which is never empty. Called from worker threads, 
+    // so it may only touch the board it is given and rng.
+    using MovePolicy = uint32_t (*)(const Simulation& board, const eastl::vector<Swap>& moves, Random& rng);
+
+    inline uint32_t FirstMovePolicy(const Simulation&, const eastl::vector<Swap>&, Random&) 
+    { 
+        return 0; 
+    }
+
+    inline uint32_t RandomMovePolicy(const Simulation&, const eastl::vector<Swap>& moves, Random& rng)
+    {
+        return (uint32_t)(((uint64_t)rng() * moves.size()) >> 32);
+    }
+
+    struct BatchStats
+    {
+        double m_Seconds = 0;
+        uint32_t m_Boards = 0;
+        uint64_t m_Moves = 0;
+
+        inline double BoardsPerSecond() const { return m_Seconds > 0 ? m_Boards / m_Seconds : 0; }
+        inline double MovesPerSecond() const { return m_Seconds > 0 ? m_Moves / m_Seconds : 0; }
+    };
+
+    /*
+        Plays the same level from many seeds. Board i is generated from seed + i, then 
+        up to MovesPerBoard moves are chosen by the policy and resolved, stopping early 
+        on a dead board. Boards are tasks on the pool, each one runs start to end on one 
+        worker. A board only touches its own Simulation, its slot in the result arrays 
+        and its worker's scratch, so results do not depend on the number of threads.
+    */
+    class BatchSimulation
+    {
+    private:
+        // Per worker, on its own cache lines.
+        struct alignas(64) Scratch
+        {
+            CascadeEvents m_Events;
+            eastl::vector<Swap> m_Moves;
+        };
+
+        Row m_Rows;
+        Col m_Cols;
+        uint64_t m_Seed;
+        eastl::vector<eastl::unique_ptr<Simulation>> m_Boards;
+        eastl::vector<Scratch, CacheLineAllocator> m_Scratch;
+
+        // Results, one entry per board.
+        eastl::vector<uint16_t> m_MovesMade;
+        eastl::vector<uint32_t> m_GemsCleared;
+        eastl::vector<uint32_t> m_Cascades;     // Steps over all moves.
+        eastl::vector<uint16_t> m_LongestChain; // Most steps one move resolved in.
+        eastl::vector<uint8_t> m_DeadBoard;     // Ran out of moves before MovesPerBoard.
+
+    public:
+        BatchSimulation(uint32_t boards, Row rows, Col cols, uint64_t seed = 0) :
+            m_Rows(rows),
+            m_Cols(cols),
+            m_Seed(seed),
+            m_MovesMade(boards),
+            m_GemsCleared(boards),
+            m_Cascades(boards),
+            m_LongestChain(boards),
+            m_DeadBoard(boards)
+        {
+            m_Boards.reserve(boards);
+            for (auto i = 0U; i < boards; i++)
+                m_Boards.push_back(eastl::unique_ptr<Simulation>(new Simulation(rows, cols, (uint32_t)(seed + i))));
+        }
+
+        inline uint32_t BoardCount() const { return (uint32_t)m_Boards.size(); }
+        inline const Simulation& Board(uint32_t i) const { return *m_Boards[i]; }
+
+        inline const eastl::vector<uint16_t>& MovesMade() const { return m_MovesMade; }
+        inline const eastl::vector<uint32_t>& GemsCleared() const { return m_GemsCleared; }
+        inline const eastl::vector<uint32_t>& Cascades() const { return m_Cascades; }
+        inline const eastl::vector<uint16_t>& LongestChain() const { return m_LongestChain; }
+        inline const eastl::vector<uint8_t>& DeadBoard() const { return m_DeadBoard; }
+
+        BatchStats Run(ThreadPool& pool, MovePolicy policy, uint16_t movesPerBoard, int minValidMoves = 3)
+        {
+            if (m_Scratch.size() < pool.WorkerCount())
+                m_Scratch.resize(pool.WorkerCount());
+
+            auto start = std::chrono::steady_clock::now();
+
+            pool.ParallelFor(BoardCount(), [&](uint32_t board, uint32_t worker)
+            {
+                RunBoard(board, m_Scratch[worker], policy, movesPerBoard, minValidMoves);
+            });
+
+            auto end = std::chrono::steady_clock::now();
+
+            BatchStats stats;
+            stats.m_Seconds = std::chrono::duration<double>(end - start).count();
+            stats.m_Boards = BoardCount();
+            for (auto moves : m_MovesMade)
+                stats.m_Moves += moves;
+
+            return stats;
+        }
+
+    private:
+        void RunBoard(uint32_t i, Scratch& scratch, MovePolicy policy, uint16_t movesPerBoard, int minValidMoves)
+        {
+            auto& board = *m_Boards[i];
+
+            // Seeded apart from the board's own generator, so policies do not shift its refills.
+            Random rng(~(m_Seed + i));
+
+            board.Generate(minValidMoves);
+
+            uint16_t moves = 0, longestChain = 0;
+            uint32_t cleared = 0, cascades = 0;
+            uint8_t dead = 0;
+
+            for (; moves < movesPerBoard; moves++)
+            {
+                if (board.FindValidMoves(&scratch.m_Moves) == 0)
+                {
+                    dead = 1;
+                    break;
+                }
+
+                auto& swap = scratch.m_Moves[policy(board, scratch.m_Moves, rng)];
+
+                scratch.m_Events.Clear();
+                auto applied = board.ApplySwap(swap, &scratch.m_Events);
+                assert(applied);
+                (void)applied;
+
+                auto steps = scratch.m_Events.StepCount();
+                cleared += scratch.m_Events.ClearedCount();
+                cascades += steps;
+                longestChain = eastl::max(longestChain, (uint16_t)steps);
+            }
+
+            m_MovesMade[i] = moves;
+            m_GemsCleared[i] = cleared;
+            m_Cascades[i] = cascades;
+            m_LongestChain[i] = longestChain;
+            m_DeadBoard[i] = dead;
+        }
+    };
+}
+
+#ifdef CatchAvailable__
+
+TEST_CASE("Batch simulation", "[batch][threads][simulation]")
+{
+    using namespace m3;
+
+    SECTION("Results do not depend on the thread count")
+    {
+        ThreadPool inline_(0), wide(5);
+
+        BatchSimulation a(200, 8, 8, 42), b(200, 8, 8, 42);
+        auto statsA = a.Run(inline_, RandomMovePolicy, 30);
+        auto statsB = b.Run(wide, RandomMovePolicy, 30);
+
+        REQUIRE(statsA.m_Moves == statsB.m_Moves);
+        REQUIRE(statsA.m_Boards == 200);
+        REQUIRE((a.MovesMade() == b.MovesMade()));
+        REQUIRE((a.GemsCleared() == b.GemsCleared()));
+        REQUIRE((a.Cascades() == b.Cascades()));
+        REQUIRE((a.LongestChain() == b.LongestChain()));
+        REQUIRE((a.DeadBoard() == b.DeadBoard()));
+
+        for (auto i = 0U; i < a.BoardCount(); i++)
+        {
+            auto moves = a.MovesMade()[i];
+            REQUIRE((moves == 30 || a.DeadBoard()[i] == 1));
+            REQUIRE(a.GemsCleared()[i] >= 3U * moves);
+            REQUIRE(a.Cascades()[i] >= moves);
+            REQUIRE(BitboardTest::WalkerMatches(a.Board(i).GetColors()).Count() == 0);
+        }
+    }
+
+    SECTION("Different policies, different games")
+    {
+        ThreadPool pool(2);
+        BatchSimulation a(50, 8, 8, 1), b(50, 8, 8, 1);
+
+        a.Run(pool, FirstMovePolicy, 20);
+        b.Run(pool, RandomMovePolicy, 20);
+
+        REQUIRE((a.GemsCleared() != b.GemsCleared()));
+    }
+}
+
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+
+TEST_CASE("Batch simulation throughput", "[.][benchmark][batch]")
+{
+    using namespace m3;
+
+    ThreadPool pool;
+    BatchSimulation batch(1000, 8, 8);
+
+    auto stats = batch.Run(pool, RandomMovePolicy, 50);
+    WARN(pool.WorkerCount() << " workers: " << stats.BoardsPerSecond() << " boards/s, " << stats.MovesPerSecond() << " moves/s");
+
+    BENCHMARK("1000 8x8 boards, 50 random moves each")
+    {
+        return batch.Run(pool, RandomMovePolicy, 50).m_Moves;
+    };
+}
+
+#endif
+
+#endif
@@ -0,0 +1,465 @@
+#pragma once
+
+#include <EASTL\vector.h>
+
+#include "m3Types.hpp"
+#include "m3Bits.hpp"
+
+namespace m3
+{
+    // One bit per cell, row-major, each row padded out to whole 64-bit words.
+    // Bit (c % 64) of word (r * WordsPerRow + c / 64) is cell (r, c). Padding bits are always 0.
+    class BoardMask
+    {
+    public:
+        using Word = uint64_t;
+        static const int WordBits = 64;
+
+    private:
+        Row m_Rows = 0;
+        Col m_Cols = 0;
+        uint32_t m_WordsPerRow = 0;
+        eastl::vector<Word> m_Words;
+
+    public:
+        BoardMask() = default;
+        BoardMask(Row rows, Col cols) { Resize(rows, cols); }
+
+        void Resize(Row rows, Col cols)
+        {
+            m_Rows = rows;
+            m_Cols = cols;
+            m_WordsPerRow = (cols.m_I + WordBits - 1) / WordBits;
+            m_Words.resize((size_t)m_WordsPerRow * rows.m_I);
+            Clear();
+        }
+
+        inline void Clear() { eastl::fill(m_Words.begin(), m_Words.end(), 0ULL); }
+
+        inline Row Rows() const { return m_Rows; }
+        inline Col Cols() const { return m_Cols; }
+        inline uint32_t WordsPerRow() const { return m_WordsPerRow; }
+
+        inline       Word* RowWords(Row r)       { return m_Words.data() + (size_t)r.m_I * m_WordsPerRow; }
+        inline const Word* RowWords(Row r) const { return m_Words.data() + (size_t)r.m_I * m_WordsPerRow; }
+
+        inline bool Test(Row r, Col c) const 
+        { 
+            return (RowWords(r)[c.m_I / WordBits] >> (c.m_I % WordBits)) & 1; 
+        }
+
+        inline void Set(Row r, Col c)   { RowWords(r)[c.m_I / WordBits] |= (1ULL << (c.m_I % WordBits)); }
+        inline void Reset(Row r, Col c) { RowWords(r)[c.m_I / WordBits] &= ~(1ULL << (c.m_I % WordBits)); }
+
+        // Cells c0..c1 of row r, inclusive. A word at a time.
+        void SetRange(Row r, Col c0, Col c1)
+        {
+            assert(c0 <= c1 && c1 < m_Cols);
+
+            auto words = RowWords(r);
+            const auto w0 = c0.m_I / WordBits;
+            const auto w1 = c1.m_I / WordBits;
+            const auto first = ~0ULL << (c0.m_I % WordBits);
+            const auto last = ~0ULL >> (WordBits - 1 - c1.m_I % WordBits);
+
+            if (w0 == w1)
+            {
+                words[w0] |= first & last;
+                return;
+            }
+
+            words[w0] |= first;
+            for (auto w = w0 + 1; w < w1; w++)
+                words[w] = ~0ULL;
+            words[w1] |= last;
+        }
+
+        uint32_t Count() const
+        {
+            uint32_t count = 0;
+            for (auto i = 0U; i < m_Words.size(); i++)
+                count += PopCount(m_Words[i]);
+            return count;
+        }
+
+        // Calls fn(r, c) for every set cell, in row-major order.
+        template <class Fn>
+        void ForEach(Fn fn) const
+        {
+            for (auto r = 0; r < m_Rows.m_I; r++)
+            {
+                auto words = RowWords(r);
+                for (auto w = 0U; w < m_WordsPerRow; w++)
+                    ForEachSetBit(words[w], [&](uint32_t bit) { fn(Row(r), Col(int(w * WordBits + bit))); });
+            }
+        }
+    };
+
+    // One BoardMask-shaped bit plane per valid GemColor.
+    // Runs are found with shifts and ANDs on whole words, so a 64 wide row 
+    // takes a handful of word operations per color instead of a walk per cell.
+    class ColorBitboards
+    {
+    public:
+        using Word = BoardMask::Word;
+        static const int WordBits = BoardMask::WordBits;
+
+    private:
+        Row m_Rows = 0;
+        Col m_Cols = 0;
+        uint32_t m_WordsPerRow = 0;
+        eastl::vector<Word> m_Planes; // NumGemColors planes, back to back.
+        eastl::vector<Word> m_RunStarts; // Scratch, one row.
+        int8_t m_PlaneOf[256]; // GemColor to plane, -1 for invalid colors.
+
+    public:
+        ColorBitboards() = default;
+        ColorBitboards(Row rows, Col cols) { Resize(rows, cols); }
+
+        void Resize(Row rows, Col cols)
+        {
+            m_Rows = rows;
+            m_Cols = cols;
+            m_WordsPerRow = (cols.m_I + WordBits - 1) / WordBits;
+            m_Planes.resize((size_t)NumGemColors * m_WordsPerRow * rows.m_I);
+            m_RunStarts.resize(m_WordsPerRow);
+
+            for (auto i = 0; i < 256; i++)
+                m_PlaneOf[i] = (int8_t)GemColorIndex(GemColor(i));
+
+            Clear();
+        }
+
+        inline void Clear() { eastl::fill(m_Planes.begin(), m_Planes.end(), 0ULL); }
+
+        inline Row Rows() const { return m_Rows; }
+        inline Col Cols() const { return m_Cols; }
+        inline uint32_t WordsPerRow() const { return m_WordsPerRow; }
+
+        inline Word* RowWords(int colorIndex, Row r)
+        { 
+            return m_Planes.data() + ((size_t)colorIndex * m_Rows.m_I + r.m_I) * m_WordsPerRow; 
+        }
+
+        inline const Word* RowWords(int colorIndex, Row r) const
+        { 
+            return m_Planes.data() + ((size_t)colorIndex * m_Rows.m_I + r.m_I) * m_WordsPerRow; 
+        }
+
+        // values(r, c) returns the GemColor of a cell.
+        template <class Values>
+        void Build(const Values& values)
+        {
+            for (auto r = 0; r < m_Rows.m_I; r++)
+                BuildRow(values, r);
+        }
+
+        template <class Values>
+        void BuildRow(const Values& values, Row r)
+        {
+            for (auto w = 0U; w < m_WordsPerRow; w++)
+            {
+                // Gather a whole word per color before storing it.
+                Word words[NumGemColors] = {};
+
+                const auto c0 = (int)w * WordBits;
+                const auto c1 = eastl::min(c0 + WordBits, (int)m_Cols.m_I);
+
+                for (auto c = c0; c < c1; c++)
+                {
+                    auto ci = m_PlaneOf[GemColor(values(r, c)).m_I];
+                    if (ci >= 0)
+                        words[ci] |= 1ULL << (c - c0);
+                }
+
+                for (auto ci = 0; ci < NumGemColors; ci++)
+                    RowWords(ci, r)[w] = words[ci];
+            }
+        }
+
+        // Invalid colors are ignored.
+        inline void Set(Row r, Col c, GemColor color)
+        {
+            auto ci = m_PlaneOf[color.m_I];
+            if (ci >= 0)
+                RowWords(ci, r)[c.m_I / WordBits] |= (1ULL << (c.m_I % WordBits));
+        }
+
+        inline void Reset(Row r, Col c)
+        {
+            const auto bit = ~(1ULL << (c.m_I % WordBits));
+            for (auto ci = 0; ci < NumGemColors; ci++)
+                RowWords(ci, r)[c.m_I / WordBits] &= bit;
+        }
+
+        GemColor Get(Row r, Col c) const
+        {
+            for (auto ci = 0; ci < NumGemColors; ci++)
+            {
+                if ((RowWords(ci, r)[c.m_I / WordBits] >> (c.m_I % WordBits)) & 1)
+                    return GemColors[ci + 1];
+            }
+
+            return InvalidColor;
+        }
+
+        // Sets every cell that is part of a horizontal or vertical run of at least minRun 
+        // same-colored cells. Same set of cells as walking left/right/up/down from every cell.
+        void FindMatches(BoardMask* outMask, int minRun = 3)
+        {
+            assert(minRun >= 1 && minRun < WordBits);
+            assert(outMask->Rows() == m_Rows && outMask->Cols() == m_Cols);
+
+            outMask->Clear();
+
+            for (auto ci = 0; ci < NumGemColors; ci++)
+            {
+                for (auto r = 0; r < m_Rows.m_I; r++)
+                    MarkRowRuns(RowWords(ci, r), outMask->RowWords(r), minRun);
+
+                for (auto r = 0; r + minRun <= m_Rows.m_I; r++)
+                    MarkColRuns(ci, r, outMask, minRun);
+            }
+        }
+
+    private:
+        // Runs along a row: a run of n starts at c if bits c..c+n-1 are set, which is 
+        // b & b>>1 & ... & b>>(n-1). Shifts carry across word boundaries.
+        void MarkRowRuns(const Word* bits, Word* out, int n)
+        {
+            const auto words = m_WordsPerRow;
+            auto starts = m_RunStarts.data();
+
+            for (auto w = 0U; w < words; w++)
+            {
+                const auto next = (w + 1 < words) ? bits[w + 1] : 0ULL;
+
+                auto m = bits[w];
+                for (auto k = 1; k < n; k++)
+                    m &= (bits[w] >> k) | (next << (WordBits - k));
+
+                starts[w] = m;
+            }
+
+            // Expand each start to cover its n cells: m | m<<1 | ... | m<<(n-1).
+            for (auto w = 0U; w < words; w++)
+            {
+                const auto prev = (w > 0) ? starts[w - 1] : 0ULL;
+
+                auto m = starts[w];
+                for (auto k = 1; k < n; k++)
+                    m |= (starts[w] << k) | (prev >> (WordBits - k));
+
+                out[w] |= m;
+            }
+        }
+
+        // Runs along a column: the AND of rows r..r+n-1, marked back into all n rows.
+        void MarkColRuns(int ci, Row r, BoardMask* outMask, int n)
+        {
+            for (auto w = 0U; w < m_WordsPerRow; w++)
+            {
+                auto m = RowWords(ci, r)[w];
+                for (auto k = 1; k < n && m != 0; k++)
+                    m &= RowWords(ci, r + k)[w];
+
+                if (m == 0)
+                    continue;
+
+                for (auto k = 0; k < n; k++)
+                    outMask->RowWords(r + k)[w] |= m;
+            }
+        }
+    };
+}
+
+#ifdef CatchAvailable__
+
+#include <random>
+#include "m3Match.hpp"
+
+namespace m3::BitboardTest
+{
+    using Colors = DynamicBoard<GemColor>;
+
+    inline Colors RandomBoard(int rows, int cols, uint32_t seed, bool withHoles)
+    {
+        std::mt19937 gen(seed);
+        std::uniform_int_distribution<int> dist(withHoles ? 0 : 1, NumGemColors);
+
+        Colors board(rows, cols);
+        for (auto r = 0; r < rows; r++)
+            for (auto c = 0; c < cols; c++)
+                board(r, c) = GemColors[dist(gen)];
+
+        return board;
+    }
+
+    // The walks Match3Game::FindAndClearFromWholeBoard used to do from every cell.
+    inline BoardMask WalkerMatches(const Colors& board, int n = 3)
+    {
+        BoardMask mask(board.Rows(), board.Cols());
+        const auto rMax = board.Rows() - 1;
+        const auto cMax = board.Cols() - 1;
+
+        for (auto r = 0; r < board.Rows().m_I; r++)
+        {
+            for (auto c = 0; c < board.Cols().m_I; c++)
+            {
+                auto color = board(r, c);
+                if (color == InvalidColor)
+                    continue;
+
+                auto rl = RowSpan { r, GetMatchingColsInRow_L(r, c, color, board), c };
+                auto rr = RowSpan { r, c, GetMatchingColsInRow_R(r, c, color, board, cMax) };
+                auto cu = ColSpan { c, r, GetMatchingRowsInCol_U(r, c, color, board, rMax) };
+                auto cd = ColSpan { c, GetMatchingRowsInCol_D(r, c, color, board), r };
+
+                for (auto& rs : { rl, rr })
+                    if (rs.Count() >= n)
+                        for (auto i = 0; i < rs.Count(); i++)
+                            mask.Set(rs.Row(), rs[i]);
+
+                for (auto& cs : { cu, cd })
+                    if (cs.Count() >= n)
+                        for (auto i = 0; i < cs.Count(); i++)
+                            mask.Set(cs[i], cs.Col());
+            }
+        }
+
+        return mask;
+    }
+
+    inline bool SameCells(const BoardMask& a, const BoardMask& b)
+    {
+        for (auto r = 0; r < a.Rows().m_I; r++)
+            for (auto c = 0; c < a.Cols().m_I; c++)
+                if (a.Test(r, c) != b.Test(r, c))
+                    return false;
+        return true;
+    }
+}
+
+TEST_CASE("Bitboard matching", "[bitboard][matching]")
+{
+    using namespace m3;
+    using namespace m3::BitboardTest;
+
+    SECTION("Known board")
+    {
+        const char colors_[] = 
+               /*|*/
+            ___01234567
+            _4"BRBGYBRO"
+            _3"OYBOGYBR"
+            _2"BBBBBBYB" //--
+            _1"BRBBROGY"
+            _0"YBROBROG";
+
+        Colors colors(5, 8);
+        Colors::CreateInverted(colors_, sizeof(colors_), &colors);
+
+        ColorBitboards bitboards(5, 8);
+        bitboards.Build(colors);
+
+        BoardMask mask(5, 8);
+        bitboards.FindMatches(&mask);
+
+        REQUIRE(mask.Count() == 9);
+        for (auto c = 0; c <= 5; c++)
+            REQUIRE(mask.Test(2, c));
+        for (auto r = 1; r <= 4; r++)
+            REQUIRE(mask.Test(r, 2));
+    }
+
+    SECTION("Get and Reset round-trip")
+    {
+        auto colors = RandomBoard(7, 70, 1, true);
+
+        ColorBitboards bitboards(7, 70);
+        bitboards.Build(colors);
+
+        for (auto r = 0; r < 7; r++)
+            for (auto c = 0; c < 70; c++)
+                REQUIRE(bitboards.Get(r, c) == colors(r, c));
+
+        bitboards.Reset(3, 65);
+        REQUIRE(bitboards.Get(3, 65) == InvalidColor);
+    }
+
+    SECTION("Same cells as the walkers on random boards of arbitrary width")
+    {
+        const int sizes[][2] = { { 1, 1 }, { 3, 3 }, { 8, 8 }, { 5, 63 }, { 9, 64 }, { 17, 65 }, { 64, 64 }, { 33, 130 }, { 130, 7 } };
+
+        for (auto& size : sizes)
+        {
+            for (auto seed = 0U; seed < 8; seed++)
+            {
+                auto colors = RandomBoard(size[0], size[1], seed, (seed & 1) != 0);
+
+                ColorBitboards bitboards(size[0], size[1]);
+                bitboards.Build(colors);
+
+                BoardMask mask(size[0], size[1]);
+                bitboards.FindMatches(&mask);
+
+                auto expected = WalkerMatches(colors);
+
+                INFO("Board " << size[0] << "x" << size[1] << " seed " << seed);
+                REQUIRE(SameCells(mask, expected));
+            }
+        }
+    }
+
+    SECTION("Longer minimum runs")
+    {
+        auto colors = RandomBoard(40, 100, 7, false);
+
+        ColorBitboards bitboards(40, 100);
+        bitboards.Build(colors);
+
+        for (auto n : { 1, 2, 4, 5 })
+        {
+            BoardMask mask(40, 100);
+            bitboards.FindMatches(&mask, n);
+            REQUIRE(SameCells(mask, WalkerMatches(colors, n)));
+        }
+    }
+}
+
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+
+TEST_CASE("Bitboard vs walker whole board scan", "[.][benchmark][bitboard]")
+{
+    using namespace m3;
+    using namespace m3::BitboardTest;
+
+    for (auto n : { 64, 512, 2048 })
+    {
+        auto colors = RandomBoard(n, n, 0, false);
+        auto size = std::to_string(n) + "x" + std::to_string(n);
+
+        ColorBitboards bitboards(n, n);
+        BoardMask mask(n, n);
+        eastl::vector<uint8_t> cleared(colors.Size());
+
+        BENCHMARK("Walkers " + size) { return BoardBench::WholeBoardScan(colors, cleared); };
+        BENCHMARK("Bitboards " + size + " (build + find)") 
+        { 
+            bitboards.Build(colors);
+            bitboards.FindMatches(&mask);
+            return mask.Count();
+        };
+
+        bitboards.Build(colors);
+        BENCHMARK("Bitboards " + size + " (find)") 
+        { 
+            bitboards.FindMatches(&mask);
+            return mask.Count();
+        };
+    }
+}
+
+#endif
+
+#endif
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace m3
+{
+    // Bit-twiddling helpers for 64-bit words.
+
+    inline uint32_t CountTrailingZeros(uint64_t x)
+    {
+        assert(x != 0);
+    #if defined(_MSC_VER) && defined(_M_X64)
+        unsigned long index;
+        _BitScanForward64(&index, x);
+        return (uint32_t)index;
+    #elif defined(_MSC_VER)
+        unsigned long index;
+        if (_BitScanForward(&index, (uint32_t)x))
+            return (uint32_t)index;
+        _BitScanForward(&index, (uint32_t)(x >> 32));
+        return (uint32_t)index + 32;
+    #else
+        return (uint32_t)__builtin_ctzll(x);
+    #endif
+    }
+
+    inline uint32_t PopCount(uint64_t x)
+    {
+    #if defined(_MSC_VER) && defined(_M_X64)
+        return (uint32_t)__popcnt64(x);
+    #elif defined(_MSC_VER)
+        return (uint32_t)(__popcnt((uint32_t)x) + __popcnt((uint32_t)(x >> 32)));
+    #else
+        return (uint32_t)__builtin_popcountll(x);
+    #endif
+    }
+
+    // Mask with the low n bits set, n in [0, 64].
+    inline uint64_t LowBits(uint32_t n)
+    {
+        return n >= 64 ? ~0ULL : ((1ULL << n) - 1);
+    }
+
+    // Calls fn(bitIndex) for every set bit, lowest first.
+    template <class Fn>
+    inline void ForEachSetBit(uint64_t x, Fn fn)
+    {
+        while (x != 0)
+        {
+            fn(CountTrailingZeros(x));
+            x &= x - 1;
+        }
+    }
+}
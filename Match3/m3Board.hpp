@@ -1,24 +1,101 @@
 #pragma once
 
 #include "m3Types.hpp"
+#include "m3Serialize.hpp"
 #include <EASTL\array.h>
 #include <EASTL\type_traits.h>
+#include <EASTL\utility.h>
+
+#include <new>
 
 namespace m3
 {
-    // @Todo: Use a vector instead of an array so size can be set at runtime.
-    template <class T, int R, int C>
+    // Storage layout policies. 
+    // Stride() is the distance between consecutive rows (or columns, or rows of tiles) 
+    // and is rounded up to a multiple of `granularity` elements where that makes sense.
+    // Index() maps a cell to its offset, and Size() is the element count of the storage.
+
+    struct RowMajor
+    {
+        static const bool RowsAreContiguous = true;
+
+        static constexpr uint32_t Stride(uint32_t /*rows*/, uint32_t cols, uint32_t granularity)
+        { 
+            return ((cols + granularity - 1) / granularity) * granularity; 
+        }
+
+        static constexpr size_t Size(uint32_t rows, uint32_t /*cols*/, uint32_t stride)
+        { 
+            return (size_t)rows * stride; 
+        }
+
+        static constexpr uint32_t Index(uint32_t r, uint32_t c, uint32_t stride)
+        { 
+            return r * stride + c; 
+        }
+    };
+
+    // Columns are sequential, which suits falls.
+    struct ColMajor
+    {
+        static const bool RowsAreContiguous = false;
+
+        static constexpr uint32_t Stride(uint32_t rows, uint32_t /*cols*/, uint32_t granularity)
+        { 
+            return ((rows + granularity - 1) / granularity) * granularity; 
+        }
+
+        static constexpr size_t Size(uint32_t /*rows*/, uint32_t cols, uint32_t stride)
+        { 
+            return (size_t)cols * stride; 
+        }
+
+        static constexpr uint32_t Index(uint32_t r, uint32_t c, uint32_t stride)
+        { 
+            return c * stride + r; 
+        }
+    };
+
+    // 8x8 tiles, row-major inside a tile and between tiles.
+    // A cell and all its neighbours are usually in the same 64 element block.
+    // Stride is the number of tiles in a row of tiles.
+    struct Tiled8x8
+    {
+        static const bool RowsAreContiguous = false;
+
+        static constexpr uint32_t Stride(uint32_t /*rows*/, uint32_t cols, uint32_t /*granularity*/)
+        { 
+            return (cols + 7) / 8; 
+        }
+
+        static constexpr size_t Size(uint32_t rows, uint32_t /*cols*/, uint32_t stride)
+        { 
+            return (size_t)((rows + 7) / 8) * stride * 64; 
+        }
+
+        static constexpr uint32_t Index(uint32_t r, uint32_t c, uint32_t stride)
+        { 
+            return (((r >> 3) * stride + (c >> 3)) << 6) + ((r & 7) << 3) + (c & 7); 
+        }
+    };
+
+    // Fixed-size board. See DynamicBoard for a board sized at runtime.
+    template <class T, int R, int C, class Layout = RowMajor>
     struct Board
     {
         static_assert(eastl::is_pod<T>::value);
-        using Array = eastl::array<T, R * C>;
         using Type = T;
+        using LayoutType = Layout;
+
+        static const uint32_t Stride = Layout::Stride(R, C, 1);
+        using Array = eastl::array<T, Layout::Size(R, C, Stride)>;
 
         Array m_Array;
 
         // @Todo: Ideally should do nothing. Does this memset to 0?
         Board() = default;
 
+        // Copies raw storage, so data must already be in this board's layout.
         Board(const void* data, size_t dataSize) 
         {
             dataSize = eastl::min(dataSize, sizeof(m_Array));
@@ -28,15 +105,22 @@ namespace m3
         // Make with an inverted y-axis
         static void CreateInverted(const void* data, size_t dataSize, Board* outBoard)
         {
-            assert(dataSize >= sizeof(m_Array));
+            assert(dataSize >= sizeof(T) * R * C);
 
             const auto rowSize = sizeof(T) * outBoard->Cols().m_I;
 
             for (auto r = 0; r < outBoard->Rows().m_I; r++)
             {
                 auto src = (T*)data + (outBoard->Cols().m_I * r);
-                auto dst = &(*outBoard)((outBoard->Rows().m_I - 1) - r, 0);
-                memcpy(dst, src, rowSize);
+                auto dr = (outBoard->Rows().m_I - 1) - r;
+
+                if constexpr (Layout::RowsAreContiguous)
+                    memcpy(&(*outBoard)(dr, 0), src, rowSize);
+                else
+                {
+                    for (auto c = 0; c < outBoard->Cols().m_I; c++)
+                        (*outBoard)(dr, c) = src[c];
+                }
             }
         }
 
@@ -47,8 +131,7 @@ namespace m3
         inline uint32_t Index(Row r, Col c) const 
         { 
             assert(IsWithinBounds(r, c));
-            // return c * Rows() + r; 
-            return r.m_I * Cols().m_I + c.m_I;
+            return Layout::Index(r.m_I, c.m_I, Stride);
         }
 
         inline       T& operator() (Row r, Col c)       { return m_Array[Index(r, c)]; }
@@ -59,10 +142,285 @@ namespace m3
             return r >= 0 && r < Rows() && c >= 0 && c < Cols();
         }
     };
+
+    template <class T, class Layout>
+    struct BoardRef;
+
+    // Same interface as Board, but the size is set at runtime.
+    // All cells live in a single aligned allocation, and each row (or column for ColMajor) 
+    // is padded out to a multiple of PitchAlignment bytes so it can be read with SIMD loads.
+    template <class T, class Layout = RowMajor>
+    struct DynamicBoard
+    {
+        static_assert(eastl::is_pod<T>::value);
+        static_assert((sizeof(T) & (sizeof(T) - 1)) == 0, "Element size must be a power of 2.");
+        using Type = T;
+        using LayoutType = Layout;
+
+        static const size_t PitchAlignment = 32;
+        static const uint32_t PitchGranularity = 
+            sizeof(T) < PitchAlignment ? PitchAlignment / sizeof(T) : 1;
+
+        T* m_Data = nullptr;
+        Row m_Rows = 0;
+        Col m_Cols = 0;
+        uint32_t m_Pitch = 0; // Layout stride, in elements for RowMajor and ColMajor.
+
+        DynamicBoard() = default;
+
+        DynamicBoard(Row rows, Col cols) 
+        { 
+            Allocate(rows, cols); 
+        }
+
+        DynamicBoard(Row rows, Col cols, const void* data, size_t dataSize)
+        {
+            Allocate(rows, cols);
+
+            const auto rowSize = sizeof(T) * cols.m_I;
+            dataSize = eastl::min(dataSize, rowSize * rows.m_I);
+
+            for (auto r = 0; r < rows.m_I && dataSize > 0; r++)
+            {
+                const auto size = eastl::min(dataSize, rowSize);
+                CopyRow(r, (const T*)((const uint8_t*)data + rowSize * r), Col((int)(size / sizeof(T))));
+                dataSize -= size;
+            }
+        }
+
+        DynamicBoard(const DynamicBoard& other) 
+        {
+            Allocate(other.m_Rows, other.m_Cols);
+            memcpy(m_Data, other.m_Data, SizeInBytes());
+        }
+
+        DynamicBoard(DynamicBoard&& other) 
+        {
+            Swap(other);
+        }
+
+        DynamicBoard& operator= (const DynamicBoard& other)
+        {
+            if (this != &other)
+            {
+                DynamicBoard copy(other);
+                Swap(copy);
+            }
+
+            return *this;
+        }
+
+        DynamicBoard& operator= (DynamicBoard&& other)
+        {
+            Swap(other);
+            return *this;
+        }
+
+        ~DynamicBoard() 
+        { 
+            Free(); 
+        }
+
+        // Make with an inverted y-axis. outBoard must already be sized.
+        static void CreateInverted(const void* data, size_t dataSize, DynamicBoard* outBoard)
+        {
+            assert(dataSize >= sizeof(T) * outBoard->Count());
+
+            for (auto r = 0; r < outBoard->Rows().m_I; r++)
+            {
+                auto src = (T*)data + (outBoard->Cols().m_I * r);
+                outBoard->CopyRow((outBoard->Rows().m_I - 1) - r, src, outBoard->Cols());
+            }
+        }
+
+        inline Row Rows() const { return m_Rows; }
+        inline Col Cols() const { return m_Cols; }
+        inline uint32_t Count() const { return (uint32_t)m_Rows.m_I * m_Cols.m_I; }
+        inline uint32_t Pitch() const { return m_Pitch; }
+        inline size_t Size() const { return Layout::Size(m_Rows.m_I, m_Cols.m_I, m_Pitch); }
+        inline size_t SizeInBytes() const { return sizeof(T) * Size(); }
+
+        inline       T* Data()       { return m_Data; }
+        inline const T* Data() const { return m_Data; }
+
+        // Only for layouts where rows are contiguous.
+        inline T* RowData(Row r)
+        { 
+            static_assert(Layout::RowsAreContiguous);
+            return m_Data + (size_t)r.m_I * m_Pitch; 
+        }
+
+        inline const T* RowData(Row r) const
+        { 
+            static_assert(Layout::RowsAreContiguous);
+            return m_Data + (size_t)r.m_I * m_Pitch; 
+        }
+
+        inline uint32_t Index(Row r, Col c) const 
+        { 
+            assert(IsWithinBounds(r, c));
+            return Layout::Index(r.m_I, c.m_I, m_Pitch);
+        }
+
+        inline       T& operator() (Row r, Col c)       { return m_Data[Index(r, c)]; }
+        inline const T& operator() (Row r, Col c) const { return m_Data[Index(r, c)]; }
+
+        inline bool IsWithinBounds(Row r, Col c) const
+        {
+            return r >= 0 && r < Rows() && c >= 0 && c < Cols();
+        }
+
+        // Also fills the padding.
+        void Fill(const T& value)
+        {
+            const auto n = Size();
+            for (auto i = 0U; i < n; i++)
+                m_Data[i] = value;
+        }
+
+        void CopyRow(Row r, const T* src, Col count)
+        {
+            if constexpr (Layout::RowsAreContiguous)
+                memcpy(RowData(r), src, sizeof(T) * count.m_I);
+            else
+            {
+                for (auto c = 0; c < count.m_I; c++)
+                    (*this)(r, c) = src[c];
+            }
+        }
+
+        void Swap(DynamicBoard& other)
+        {
+            eastl::swap(m_Data, other.m_Data);
+            eastl::swap(m_Rows, other.m_Rows);
+            eastl::swap(m_Cols, other.m_Cols);
+            eastl::swap(m_Pitch, other.m_Pitch);
+        }
+
+        // Padding included, so a loaded board reads exactly like the saved one.
+        void Save(BinaryWriter& writer) const
+        {
+            writer.Write(m_Rows);
+            writer.Write(m_Cols);
+            writer.WriteBytes(m_Data, SizeInBytes());
+        }
+
+        // Same layout, so a plain copy. Reallocates if the size differs.
+        void CopyFrom(const BoardRef<T, Layout>& other)
+        {
+            if (other.Rows() != m_Rows || other.Cols() != m_Cols)
+            {
+                DynamicBoard board(other.Rows(), other.Cols());
+                Swap(board);
+            }
+
+            assert(other.Pitch() == m_Pitch);
+            memcpy(m_Data, other.Data(), SizeInBytes());
+        }
+
+        // Reallocates if the size differs, but only once the bytes are known to be there.
+        bool Load(BinaryReader& reader)
+        {
+            auto rows = reader.Read<Row>();
+            auto cols = reader.Read<Col>();
+            if (!reader.Ok() || rows <= 0 || cols <= 0)
+                return false;
+
+            auto pitch = Layout::Stride(rows.m_I, cols.m_I, PitchGranularity);
+            if (sizeof(T) * Layout::Size(rows.m_I, cols.m_I, pitch) > reader.Remaining())
+                return false;
+
+            if (rows != m_Rows || cols != m_Cols)
+            {
+                DynamicBoard board(rows, cols);
+                Swap(board);
+            }
+
+            return reader.ReadBytes(m_Data, SizeInBytes());
+        }
+
+    private:
+        void Allocate(Row rows, Col cols)
+        {
+            assert(rows > 0 && cols > 0);
+
+            m_Rows = rows;
+            m_Cols = cols;
+            m_Pitch = Layout::Stride(rows.m_I, cols.m_I, PitchGranularity);
+            m_Data = (T*)::operator new(SizeInBytes(), std::align_val_t(PitchAlignment));
+
+            // Zero the padding too, so whole-row reads are deterministic.
+            memset(m_Data, 0, SizeInBytes());
+        }
+
+        void Free()
+        {
+            if (m_Data != nullptr)
+                ::operator delete(m_Data, std::align_val_t(PitchAlignment));
+
+            m_Data = nullptr;
+        }
+    };
+
+    // Read-only view of cells laid out exactly like a DynamicBoard of the same size, 
+    // eg. a board in a mapped snapshot. Doesn't own the cells.
+    template <class T, class Layout = RowMajor>
+    struct BoardRef
+    {
+        using Type = T;
+        using LayoutType = Layout;
+
+        const T* m_Data = nullptr;
+        Row m_Rows = 0;
+        Col m_Cols = 0;
+        uint32_t m_Pitch = 0;
+
+        BoardRef() = default;
+
+        BoardRef(const T* data, Row rows, Col cols, uint32_t pitch) :
+            m_Data(data), m_Rows(rows), m_Cols(cols), m_Pitch(pitch)
+        {}
+
+        BoardRef(const DynamicBoard<T, Layout>& board) :
+            BoardRef(board.Data(), board.Rows(), board.Cols(), board.Pitch())
+        {}
+
+        inline bool Empty() const { return m_Data == nullptr; }
+
+        inline Row Rows() const { return m_Rows; }
+        inline Col Cols() const { return m_Cols; }
+        inline uint32_t Count() const { return (uint32_t)m_Rows.m_I * m_Cols.m_I; }
+        inline uint32_t Pitch() const { return m_Pitch; }
+        inline size_t Size() const { return Layout::Size(m_Rows.m_I, m_Cols.m_I, m_Pitch); }
+        inline size_t SizeInBytes() const { return sizeof(T) * Size(); }
+
+        inline const T* Data() const { return m_Data; }
+
+        inline const T* RowData(Row r) const
+        { 
+            static_assert(Layout::RowsAreContiguous);
+            return m_Data + (size_t)r.m_I * m_Pitch; 
+        }
+
+        inline uint32_t Index(Row r, Col c) const 
+        { 
+            assert(IsWithinBounds(r, c));
+            return Layout::Index(r.m_I, c.m_I, m_Pitch);
+        }
+
+        inline const T& operator() (Row r, Col c) const { return m_Data[Index(r, c)]; }
+
+        inline bool IsWithinBounds(Row r, Col c) const
+        {
+            return r >= 0 && r < Rows() && c >= 0 && c < Cols();
+        }
+    };
 }
 
 #ifdef CatchAvailable__
 
+#include <EASTL\vector.h>
+
 #pragma region Rows/Cols
 #define _0
 #define _1
@@ -108,4 +466,159 @@ TEST_CASE("Inverted board creation", "[board]")
     REQUIRE(0 == SDL_memcmp(&colors, invertedColors, sizeof(colors)));
 }
 
+TEST_CASE("Dynamic board", "[board]")
+{
+    using namespace m3;
+
+    const int Rows = 5;
+    const int Cols = 8;
+
+    const char colors_[] = 
+        ___01234567
+        _4"BROGYBRO"
+        _3"OBROGYBR"
+        _2"ROBROGYB"
+        _1"BROBROGY"
+        _0"YBROBROG";
+
+    using GemColors = DynamicBoard<gem_color_t>;
+
+    SECTION("Row pitch is padded and aligned")
+    {
+        GemColors colors(Rows, Cols);
+
+        REQUIRE(colors.Count() == Rows * Cols);
+        REQUIRE(colors.Pitch() >= (uint32_t)Cols);
+        REQUIRE((colors.Pitch() * sizeof(gem_color_t)) % GemColors::PitchAlignment == 0);
+        REQUIRE(((uintptr_t)colors.Data() % GemColors::PitchAlignment) == 0);
+        REQUIRE(colors.Index(1, 0) == colors.Pitch());
+    }
+
+    SECTION("Inverted creation matches the fixed-size board")
+    {
+        using FixedColors = Board<gem_color_t, Rows, Cols>;
+
+        FixedColors fixed;
+        FixedColors::CreateInverted(colors_, sizeof(colors_), &fixed);
+
+        GemColors colors(Rows, Cols);
+        GemColors::CreateInverted(colors_, sizeof(colors_), &colors);
+
+        for (auto r = 0; r < Rows; r++)
+            for (auto c = 0; c < Cols; c++)
+                REQUIRE(colors(r, c) == fixed(r, c));
+    }
+
+    SECTION("Copies are deep")
+    {
+        GemColors a(Rows, Cols, colors_, sizeof(colors_));
+        GemColors b = a;
+
+        b(0, 0) = 'X';
+
+        REQUIRE(a(0, 0) == 'B');
+        REQUIRE(b(0, 0) == 'X');
+        REQUIRE(b(4, 7) == a(4, 7));
+    }
+
+    SECTION("Load checks the size before allocating")
+    {
+        GemColors a(Rows, Cols, colors_, sizeof(colors_));
+
+        eastl::vector<uint8_t> bytes;
+        BinaryWriter writer(&bytes);
+        a.Save(writer);
+
+        GemColors b;
+        BinaryReader reader(bytes.data(), bytes.size());
+        REQUIRE(b.Load(reader));
+        REQUIRE(b(4, 7) == a(4, 7));
+
+        GemColors c;
+        BinaryReader truncated(bytes.data(), bytes.size() - 1);
+        REQUIRE(!c.Load(truncated));
+        REQUIRE(c.Count() == 0);
+
+        // A huge board with no bytes behind it fails, and leaves the board as it was.
+        Row huge = 30000;
+        memcpy(bytes.data(), &huge, sizeof(huge));
+        memcpy(bytes.data() + sizeof(huge), &huge, sizeof(huge));
+
+        BinaryReader corrupt(bytes.data(), bytes.size());
+        REQUIRE(!b.Load(corrupt));
+        REQUIRE(b.Rows() == Rows);
+        REQUIRE(b(4, 7) == a(4, 7));
+    }
+}
+
+TEMPLATE_TEST_CASE("Board layouts", "[board]", m3::RowMajor, m3::ColMajor, m3::Tiled8x8)
+{
+    using namespace m3;
+
+    const int Rows = 11;
+    const int Cols = 13;
+
+    SECTION("Every cell maps to a distinct index within storage")
+    {
+        using Fixed = Board<uint8_t, Rows, Cols, TestType>;
+        using Dynamic = DynamicBoard<uint8_t, TestType>;
+
+        Fixed fixed;
+        Dynamic dynamic(Rows, Cols);
+
+        eastl::vector<bool> fixedSeen(sizeof(fixed.m_Array), false);
+        eastl::vector<bool> dynamicSeen(dynamic.Size(), false);
+
+        for (auto r = 0; r < Rows; r++)
+        {
+            for (auto c = 0; c < Cols; c++)
+            {
+                auto fi = fixed.Index(r, c);
+                auto di = dynamic.Index(r, c);
+
+                REQUIRE(fi < fixedSeen.size());
+                REQUIRE(di < dynamicSeen.size());
+                REQUIRE(!fixedSeen[fi]);
+                REQUIRE(!dynamicSeen[di]);
+
+                fixedSeen[fi] = true;
+                dynamicSeen[di] = true;
+            }
+        }
+    }
+
+    SECTION("Inverted creation is layout independent")
+    {
+        const char colors_[] = 
+            ___01234567
+            _4"BROGYBRO"
+            _3"OBROGYBR"
+            _2"ROBROGYB"
+            _1"BROBROGY"
+            _0"YBROBROG";
+
+        using RowMajorColors = Board<gem_color_t, 5, 8>;
+        using Colors = Board<gem_color_t, 5, 8, TestType>;
+        using DynamicColors = DynamicBoard<gem_color_t, TestType>;
+
+        RowMajorColors expected;
+        RowMajorColors::CreateInverted(colors_, sizeof(colors_), &expected);
+
+        Colors colors;
+        Colors::CreateInverted(colors_, sizeof(colors_), &colors);
+
+        DynamicColors dynamicColors(5, 8);
+        DynamicColors::CreateInverted(colors_, sizeof(colors_), &dynamicColors);
+
+        for (auto r = 0; r < 5; r++)
+        {
+            for (auto c = 0; c < 8; c++)
+            {
+                REQUIRE(colors(r, c) == expected(r, c));
+                REQUIRE(dynamicColors(r, c) == expected(r, c));
+            }
+        }
+    }
+}
+
 #endif
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <SpriteRenderer.hpp>
 
 #include "m3Board.hpp"
+#include "m3GemStore.hpp"
 
 namespace m3
 {
@@ -121,19 +122,21 @@ namespace m3
             return Color(0, 0, 0, 0);
         }
 
-        void RenderGems(
-            const eastl::vector<Vector2> positions, 
-            const eastl::vector<Vector2> scales, 
-            const eastl::vector<m3::GemColor> colors)
+        // Chunk by chunk, each chunk's three arrays are read straight through.
+        void RenderGems(const GemStore& gems)
         {
-            for (auto i = 0; i < positions.size(); i++)
+            gems.ForEachChunk([&](uint32_t chunk, uint32_t count)
             {
-                auto position = positions[i];
-                auto scale = scales[i];
-                auto tint = ToColor(colors[i]);
+                auto positions = gems.Array<GemComponent::Position>(chunk);
+                auto scales = gems.Array<GemComponent::Scale>(chunk);
+                auto colors = gems.Array<GemComponent::Color>(chunk);
 
-                m_SpriteRenderer.Draw(position, scale, tint, 0);
-            }
+                for (auto i = 0U; i < count; i++)
+                {
+                    auto tint = ToColor(colors[i]);
+                    m_SpriteRenderer.Draw(positions[i], scales[i], tint, 0);
+                }
+            });
         }
 
         inline void EndRender()
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <EASTL\sort.h>
+#include <EASTL\vector.h>
+
+#include "m3Types.hpp"
+#include "m3Bitboard.hpp"
+#include "m3Match.hpp"
+
+namespace m3
+{
+    // Cells that changed since the last match scan, grown by the match radius.
+    // Rows with any dirty cell are also kept in a list, so clearing and iterating cost 
+    // grows with the dirty rows rather than with the board.
+    class DirtyCells
+    {
+    private:
+        BoardMask m_Mask;
+        eastl::vector<uint8_t> m_RowIsDirty;
+        eastl::vector<Row> m_DirtyRows;
+
+    public:
+        DirtyCells() = default;
+        DirtyCells(Row rows, Col cols) { Resize(rows, cols); }
+
+        void Resize(Row rows, Col cols)
+        {
+            m_Mask.Resize(rows, cols);
+            m_RowIsDirty.clear();
+            m_RowIsDirty.resize(rows.m_I, 0);
+            m_DirtyRows.clear();
+            m_DirtyRows.reserve(rows.m_I);
+        }
+
+        inline Row Rows() const { return m_Mask.Rows(); }
+        inline Col Cols() const { return m_Mask.Cols(); }
+        inline bool Empty() const { return m_DirtyRows.empty(); }
+        inline bool Test(Row r, Col c) const { return m_Mask.Test(r, c); }
+
+        void Clear()
+        {
+            for (auto r : m_DirtyRows)
+            {
+                auto words = m_Mask.RowWords(r);
+                for (auto w = 0U; w < m_Mask.WordsPerRow(); w++)
+                    words[w] = 0;
+
+                m_RowIsDirty[r.m_I] = 0;
+            }
+
+            m_DirtyRows.clear();
+        }
+
+        inline void Mark(Row r, Col c)
+        {
+            if (!m_RowIsDirty[r.m_I])
+            {
+                m_RowIsDirty[r.m_I] = 1;
+                m_DirtyRows.push_back(r);
+            }
+
+            m_Mask.Set(r, c);
+        }
+
+        // A changed cell can only complete runs that pass through it, so the cells 
+        // up to radius away along its row and column need checking, clipped to the board.
+        void MarkChanged(Row r, Col c, int radius = 2)
+        {
+            const auto c0 = eastl::max(c.m_I - radius, 0);
+            const auto c1 = eastl::min(c.m_I + radius, Cols().m_I - 1);
+            for (auto cc = c0; cc <= c1; cc++)
+                Mark(r, cc);
+
+            const auto r0 = eastl::max(r.m_I - radius, 0);
+            const auto r1 = eastl::min(r.m_I + radius, Rows().m_I - 1);
+            for (auto rr = r0; rr <= r1; rr++)
+                Mark(rr, c);
+        }
+
+        // Calls fn(r, c) for every dirty cell, in row-major order.
+        template <class Fn>
+        void ForEach(Fn fn)
+        {
+            eastl::sort(m_DirtyRows.begin(), m_DirtyRows.end(), 
+                [](Row a, Row b) { return a < b; });
+
+            for (auto r : m_DirtyRows)
+            {
+                auto words = m_Mask.RowWords(r);
+                for (auto w = 0U; w < m_Mask.WordsPerRow(); w++)
+                    ForEachSetBit(words[w], [&](uint32_t bit) { fn(r, Col(int(w * BoardMask::WordBits + bit))); });
+            }
+        }
+    };
+
+    // Calls onMatch(r, c), in row-major order, for every dirty cell that is in a run of 
+    // at least n. Gives the same cells as a whole board scan as long as every run on the 
+    // board passes through a changed cell, ie. the board had no runs before the changes.
+    template <class Colors, class Fn>
+    void FindMatchesInDirtyCells(const Colors& colors, DirtyCells& dirty, Fn onMatch, int n = 3)
+    {
+        const auto rMax = colors.Rows() - 1;
+        const auto cMax = colors.Cols() - 1;
+
+        dirty.ForEach([&](Row r, Col c)
+        {
+            auto color = colors(r, c);
+            if (color == InvalidColor)
+                return;
+
+            auto rs = RowSpan { r, GetMatchingColsInRow_L(r, c, color, colors), GetMatchingColsInRow_R(r, c, color, colors, cMax) };
+            auto cs = ColSpan { c, GetMatchingRowsInCol_D(r, c, color, colors), GetMatchingRowsInCol_U(r, c, color, colors, rMax) };
+
+            if (rs.Count() >= n || cs.Count() >= n)
+                onMatch(r, c);
+        });
+    }
+}
+
+#ifdef CatchAvailable__
+
+namespace m3::DirtyCellsTest
+{
+    using Colors = DynamicBoard<GemColor>;
+
+    // Clears the masked cells and lets every column fall, marking where gems land.
+    inline void ClearAndFall(Colors& colors, const BoardMask& cleared, DirtyCells& dirty)
+    {
+        for (auto c = 0; c < colors.Cols().m_I; c++)
+        {
+            auto dr = 0;
+            for (auto r = 0; r < colors.Rows().m_I; r++)
+            {
+                if (cleared.Test(r, c))
+                {
+                    colors(r, c) = InvalidColor;
+                    dr++;
+                }
+                else if (dr > 0 && colors(r, c) != InvalidColor)
+                {
+                    colors(r - dr, c) = colors(r, c);
+                    colors(r, c) = InvalidColor;
+                    dirty.MarkChanged(r - dr, c);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Dirty cell matching", "[dirty][matching]")
+{
+    using namespace m3;
+    using namespace m3::BitboardTest;
+    using namespace m3::DirtyCellsTest;
+
+    SECTION("Marks are clipped and cleared")
+    {
+        DirtyCells dirty(6, 6);
+        dirty.MarkChanged(0, 0);
+
+        REQUIRE(dirty.Test(0, 0));
+        REQUIRE(dirty.Test(0, 2));
+        REQUIRE(dirty.Test(2, 0));
+        REQUIRE(!dirty.Test(0, 3));
+        REQUIRE(!dirty.Test(1, 1));
+
+        dirty.Clear();
+        REQUIRE(dirty.Empty());
+        REQUIRE(!dirty.Test(0, 0));
+    }
+
+    SECTION("Cascades find the same cells as a whole board scan")
+    {
+        const int sizes[][2] = { { 8, 8 }, { 16, 70 }, { 64, 64 }, { 100, 9 } };
+
+        for (auto& size : sizes)
+        {
+            for (auto seed = 0U; seed < 6; seed++)
+            {
+                auto colors = RandomBoard(size[0], size[1], seed, false);
+                DirtyCells dirty(size[0], size[1]);
+
+                // The first scan has to look at everything.
+                auto cleared = WalkerMatches(colors);
+
+                for (auto step = 0; step < 20 && cleared.Count() > 0; step++)
+                {
+                    dirty.Clear();
+                    ClearAndFall(colors, cleared, dirty);
+
+                    BoardMask incremental(size[0], size[1]);
+                    FindMatchesInDirtyCells(colors, dirty, [&](Row r, Col c) { incremental.Set(r, c); });
+
+                    cleared = WalkerMatches(colors);
+
+                    INFO("Board " << size[0] << "x" << size[1] << " seed " << seed << " step " << step);
+                    REQUIRE(SameCells(incremental, cleared));
+                }
+            }
+        }
+    }
+}
+
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+
+#include "m3MatchKernel.hpp"
+
+TEST_CASE("Dirty vs whole board scan", "[.][benchmark][dirty]")
+{
+    using namespace m3;
+    using namespace m3::BitboardTest;
+
+    const auto n = 1024;
+    auto colors = RandomBoard(n, n, 0, false);
+
+    // A small cascade in one corner: 3 columns of 8 gems landing.
+    DirtyCells dirty(n, n);
+    for (auto c = 0; c < 3; c++)
+        for (auto r = 0; r < 8; r++)
+            dirty.MarkChanged(r, c);
+
+    MatchRunKernel kernel;
+    MatchRunKernel::Mask mask(n, n);
+
+    BENCHMARK("Kernel whole board 1024x1024") 
+    { 
+        kernel.Find(colors, &mask);
+        return mask(0, 0);
+    };
+
+    BENCHMARK("Dirty cells, corner cascade 1024x1024") 
+    { 
+        auto count = 0;
+        FindMatchesInDirtyCells(colors, dirty, [&](Row, Col) { count++; });
+        return count;
+    };
+}
+
+#endif
+
+#endif
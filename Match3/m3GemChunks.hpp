@@ -0,0 +1,1062 @@
+#pragma once
+
+#include <cstring>
+#include <EASTL\algorithm.h>
+#include <EASTL\array.h>
+#include <EASTL\span.h>
+#include <EASTL\tuple.h>
+#include <EASTL\type_traits.h>
+#include <EASTL\unique_ptr.h>
+#include <EASTL\utility.h>
+#include <EASTL\vector.h>
+
+#include "m3Types.hpp"
+#include "m3GemPool.hpp"
+#include "m3Serialize.hpp"
+#include "m3Snapshot.hpp"
+#include "m3ThreadPool.hpp"
+
+namespace m3
+{
+    /*
+        Gem components stored by archetype, in 16KB chunks. A chunk holds every component
+        of a fixed number of gems, one array per component, so a pass over a few
+        components reads a few dense arrays that sit together, and a chunk is a natural
+        unit of work for a thread.
+
+        Handles are GemIds from a GemPool and stay valid until the gem is removed. A slot
+        maps to its chunk and index. Removal fills the hole from the chunk's tail, so it
+        only touches one chunk; RemoveN does a whole batch in one pass, each survivor moves
+        at most once and victims never move. Chunks are never freed or moved:
+        growing allocates one more chunk, nothing is copied, and chunks with room are
+        filled before a new one is made.
+
+        Swap-removes and refills scatter gems over time, so chunk order stops following
+        whatever the caller iterates by. SortBy restores it in one pass, a radix sort on
+        caller keys, and Unsorted() counts the gems placed since, to decide when.
+
+        Components are accessed by index, in the order of the template arguments.
+    */
+    template <class... Components>
+    class GemChunks
+    {
+    public:
+        static constexpr size_t ChunkBytes = 16 * 1024;
+        static constexpr size_t ComponentCount = sizeof...(Components);
+
+        template <size_t I>
+        using Component = typename eastl::tuple_element<I, eastl::tuple<Components...>>::type;
+
+    private:
+        static constexpr size_t ArrayAlignment = 16;
+        static constexpr uint32_t NoLocation = 0xFFFFFFFF;
+
+        static_assert((eastl::is_trivially_copyable<Components>::value && ...));
+        static_assert(((alignof(Components) <= ArrayAlignment) && ...));
+
+        // Ids, then one array per component, each aligned.
+        static constexpr uint32_t Capacity_ =
+            (uint32_t)((ChunkBytes - ArrayAlignment * (ComponentCount + 1)) / (sizeof(GemId) + (sizeof(Components) + ...)));
+
+        static constexpr eastl::array<size_t, ComponentCount + 1> Offsets()
+        {
+            const size_t sizes[] = { sizeof(GemId), sizeof(Components)... };
+            eastl::array<size_t, ComponentCount + 1> offsets = {};
+
+            size_t offset = 0;
+            for (size_t i = 0; i <= ComponentCount; i++)
+            {
+                offsets[i] = offset;
+                offset += sizes[i] * Capacity_;
+                offset = (offset + ArrayAlignment - 1) / ArrayAlignment * ArrayAlignment;
+            }
+
+            return offsets;
+        }
+
+        static constexpr auto Offsets_ = Offsets();
+
+        struct alignas(64) Chunk
+        {
+            uint8_t m_Bytes[ChunkBytes];
+        };
+
+        GemPool m_Pool;
+        eastl::vector<uint32_t> m_SlotToLocation;       // chunk * ChunkCapacity + index.
+        eastl::vector<eastl::unique_ptr<Chunk>> m_Chunks;
+        eastl::vector<uint32_t> m_ChunkCounts;
+        eastl::vector<uint32_t> m_OpenChunks;           // Chunks with room, the last one is filled next.
+        uint32_t m_Count = 0;
+        uint32_t m_Unsorted = 0;                        // Adds and swap-removes since the last SortBy.
+
+        // Scratch for RemoveN, per chunk. m_Removed is all zeroes between calls.
+        eastl::vector<uint32_t> m_Removed, m_Tails, m_Touched;
+
+        // Scratch for SortBy, not saved.
+        eastl::vector<uint32_t> m_Keys, m_Keys_1;
+        eastl::vector<uint32_t> m_Order, m_Order_1;     // Locations, sorted along with the keys.
+        eastl::vector<uint64_t> m_Sorted;               // One array at a time, in sorted order.
+
+    public:
+        static constexpr uint32_t ChunkCapacity = Capacity_;
+
+        GemChunks() = default;
+        GemChunks(uint32_t capacity) { Init(capacity); }
+
+        // Fixed capacity of ids. Chunks are allocated as they are needed.
+        void Init(uint32_t capacity)
+        {
+            m_Pool.Init(capacity);
+            m_SlotToLocation.clear();
+            m_SlotToLocation.resize(capacity, NoLocation);
+            m_Chunks.clear();
+            m_ChunkCounts.clear();
+            m_OpenChunks.clear();
+            m_Count = 0;
+            m_Unsorted = 0;
+
+            auto chunks = (capacity + ChunkCapacity - 1) / ChunkCapacity;
+            m_Chunks.reserve(chunks);
+            m_ChunkCounts.reserve(chunks);
+            m_OpenChunks.reserve(chunks);
+        }
+
+        inline uint32_t Capacity() const { return m_Pool.Capacity(); }
+        inline uint32_t Count() const { return m_Count; }
+        inline uint32_t ChunkCount() const { return (uint32_t)m_Chunks.size(); }
+        inline uint32_t ChunkSize(uint32_t chunk) const { return m_ChunkCounts[chunk]; }
+        inline uint32_t Unsorted() const { return m_Unsorted; }
+
+        // False for InvalidGemId and for ids that have been removed.
+        inline bool Contains(GemId id) const
+        {
+            return m_Pool.IsAlive(id) && m_SlotToLocation[GemIdSlot(id)] != NoLocation;
+        }
+
+        // A chunk's arrays, ChunkSize(chunk) long.
+        inline const GemId* Ids(uint32_t chunk) const { return (const GemId*)(m_Chunks[chunk]->m_Bytes + Offsets_[0]); }
+
+        template <size_t I>
+        inline Component<I>* Array(uint32_t chunk) { return (Component<I>*)(m_Chunks[chunk]->m_Bytes + Offsets_[I + 1]); }
+
+        template <size_t I>
+        inline const Component<I>* Array(uint32_t chunk) const { return (const Component<I>*)(m_Chunks[chunk]->m_Bytes + Offsets_[I + 1]); }
+
+        template <size_t I>
+        inline Component<I>& Get(GemId id)
+        {
+            auto location = LocationOf(id);
+            return Array<I>(location / ChunkCapacity)[location % ChunkCapacity];
+        }
+
+        template <size_t I>
+        inline const Component<I>& Get(GemId id) const
+        {
+            auto location = LocationOf(id);
+            return Array<I>(location / ChunkCapacity)[location % ChunkCapacity];
+        }
+
+        // InvalidGemId once the pool is out of ids.
+        GemId Add(const Components&... values)
+        {
+            if (m_Pool.FreeCount() == 0)
+                return InvalidGemId;
+
+            if (m_OpenChunks.empty())
+            {
+                m_OpenChunks.push_back((uint32_t)m_Chunks.size());
+                m_Chunks.push_back(eastl::unique_ptr<Chunk>(new Chunk()));
+                m_ChunkCounts.push_back(0);
+            }
+
+            auto chunk = m_OpenChunks.back();
+            auto index = m_ChunkCounts[chunk]++;
+
+            if (m_ChunkCounts[chunk] == ChunkCapacity)
+                m_OpenChunks.pop_back();
+
+            auto id = m_Pool.GetOrCreateGem();
+            m_SlotToLocation[GemIdSlot(id)] = chunk * ChunkCapacity + index;
+            MutableIds(chunk)[index] = id;
+            Store(chunk, index, eastl::index_sequence_for<Components...>(), values...);
+
+            m_Count++;
+            m_Unsorted++;
+            return id;
+        }
+
+        void Remove(GemId id)
+        {
+            RemoveAt(id);
+            m_Pool.ReleaseGem(id);
+        }
+
+        // Many gems at once. Holes below a chunk's new count are filled from its tail, as
+        // Remove() would, but each survivor moves and has its slot patched only once, and
+        // the ids go back to the pool in one go. Ids have to be distinct.
+        void RemoveN(eastl::span<const GemId> ids)
+        {
+            m_Removed.resize(ChunkCount(), 0);
+            m_Tails.resize(ChunkCount());
+            m_Touched.clear();
+
+            // Mark the victims in the chunks' ids first, so the tails can skip them.
+            for (auto id : ids)
+            {
+                auto location = LocationOf(id);
+                auto chunk = location / ChunkCapacity;
+
+                MutableIds(chunk)[location % ChunkCapacity] = InvalidGemId;
+
+                if (m_Removed[chunk]++ == 0)
+                {
+                    m_Touched.push_back(chunk);
+                    m_Tails[chunk] = m_ChunkCounts[chunk];
+                }
+            }
+
+            for (auto id : ids)
+            {
+                auto& location = m_SlotToLocation[GemIdSlot(id)];
+                auto chunk = location / ChunkCapacity;
+                auto index = location % ChunkCapacity;
+
+                if (index < m_ChunkCounts[chunk] - m_Removed[chunk])
+                {
+                    // There are as many survivors past the new count as holes before it.
+                    auto chunkIds = MutableIds(chunk);
+                    auto& tail = m_Tails[chunk];
+                    while (chunkIds[--tail] == InvalidGemId) {}
+
+                    auto moved = chunkIds[tail];
+                    chunkIds[index] = moved;
+                    Move(chunk, tail, index, eastl::index_sequence_for<Components...>());
+                    m_SlotToLocation[GemIdSlot(moved)] = chunk * ChunkCapacity + index;
+                    m_Unsorted++;
+                }
+
+                location = NoLocation;
+            }
+
+            for (auto chunk : m_Touched)
+            {
+                if (m_ChunkCounts[chunk] == ChunkCapacity)
+                    m_OpenChunks.push_back(chunk);
+
+                m_ChunkCounts[chunk] -= m_Removed[chunk];
+                m_Removed[chunk] = 0;
+            }
+
+            m_Count -= (uint32_t)ids.size();
+            m_Pool.ReleaseN(ids);
+        }
+
+        // fn(chunk, count) for every chunk, in order.
+        template <class Fn>
+        void ForEachChunk(const Fn& fn) const
+        {
+            for (auto chunk = 0U; chunk < ChunkCount(); chunk++)
+                fn(chunk, m_ChunkCounts[chunk]);
+        }
+
+        // fn(chunk, count) for every chunk, a chunk per task. Chunks share no data, so fn
+        // can write to its own chunk's arrays freely.
+        template <class Fn>
+        void ParallelForEachChunk(ThreadPool* pool, const Fn& fn)
+        {
+            pool->ParallelFor(ChunkCount(), [&](uint32_t chunk, uint32_t) { fn(chunk, m_ChunkCounts[chunk]); });
+        }
+
+        // As above, on a const GemChunks, so fn only reads.
+        template <class Fn>
+        void ParallelForEachChunk(ThreadPool* pool, const Fn& fn) const
+        {
+            pool->ParallelFor(ChunkCount(), [&](uint32_t chunk, uint32_t) { fn(chunk, m_ChunkCounts[chunk]); });
+        }
+
+        // Reorders all gems by key, ties keep their order, and packs them into the first
+        // chunks. keysOf(chunk, count, outKeys) writes one uint32_t key per gem of a chunk.
+        // Handles stay valid, only where they point changes. Costs a few passes over the
+        // keys and one gather per array, so it is meant to run now and then, not per frame.
+        template <class KeysOf>
+        void SortBy(const KeysOf& keysOf)
+        {
+            m_Keys.resize(m_Count);
+            m_Order.resize(m_Count);
+
+            auto maxKey = 0U;
+            auto n = 0U;
+
+            for (auto chunk = 0U; chunk < ChunkCount(); chunk++)
+            {
+                auto count = m_ChunkCounts[chunk];
+                keysOf(chunk, count, m_Keys.data() + n);
+
+                for (auto i = 0U; i < count; i++)
+                {
+                    maxKey = eastl::max(maxKey, m_Keys[n + i]);
+                    m_Order[n + i] = chunk * ChunkCapacity + i;
+                }
+
+                n += count;
+            }
+
+            RadixSort(maxKey);
+
+            Permute<GemId>(Offsets_[0]);
+            PermuteArrays(eastl::index_sequence_for<Components...>());
+
+            // Packed: full chunks, then the rest, then empty ones.
+            m_OpenChunks.clear();
+
+            for (auto chunk = ChunkCount(); chunk-- > 0; )
+            {
+                auto first = chunk * ChunkCapacity;
+                m_ChunkCounts[chunk] = first < m_Count ? eastl::min(ChunkCapacity, m_Count - first) : 0;
+
+                if (m_ChunkCounts[chunk] < ChunkCapacity)
+                    m_OpenChunks.push_back(chunk);
+
+                auto ids = Ids(chunk);
+                for (auto i = 0U; i < m_ChunkCounts[chunk]; i++)
+                    m_SlotToLocation[GemIdSlot(ids[i])] = first + i;
+            }
+
+            m_Unsorted = 0;
+        }
+
+        // Only the used part of each chunk.
+        void Save(BinaryWriter& writer) const
+        {
+            SaveIndex(writer);
+            writer.WriteVector(m_SlotToLocation);
+
+            for (auto chunk = 0U; chunk < ChunkCount(); chunk++)
+            {
+                writer.WriteBytes(Ids(chunk), sizeof(GemId) * m_ChunkCounts[chunk]);
+                SaveArrays(writer, chunk, eastl::index_sequence_for<Components...>());
+            }
+        }
+
+        // All or nothing: the data is loaded to the side and checked, see IsConsistent(),
+        // so a bad or foreign blob leaves the store as it was.
+        bool Load(BinaryReader& reader)
+        {
+            GemChunks loaded;
+            if (!loaded.LoadIndex(reader) || !reader.ReadVector(&loaded.m_SlotToLocation))
+                return false;
+
+            for (auto chunk = 0U; chunk < loaded.ChunkCount(); chunk++)
+            {
+                reader.ReadBytes(loaded.MutableIds(chunk), sizeof(GemId) * loaded.m_ChunkCounts[chunk]);
+                loaded.LoadArrays(reader, chunk, eastl::index_sequence_for<Components...>());
+            }
+
+            if (!reader.Ok() || !loaded.IsConsistent())
+                return false;
+
+            *this = eastl::move(loaded);
+            return true;
+        }
+
+        // Snapshot sections, see m3Snapshot.hpp. tags[0] is the pool and chunk bookkeeping,
+        // tags[1] the slot map, tags[2] the ids, then one per component. The arrays hold whole
+        // chunks back to back, so a location from the slot map indexes any of them in place.
+        static constexpr size_t SectionCount = ComponentCount + 3;
+        using SectionTags = eastl::array<uint32_t, SectionCount>;
+
+        // Nothing is copied but the bookkeeping, the arrays are written from the chunks.
+        void AddSections(SnapshotWriter& writer, const SectionTags& tags) const
+        {
+            writer.AddObject(tags[0], SectionIndex { this });
+            writer.AddArray(tags[1], m_SlotToLocation);
+            AddArraySection<GemId>(writer, tags[2], Offsets_[0]);
+            AddComponentSections(writer, tags, eastl::index_sequence_for<Components...>());
+        }
+
+        // A memcpy per chunk and array. All or nothing, like Load().
+        bool LoadSections(const Snapshot& snapshot, const SectionTags& tags)
+        {
+            GemChunks loaded;
+            auto reader = snapshot.Reader(tags[0]);
+            if (!loaded.LoadIndex(reader) || reader.Remaining() != 0)
+                return false;
+
+            eastl::span<const uint32_t> slotToLocation;
+            if (!snapshot.FindArray(tags[1], &slotToLocation))
+                return false;
+
+            loaded.m_SlotToLocation.assign(slotToLocation.begin(), slotToLocation.end());
+
+            if (!loaded.LoadArraySection<GemId>(snapshot, tags[2], Offsets_[0]) ||
+                !loaded.LoadComponentSections(snapshot, tags, eastl::index_sequence_for<Components...>()) ||
+                !loaded.IsConsistent())
+                return false;
+
+            *this = eastl::move(loaded);
+            return true;
+        }
+
+        // Every live gem is where its slot says, and every chunk with room is open once.
+        // Anything that could index out of bounds later is checked here.
+        bool IsConsistent() const
+        {
+            if (m_SlotToLocation.size() != Capacity() || m_ChunkCounts.size() != ChunkCount() ||
+                m_Count > Capacity() || m_Count + m_Pool.FreeCount() != Capacity())
+                return false;
+
+            eastl::vector<uint8_t> isOpen(ChunkCount(), 0);
+            for (auto chunk : m_OpenChunks)
+            {
+                if (chunk >= ChunkCount() || isOpen[chunk] || m_ChunkCounts[chunk] >= ChunkCapacity)
+                    return false;
+
+                isOpen[chunk] = 1;
+            }
+
+            auto count = 0U;
+            for (auto chunk = 0U; chunk < ChunkCount(); chunk++)
+            {
+                if (m_ChunkCounts[chunk] > ChunkCapacity || (m_ChunkCounts[chunk] < ChunkCapacity) != (isOpen[chunk] != 0))
+                    return false;
+
+                auto ids = Ids(chunk);
+                for (auto i = 0U; i < m_ChunkCounts[chunk]; i++)
+                {
+                    if (!m_Pool.IsAlive(ids[i]) || m_SlotToLocation[GemIdSlot(ids[i])] != chunk * ChunkCapacity + i)
+                        return false;
+                }
+
+                count += m_ChunkCounts[chunk];
+            }
+
+            // Each live gem maps back to its own location, so no other slot may claim one.
+            auto located = (uint32_t)eastl::count_if(m_SlotToLocation.begin(), m_SlotToLocation.end(), 
+                [](uint32_t location) { return location != NoLocation; });
+
+            return count == m_Count && located == m_Count;
+        }
+
+    private:
+        // For AddObject, which wants something with a Save().
+        struct SectionIndex
+        {
+            const GemChunks* m_Chunks;
+            inline void Save(BinaryWriter& writer) const { m_Chunks->SaveIndex(writer); }
+        };
+
+        // Everything but the slot map and the chunks' arrays.
+        void SaveIndex(BinaryWriter& writer) const
+        {
+            m_Pool.Save(writer);
+            writer.Write(m_Unsorted);
+            writer.WriteVector(m_ChunkCounts);
+            writer.WriteVector(m_OpenChunks);
+        }
+
+        // Into a GemChunks that isn't in use yet, see Load(). Allocates the chunks.
+        bool LoadIndex(BinaryReader& reader)
+        {
+            if (!m_Pool.Load(reader))
+                return false;
+
+            m_Unsorted = reader.Read<uint32_t>();
+            reader.ReadVector(&m_ChunkCounts);
+            reader.ReadVector(&m_OpenChunks);
+
+            return reader.Ok() && AllocateLoadedChunks();
+        }
+
+        template <class T>
+        void AddArraySection(SnapshotWriter& writer, uint32_t tag, size_t offset) const
+        {
+            eastl::vector<const void*> pieces;
+            pieces.reserve(ChunkCount());
+
+            for (auto& chunk : m_Chunks)
+                pieces.push_back(chunk->m_Bytes + offset);
+
+            writer.AddPieces(tag, eastl::move(pieces), sizeof(T) * ChunkCapacity, sizeof(T));
+        }
+
+        template <size_t... I>
+        void AddComponentSections(SnapshotWriter& writer, const SectionTags& tags, eastl::index_sequence<I...>) const
+        {
+            (AddArraySection<Component<I>>(writer, tags[I + 3], Offsets_[I + 1]), ...);
+        }
+
+        template <class T>
+        bool LoadArraySection(const Snapshot& snapshot, uint32_t tag, size_t offset)
+        {
+            eastl::span<const T> values;
+            if (!snapshot.FindArray(tag, &values) || values.size() != (size_t)ChunkCount() * ChunkCapacity)
+                return false;
+
+            for (auto chunk = 0U; chunk < ChunkCount(); chunk++)
+                memcpy(m_Chunks[chunk]->m_Bytes + offset, values.data() + (size_t)chunk * ChunkCapacity, sizeof(T) * ChunkCapacity);
+
+            return true;
+        }
+
+        template <size_t... I>
+        bool LoadComponentSections(const Snapshot& snapshot, const SectionTags& tags, eastl::index_sequence<I...>)
+        {
+            return (LoadArraySection<Component<I>>(snapshot, tags[I + 3], Offsets_[I + 1]) && ...);
+        }
+
+        // After m_ChunkCounts is loaded. Bounds the chunk count by what the capacity can
+        // need, so a bad count can't allocate without limit.
+        bool AllocateLoadedChunks()
+        {
+            auto maxChunks = (Capacity() + ChunkCapacity - 1) / ChunkCapacity;
+            if (m_ChunkCounts.size() > maxChunks)
+                return false;
+
+            m_Chunks.clear();
+            m_Count = 0;
+
+            for (auto count : m_ChunkCounts)
+            {
+                if (count > ChunkCapacity)
+                    return false;
+
+                m_Chunks.push_back(eastl::unique_ptr<Chunk>(new Chunk()));
+                m_Count += count;
+            }
+
+            return true;
+        }
+
+        inline GemId* MutableIds(uint32_t chunk) { return (GemId*)(m_Chunks[chunk]->m_Bytes + Offsets_[0]); }
+
+        inline uint32_t LocationOf(GemId id) const
+        {
+            assert(Contains(id));
+            return m_SlotToLocation[GemIdSlot(id)];
+        }
+
+        template <size_t... I>
+        inline void Store(uint32_t chunk, uint32_t index, eastl::index_sequence<I...>, const Components&... values)
+        {
+            ((Array<I>(chunk)[index] = values), ...);
+        }
+
+        template <size_t... I>
+        inline void Move(uint32_t chunk, uint32_t from, uint32_t to, eastl::index_sequence<I...>)
+        {
+            ((Array<I>(chunk)[to] = Array<I>(chunk)[from]), ...);
+        }
+
+        // LSD, 8 bits a pass, only as many passes as maxKey needs. Stable, so equal keys
+        // keep their chunk order.
+        void RadixSort(uint32_t maxKey)
+        {
+            m_Keys_1.resize(m_Count);
+            m_Order_1.resize(m_Count);
+
+            for (auto shift = 0U; shift < 32 && (maxKey >> shift) != 0; shift += 8)
+            {
+                uint32_t offsets[256] = {};
+
+                for (auto key : m_Keys)
+                    offsets[(key >> shift) & 0xFF]++;
+
+                auto sum = 0U;
+                for (auto& offset : offsets)
+                {
+                    auto count = offset;
+                    offset = sum;
+                    sum += count;
+                }
+
+                for (auto i = 0U; i < m_Count; i++)
+                {
+                    auto to = offsets[(m_Keys[i] >> shift) & 0xFF]++;
+                    m_Keys_1[to] = m_Keys[i];
+                    m_Order_1[to] = m_Order[i];
+                }
+
+                eastl::swap(m_Keys, m_Keys_1);
+                eastl::swap(m_Order, m_Order_1);
+            }
+        }
+
+        // Gathers one array in m_Order into m_Sorted, then writes it back chunk by chunk.
+        template <class T>
+        void Permute(size_t offset)
+        {
+            m_Sorted.resize(((size_t)m_Count * sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+            auto sorted = (T*)m_Sorted.data();
+
+            for (auto i = 0U; i < m_Count; i++)
+            {
+                auto location = m_Order[i];
+                sorted[i] = ((const T*)(m_Chunks[location / ChunkCapacity]->m_Bytes + offset))[location % ChunkCapacity];
+            }
+
+            for (auto first = 0U, chunk = 0U; first < m_Count; first += ChunkCapacity, chunk++)
+            {
+                auto count = eastl::min(ChunkCapacity, m_Count - first);
+                memcpy(m_Chunks[chunk]->m_Bytes + offset, sorted + first, sizeof(T) * count);
+            }
+        }
+
+        template <size_t... I>
+        inline void PermuteArrays(eastl::index_sequence<I...>)
+        {
+            (Permute<Component<I>>(Offsets_[I + 1]), ...);
+        }
+
+        template <size_t... I>
+        void SaveArrays(BinaryWriter& writer, uint32_t chunk, eastl::index_sequence<I...>) const
+        {
+            (writer.WriteBytes(Array<I>(chunk), sizeof(Component<I>) * m_ChunkCounts[chunk]), ...);
+        }
+
+        template <size_t... I>
+        void LoadArrays(BinaryReader& reader, uint32_t chunk, eastl::index_sequence<I...>)
+        {
+            (reader.ReadBytes(Array<I>(chunk), sizeof(Component<I>) * m_ChunkCounts[chunk]), ...);
+        }
+
+        // Moves the chunk's last gem into the hole. Leaves the id to the caller to release.
+        void RemoveAt(GemId id)
+        {
+            auto& location = m_SlotToLocation[GemIdSlot(id)];
+            assert(Contains(id));
+
+            auto chunk = location / ChunkCapacity;
+            auto index = location % ChunkCapacity;
+            auto last = --m_ChunkCounts[chunk];
+
+            if (index != last)
+            {
+                auto ids = MutableIds(chunk);
+                auto moved = ids[last];
+
+                ids[index] = moved;
+                Move(chunk, last, index, eastl::index_sequence_for<Components...>());
+                m_SlotToLocation[GemIdSlot(moved)] = chunk * ChunkCapacity + index;
+                m_Unsorted++;
+            }
+
+            if (last == ChunkCapacity - 1)
+                m_OpenChunks.push_back(chunk);
+
+            location = NoLocation;
+            m_Count--;
+        }
+    };
+}
+
+#ifdef CatchAvailable__
+
+#include "m3Random.hpp"
+
+TEST_CASE("Gem chunks", "[gemchunks]")
+{
+    using namespace m3;
+
+    struct Float2 { float x, y; };
+    using Gems = GemChunks<Row, Col, GemColor, Float2>;
+
+    static_assert(Gems::ChunkCapacity * (sizeof(GemId) + sizeof(Row) + sizeof(Col) + sizeof(GemColor) + sizeof(Float2)) <= Gems::ChunkBytes);
+
+    SECTION("Handles stay valid across removals")
+    {
+        Gems gems(3000);
+        Random random(9);
+
+        // Id to what it was added with.
+        eastl::vector<eastl::pair<GemId, int>> live;
+
+        for (auto round = 0; round < 30; round++)
+        {
+            auto adds = random() % 400;
+            for (auto i = 0U; i < adds; i++)
+            {
+                auto value = (int)(random() % 10000);
+                auto id = gems.Add(value % 100, value / 100, GemColor((uint8_t)value), { (float)value, -(float)value });
+                if (id == InvalidGemId)
+                    break;
+
+                live.push_back({ id, value });
+            }
+
+            // Remove about a third, some one by one, some in bulk.
+            eastl::vector<GemId> victims;
+            for (auto i = 0U; i < live.size(); )
+            {
+                if (random() % 3 == 0)
+                {
+                    victims.push_back(live[i].first);
+                    live.erase_unsorted(live.begin() + i);
+                }
+                else
+                    i++;
+            }
+
+            auto half = victims.size() / 2;
+            for (auto i = 0U; i < half; i++)
+                gems.Remove(victims[i]);
+            gems.RemoveN({ victims.data() + half, victims.size() - half });
+
+            for (auto id : victims)
+                REQUIRE(!gems.Contains(id));
+
+            REQUIRE(gems.Count() == live.size());
+
+            for (auto& gem : live)
+            {
+                auto id = gem.first;
+                auto value = gem.second;
+
+                REQUIRE(gems.Contains(id));
+                REQUIRE(gems.Get<0>(id) == value % 100);
+                REQUIRE(gems.Get<1>(id) == value / 100);
+                REQUIRE(gems.Get<2>(id) == GemColor((uint8_t)value));
+                REQUIRE(gems.Get<3>(id).x == (float)value);
+            }
+
+            // Iteration sees every live gem once.
+            auto seen = 0U;
+            gems.ForEachChunk([&](uint32_t chunk, uint32_t count)
+            {
+                for (auto i = 0U; i < count; i++)
+                {
+                    auto id = gems.Ids(chunk)[i];
+                    REQUIRE(gems.Contains(id));
+                    REQUIRE(gems.Array<3>(chunk)[i].x == -gems.Array<3>(chunk)[i].y);
+                    REQUIRE(&gems.Get<3>(id) == &gems.Array<3>(chunk)[i]);
+                }
+
+                seen += count;
+            });
+
+            REQUIRE(seen == gems.Count());
+        }
+
+        // Chunks are refilled before new ones are made.
+        REQUIRE(gems.ChunkCount() <= (3000 + Gems::ChunkCapacity - 1) / Gems::ChunkCapacity);
+    }
+
+    SECTION("Bulk removal moves each survivor at most once")
+    {
+        Gems gems(Gems::ChunkCapacity);
+        eastl::vector<GemId> ids;
+
+        for (auto i = 0U; i < Gems::ChunkCapacity; i++)
+            ids.push_back(gems.Add(0, 0, Red, { (float)i, 0 }));
+
+        // The first ten and the last ten go: ten survivors fill the front, the victims at
+        // the back are dropped where they are.
+        eastl::vector<GemId> victims(ids.begin(), ids.begin() + 10);
+        victims.insert(victims.end(), ids.end() - 10, ids.end());
+
+        auto before = gems.Unsorted();
+        gems.RemoveN(victims);
+
+        REQUIRE(gems.Unsorted() - before == 10);
+        REQUIRE(gems.ChunkSize(0) == Gems::ChunkCapacity - 20);
+        REQUIRE(gems.Count() == Gems::ChunkCapacity - 20);
+
+        for (auto i = 0U; i < Gems::ChunkCapacity; i++)
+        {
+            auto removed = i < 10 || i >= Gems::ChunkCapacity - 10;
+            REQUIRE(gems.Contains(ids[i]) == !removed);
+            if (!removed)
+                REQUIRE(gems.Get<3>(ids[i]).x == (float)i);
+        }
+
+        // The chunk has room again.
+        REQUIRE(gems.Add(0, 0, Red, { 0, 0 }) != InvalidGemId);
+        REQUIRE(gems.ChunkCount() == 1);
+    }
+
+    SECTION("Chunks do not move as the store grows")
+    {
+        Gems gems(Gems::ChunkCapacity * 4);
+
+        auto first = gems.Add(1, 2, Red, { 3, 4 });
+        auto address = &gems.Get<3>(first);
+
+        for (auto i = 1U; i < Gems::ChunkCapacity * 4; i++)
+            REQUIRE(gems.Add(0, 0, Blue, { 0, 0 }) != InvalidGemId);
+
+        REQUIRE(gems.Add(0, 0, Blue, { 0, 0 }) == InvalidGemId);
+        REQUIRE(gems.ChunkCount() == 4);
+        REQUIRE(&gems.Get<3>(first) == address);
+        REQUIRE(gems.Get<3>(first).y == 4);
+    }
+
+    SECTION("Per-chunk parallel iteration")
+    {
+        ThreadPool pool(3);
+        Gems gems(5000);
+
+        for (auto i = 0; i < 5000; i++)
+            gems.Add(i % 7, 0, Red, { (float)i, 0 });
+
+        gems.ParallelForEachChunk(&pool, [&](uint32_t chunk, uint32_t count)
+        {
+            auto values = gems.Array<3>(chunk);
+            for (auto i = 0U; i < count; i++)
+                values[i].y = values[i].x * 2;
+        });
+
+        const auto& view = gems;
+        std::atomic<uint32_t> bad { 0 };
+
+        view.ParallelForEachChunk(&pool, [&](uint32_t chunk, uint32_t count)
+        {
+            auto values = view.Array<3>(chunk);
+            for (auto i = 0U; i < count; i++)
+                bad += values[i].y != 2 * values[i].x;
+        });
+
+        REQUIRE(bad == 0);
+    }
+
+    SECTION("Sort by key")
+    {
+        Gems gems(3000);
+        Random random(4);
+        eastl::vector<GemId> ids;
+
+        for (auto i = 0; i < 3000; i++)
+            ids.push_back(gems.Add(0, 0, Red, { (float)(random() % 70000), (float)i }));
+
+        // Scatter them, as play does.
+        eastl::vector<GemId> victims;
+        for (auto i = 0; i < 3000; i += 2)
+            victims.push_back(ids[i]);
+        gems.RemoveN(victims);
+
+        for (auto i = 0; i < 700; i++)
+            ids.push_back(gems.Add(0, 0, Red, { (float)(random() % 70000), (float)(3000 + i) }));
+
+        REQUIRE(gems.Unsorted() > 0);
+        auto count = gems.Count();
+
+        gems.SortBy([&](uint32_t chunk, uint32_t n, uint32_t* keys)
+        {
+            for (auto i = 0U; i < n; i++)
+                keys[i] = (uint32_t)gems.Array<3>(chunk)[i].x;
+        });
+
+        REQUIRE(gems.Unsorted() == 0);
+        REQUIRE(gems.Count() == count);
+
+        // Packed and sorted across chunks.
+        Float2 previous = { -1, -1 };
+        auto seen = 0U;
+
+        gems.ForEachChunk([&](uint32_t chunk, uint32_t n)
+        {
+            REQUIRE((n == Gems::ChunkCapacity || seen + n == count));
+
+            for (auto i = 0U; i < n; i++)
+            {
+                auto value = gems.Array<3>(chunk)[i];
+                REQUIRE(previous.x <= value.x);
+
+                auto id = gems.Ids(chunk)[i];
+                REQUIRE(&gems.Get<3>(id) == &gems.Array<3>(chunk)[i]);
+                previous = value;
+            }
+
+            seen += n;
+        });
+
+        REQUIRE(seen == count);
+
+        // Handles still point at their own gem.
+        for (auto i = 0; i < 3700; i++)
+        {
+            REQUIRE(gems.Contains(ids[i]) == (i >= 3000 || (i & 1) != 0));
+            if (gems.Contains(ids[i]))
+                REQUIRE(gems.Get<3>(ids[i]).y == (float)i);
+        }
+
+        // And the store carries on, filling the first chunk with room.
+        auto id = gems.Add(1, 1, Blue, { 0, 0 });
+        REQUIRE(&gems.Get<3>(id) == &gems.Array<3>(count / Gems::ChunkCapacity)[count % Gems::ChunkCapacity]);
+    }
+
+    SECTION("Save and load")
+    {
+        Gems gems(2000);
+        eastl::vector<GemId> ids;
+
+        for (auto i = 0; i < 2000; i++)
+            ids.push_back(gems.Add(i % 50, i / 50, Green, { (float)i, 1 }));
+        for (auto i = 0; i < 2000; i += 3)
+            gems.Remove(ids[i]);
+
+        eastl::vector<uint8_t> bytes;
+        BinaryWriter writer(&bytes);
+        gems.Save(writer);
+
+        auto openChunks = 0U;
+        gems.ForEachChunk([&](uint32_t, uint32_t count) { openChunks += count < Gems::ChunkCapacity; });
+
+        Gems loaded;
+        BinaryReader reader(bytes.data(), bytes.size());
+        REQUIRE(loaded.Load(reader));
+        REQUIRE(reader.Remaining() == 0);
+        REQUIRE(loaded.Count() == gems.Count());
+
+        for (auto i = 0; i < 2000; i++)
+        {
+            REQUIRE(loaded.Contains(ids[i]) == gems.Contains(ids[i]));
+            if (gems.Contains(ids[i]))
+                REQUIRE(loaded.Get<3>(ids[i]).x == (float)i);
+        }
+
+        // Same free slots and open chunks, so both carry on the same.
+        auto a = gems.Add(0, 0, Red, { 0, 0 });
+        auto b = loaded.Add(0, 0, Red, { 0, 0 });
+        REQUIRE(a == b);
+        REQUIRE(loaded.ChunkCount() == gems.ChunkCount());
+
+        gems.ForEachChunk([&](uint32_t chunk, uint32_t count)
+        {
+            REQUIRE(loaded.ChunkSize(chunk) == count);
+            REQUIRE(memcmp(loaded.Ids(chunk), gems.Ids(chunk), sizeof(GemId) * count) == 0);
+        });
+
+        BinaryReader truncated(bytes.data(), bytes.size() / 2);
+        REQUIRE(!Gems().Load(truncated));
+
+        // Corrupt blobs are rejected, and leave the store as it was.
+        auto count = gems.Count() - 1;
+        auto chunkCounts = (4 + gems.Capacity()) + (4 + 4 * (gems.Capacity() - count)) + 4;
+        auto slotMap = chunkCounts + (4 + 4 * gems.ChunkCount()) + (4 + 4 * openChunks) + 4;
+
+        auto rejects = [&](size_t offset, uint32_t value)
+        {
+            auto corrupt = bytes;
+            memcpy(corrupt.data() + offset, &value, sizeof(value));
+
+            BinaryReader corruptReader(corrupt.data(), corrupt.size());
+            auto ok = loaded.Load(corruptReader);
+
+            REQUIRE(loaded.Count() == count + 1);
+            REQUIRE(loaded.Contains(b));
+            return !ok;
+        };
+
+        uint32_t location;
+        memcpy(&location, bytes.data() + slotMap + 4 * GemIdSlot(ids[1]), sizeof(location));
+        REQUIRE(location != 0xFFFFFFFF);
+
+        REQUIRE(rejects(slotMap + 4 * GemIdSlot(ids[1]), location + 1));
+        REQUIRE(rejects(slotMap + 4 * GemIdSlot(ids[1]), 1 << 30));
+        REQUIRE(rejects(slotMap + 4 * GemIdSlot(ids[0]), location));
+        REQUIRE(rejects(chunkCounts, 1000));
+        REQUIRE(rejects(chunkCounts + 4, Gems::ChunkCapacity + 1));
+        REQUIRE(rejects(chunkCounts + 4 + 4 * gems.ChunkCount(), 1));
+        REQUIRE(rejects(chunkCounts + 4 + 4 * gems.ChunkCount() + 4, 77));
+    }
+
+    SECTION("Snapshot sections")
+    {
+        Gems gems(1000);
+        eastl::vector<GemId> ids;
+
+        for (auto i = 0; i < 1000; i++)
+            ids.push_back(gems.Add(i % 50, i / 50, Green, { (float)i, 1 }));
+        for (auto i = 0; i < 1000; i += 7)
+            gems.Remove(ids[i]);
+
+        const Gems::SectionTags tags = { 'GIDX', 'GSLT', 'GIDS', 'GROW', 'GCOL', 'GCLR', 'GPOS' };
+        SnapshotWriter writer;
+        gems.AddSections(writer, tags);
+
+        eastl::vector<uint8_t> bytes;
+        REQUIRE(writer.Save(&bytes));
+
+        Snapshot snapshot;
+        REQUIRE(snapshot.Open(bytes.data(), bytes.size()));
+
+        // Each array is whole chunks, usable in place through the slot map.
+        auto positions = snapshot.Array<Float2>(tags[6]);
+        auto slotToLocation = snapshot.Array<uint32_t>(tags[1]);
+        REQUIRE(positions.size() == gems.ChunkCount() * Gems::ChunkCapacity);
+        REQUIRE(slotToLocation.size() == gems.Capacity());
+
+        REQUIRE(positions[slotToLocation[GemIdSlot(ids[1])]].x == 1.0f);
+
+        Gems loaded;
+        REQUIRE(loaded.LoadSections(snapshot, tags));
+        REQUIRE(loaded.Count() == gems.Count());
+
+        for (auto i = 0; i < 1000; i++)
+        {
+            REQUIRE(loaded.Contains(ids[i]) == gems.Contains(ids[i]));
+            if (gems.Contains(ids[i]))
+                REQUIRE(loaded.Get<3>(ids[i]).x == (float)i);
+        }
+
+        // A missing section fails, and leaves the store as it was.
+        auto missing = tags;
+        missing[4] = 'NONE';
+        REQUIRE(!loaded.LoadSections(snapshot, missing));
+        REQUIRE(loaded.Count() == gems.Count());
+    }
+}
+
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+
+TEST_CASE("Gem chunks vs parallel vectors", "[.][benchmark][gemchunks]")
+{
+    using namespace m3;
+
+    struct Float2 { float x, y; };
+    const uint32_t count = 1 << 18;
+
+    GemChunks<Row, Col, GemColor, Float2, Float2> gems(count);
+    eastl::vector<Float2> positions(count), scales(count);
+    eastl::vector<GemColor> colors(count, Red);
+
+    for (auto i = 0U; i < count; i++)
+        gems.Add(0, 0, Red, { (float)i, 0 }, { 1, 1 });
+
+    // What RenderGems reads: position, scale and color of every gem.
+    BENCHMARK("Parallel vectors, all gems")
+    {
+        auto sum = 0.0f;
+        for (auto i = 0U; i < count; i++)
+            sum += positions[i].x * scales[i].x + colors[i].m_I;
+        return sum;
+    };
+
+    BENCHMARK("Chunks, all gems")
+    {
+        auto sum = 0.0f;
+        gems.ForEachChunk([&](uint32_t chunk, uint32_t n)
+        {
+            auto p = gems.Array<3>(chunk);
+            auto s = gems.Array<4>(chunk);
+            auto c = gems.Array<2>(chunk);
+            for (auto i = 0U; i < n; i++)
+                sum += p[i].x * s[i].x + c[i].m_I;
+        });
+        return sum;
+    };
+
+    // Keys that are already sorted still take the full passes.
+    BENCHMARK("Sort by key, all gems")
+    {
+        gems.SortBy([&](uint32_t chunk, uint32_t n, uint32_t* keys)
+        {
+            for (auto i = 0U; i < n; i++)
+                keys[i] = (uint32_t)gems.Array<3>(chunk)[i].x;
+        });
+        return gems.Unsorted();
+    };
+}
+
+#endif
+
+#endif
@@ -1,15 +1,292 @@
 #pragma once
 
-#include <EASTL\queue.h>
+#include <EASTL\span.h>
+#include <EASTL\vector.h>
 
 #include "m3Types.hpp"
+#include "m3Serialize.hpp"
 
 namespace m3
 {
+    // Hands out generational GemIds from a fixed number of slots. 
+    // Releasing an id bumps its slot's generation, so the id goes stale and the slot 
+    // can be handed out again. Free slots are kept on a stack, so bulk allocate/release 
+    // are straight copies, and nothing is allocated after Init().
     class GemPool
     {
     private:
-        // @Todo: Use a freelist instead?
+        eastl::vector<uint32_t> m_FreeSlots; // Stack, top at the back. Next slot to hand out is back().
+        eastl::vector<uint8_t> m_Generations;
+
+    public:
+        GemPool() = default;
+        GemPool(uint32_t capacity) { Init(capacity); }
+
+        void Init(uint32_t capacity)
+        {
+            assert(capacity > 0 && capacity - 1 <= GemIdSlotMask);
+
+            m_Generations.clear();
+            m_Generations.resize(capacity, 0);
+            m_FreeSlots.resize(capacity);
+
+            // Hand out slots in ascending order to begin with.
+            for (auto i = 0U; i < capacity; i++)
+                m_FreeSlots[i] = capacity - 1 - i;
+        }
+
+        inline uint32_t Capacity() const { return (uint32_t)m_Generations.size(); }
+        inline uint32_t FreeCount() const { return (uint32_t)m_FreeSlots.size(); }
+
+        GemId GetOrCreateGem()
+        {
+            assert(FreeCount() > 0);
+
+            auto slot = m_FreeSlots.back();
+            m_FreeSlots.pop_back();
+
+            return MakeGemId(slot, m_Generations[slot]);
+        }
+
+        void ReleaseGem(GemId id)
+        {
+            assert(IsAlive(id));
+
+            auto slot = GemIdSlot(id);
+            BumpGeneration(slot);
+            m_FreeSlots.push_back(slot);
+        }
+
+        // Fills outIds with up to count new ids, and returns how many it handed out.
+        uint32_t AllocateN(uint32_t count, eastl::span<GemId> outIds)
+        {
+            count = eastl::min(count, (uint32_t)outIds.size());
+            count = eastl::min(count, FreeCount());
+
+            auto top = m_FreeSlots.data() + m_FreeSlots.size();
+            for (auto i = 0U; i < count; i++)
+            {
+                auto slot = *(--top);
+                outIds[i] = MakeGemId(slot, m_Generations[slot]);
+            }
+
+            m_FreeSlots.resize(m_FreeSlots.size() - count);
+
+            return count;
+        }
+
+        void ReleaseN(eastl::span<const GemId> ids)
+        {
+            assert(FreeCount() + ids.size() <= Capacity());
+
+            // Capacity was reserved in Init(), so this never reallocates.
+            auto base = m_FreeSlots.size();
+            m_FreeSlots.resize(base + ids.size());
+
+            // Reverse, so the next AllocateN hands the same slots back in the same order.
+            auto top = m_FreeSlots.data() + base + ids.size();
+            for (auto id : ids)
+            {
+                assert(IsAlive(id));
+
+                auto slot = GemIdSlot(id);
+                BumpGeneration(slot);
+                *(--top) = slot;
+            }
+        }
+
+        // Generations wrap after GemIdMaxGeneration + 1 (255) reuses of a slot, and an id 
+        // held across that many reads as alive again. Cascades recycle slots every step,
+        // so ids must not be kept across more than a few steps: the game only keeps them
+        // in the board and in tweens of the step being played.
+        inline bool IsAlive(GemId id) const
+        {
+            auto slot = GemIdSlot(id);
+            return id != InvalidGemId
+                && slot < m_Generations.size()
+                && GemIdGeneration(id) == m_Generations[slot];
+        }
+
+        void Save(BinaryWriter& writer) const
+        {
+            writer.WriteVector(m_Generations);
+            writer.WriteVector(m_FreeSlots);
+        }
+
+        // Keeps the no-allocation guarantee: the free stack is reserved to capacity again.
+        // Leaves the pool as it was if the data is bad: out of range or repeated free slots,
+        // or generations that are never handed out.
+        bool Load(BinaryReader& reader)
+        {
+            eastl::vector<uint8_t> generations;
+            eastl::vector<uint32_t> freeSlots;
+
+            reader.ReadVector(&generations);
+            reader.ReadVector(&freeSlots);
+
+            if (!reader.Ok() || generations.empty() || generations.size() - 1 > GemIdSlotMask || 
+                freeSlots.size() > generations.size())
+                return false;
+
+            for (auto generation : generations)
+            {
+                if (generation > GemIdMaxGeneration)
+                    return false;
+            }
+
+            eastl::vector<uint8_t> isFree(generations.size(), 0);
+            for (auto slot : freeSlots)
+            {
+                if (slot >= generations.size() || isFree[slot])
+                    return false;
+
+                isFree[slot] = 1;
+            }
+
+            freeSlots.reserve(generations.size());
+            m_Generations.swap(generations);
+            m_FreeSlots.swap(freeSlots);
+            return true;
+        }
+
+    private:
+        inline void BumpGeneration(uint32_t slot)
+        {
+            auto& generation = m_Generations[slot];
+            generation = (generation == GemIdMaxGeneration) ? 0 : generation + 1;
+        }
+    };
+}
+
+#ifdef CatchAvailable__
+
+TEST_CASE("Gem pool", "[gempool]")
+{
+    using namespace m3;
+
+    GemPool pool(8);
+    GemId ids[8];
+
+    SECTION("Bulk allocation hands out slots in order")
+    {
+        REQUIRE(pool.AllocateN(5, ids) == 5);
+        REQUIRE(pool.FreeCount() == 3);
+
+        for (auto i = 0U; i < 5; i++)
+        {
+            REQUIRE(GemIdSlot(ids[i]) == i);
+            REQUIRE(pool.IsAlive(ids[i]));
+        }
+
+        REQUIRE(GemIdSlot(pool.GetOrCreateGem()) == 5);
+    }
+
+    SECTION("Allocation stops at capacity")
+    {
+        REQUIRE(pool.AllocateN(100, ids) == 8);
+        REQUIRE(pool.FreeCount() == 0);
+        REQUIRE(pool.AllocateN(1, ids) == 0);
+    }
+
+    SECTION("Released ids go stale and their slots come back in the same order")
+    {
+        pool.AllocateN(8, ids);
+        pool.ReleaseN({ ids + 2, 3 });
+
+        for (auto i = 2; i < 5; i++)
+            REQUIRE(!pool.IsAlive(ids[i]));
+
+        GemId again[3];
+        REQUIRE(pool.AllocateN(3, again) == 3);
+
+        for (auto i = 0; i < 3; i++)
+        {
+            REQUIRE(GemIdSlot(again[i]) == GemIdSlot(ids[i + 2]));
+            REQUIRE(again[i] != ids[i + 2]);
+            REQUIRE(pool.IsAlive(again[i]));
+        }
+    }
+
+    SECTION("Single and bulk release agree")
+    {
+        pool.AllocateN(2, ids);
+        pool.ReleaseGem(ids[0]);
+        pool.ReleaseN({ ids + 1, 1 });
+
+        REQUIRE(pool.FreeCount() == 8);
+        REQUIRE(!pool.IsAlive(ids[0]));
+        REQUIRE(!pool.IsAlive(ids[1]));
+    }
+
+    SECTION("Generations wrap after 255 reuses of a slot")
+    {
+        pool.AllocateN(8, ids);
+        auto first = ids[0];
+
+        for (auto i = 0U; i < GemIdMaxGeneration; i++)
+        {
+            pool.ReleaseGem(ids[0]);
+            pool.AllocateN(1, ids);
+            REQUIRE(!pool.IsAlive(first));
+        }
+
+        pool.ReleaseGem(ids[0]);
+        pool.AllocateN(1, ids);
+        REQUIRE(ids[0] == first);
+        REQUIRE(pool.IsAlive(first));
+    }
+
+    SECTION("Load rejects free slots that are out of range or repeated")
+    {
+        pool.AllocateN(3, ids);
+
+        auto load = [](const eastl::vector<uint8_t>& generations, const eastl::vector<uint32_t>& freeSlots)
+        {
+            eastl::vector<uint8_t> bytes;
+            BinaryWriter writer(&bytes);
+            writer.WriteVector(generations);
+            writer.WriteVector(freeSlots);
+
+            GemPool loaded(4);
+            BinaryReader reader(bytes.data(), bytes.size());
+            auto ok = loaded.Load(reader);
+
+            // A failed load leaves the pool as it was.
+            if (!ok)
+                REQUIRE((loaded.Capacity() == 4 && loaded.FreeCount() == 4));
+
+            return ok;
+        };
+
+        REQUIRE(load({ 0, 1, 2 }, { 2, 0 }));
+        REQUIRE(!load({ 0, 1, 2 }, { 3 }));
+        REQUIRE(!load({ 0, 1, 2 }, { 1, 0, 1 }));
+        REQUIRE(!load({ 0, GemIdMaxGeneration + 1 }, {}));
+        REQUIRE(!load({}, {}));
+
+        eastl::vector<uint8_t> bytes;
+        BinaryWriter writer(&bytes);
+        pool.Save(writer);
+
+        GemPool loaded;
+        BinaryReader reader(bytes.data(), bytes.size());
+        REQUIRE(loaded.Load(reader));
+        REQUIRE(loaded.FreeCount() == pool.FreeCount());
+        REQUIRE(loaded.IsAlive(ids[2]));
+        REQUIRE(loaded.GetOrCreateGem() == pool.GetOrCreateGem());
+    }
+}
+
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+
+#include <EASTL\queue.h>
+
+namespace m3::GemPoolBench
+{
+    // The pool as it was: a queue of released ids, and a counter for new ones.
+    class QueueGemPool
+    {
+    private:
         eastl::queue<GemId> m_GemPool;
         GemId m_MaxGemId = 0;
 
@@ -33,4 +310,51 @@ namespace m3
             m_GemPool.push(id);
         }
     };
-}
\ No newline at end of file
+}
+
+TEST_CASE("Queue vs free-list gem pool", "[.][benchmark][gempool]")
+{
+    using namespace m3;
+
+    for (auto n : { 1024U, 16384U, 262144U })
+    {
+        eastl::vector<GemId> ids(n);
+        auto size = std::to_string(n);
+
+        GemPoolBench::QueueGemPool queuePool;
+        for (auto i = 0U; i < n; i++)
+            ids[i] = queuePool.GetOrCreateGem();
+
+        BENCHMARK("Queue release + acquire " + size)
+        {
+            for (auto i = 0U; i < n; i++)
+                queuePool.ReleaseGem(ids[i]);
+            for (auto i = 0U; i < n; i++)
+                ids[i] = queuePool.GetOrCreateGem();
+            return ids[0];
+        };
+
+        GemPool pool(n);
+        pool.AllocateN(n, ids);
+
+        BENCHMARK("Free-list release + acquire " + size)
+        {
+            for (auto i = 0U; i < n; i++)
+                pool.ReleaseGem(ids[i]);
+            for (auto i = 0U; i < n; i++)
+                ids[i] = pool.GetOrCreateGem();
+            return ids[0];
+        };
+
+        BENCHMARK("Free-list ReleaseN + AllocateN " + size)
+        {
+            pool.ReleaseN(ids);
+            pool.AllocateN(n, ids);
+            return ids[0];
+        };
+    }
+}
+
+#endif
+
+#endif
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <VectorMath.hpp>
+
+#include "m3Types.hpp"
+#include "m3GemChunks.hpp"
+
+namespace m3
+{
+    // What the game keeps per gem, see GemChunks. Positions and scales are computed stuff.
+    struct GemComponent
+    {
+        enum : size_t { Row, Col, Color, Position, Scale };
+    };
+
+    using GemStore = GemChunks<Row, Col, GemColor, Vector2, Vector2>;
+}
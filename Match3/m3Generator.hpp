@@ -0,0 +1,241 @@
+#pragma once
+
+#include <EASTL\vector.h>
+
+#include "m3Types.hpp"
+#include "m3Board.hpp"
+#include "m3Match.hpp"
+
+namespace m3
+{
+    // Fills a board in one pass without creating any runs. Each cell may take any color 
+    // but the one of two equal neighbors to its left, or two equal neighbors below it, 
+    // so there are always at least NumGemColors - 2 to pick from.
+    class BoardGenerator
+    {
+    public:
+        using Colors = DynamicBoard<GemColor>;
+
+    private:
+        static constexpr uint32_t AllColors = (1U << NumGemColors) - 1;
+
+        // The allowed color indices for each mask of allowed colors, so picking is a table lookup.
+        struct Choice
+        {
+            uint8_t m_Count;
+            uint8_t m_Indices[NumGemColors];
+        };
+
+        Choice m_Choices[AllColors + 1];
+
+        // Color indices of the last three rows generated.
+        eastl::vector<uint8_t> m_Rows[3];
+
+    public:
+        BoardGenerator()
+        {
+            for (auto mask = 0U; mask <= AllColors; mask++)
+            {
+                auto& choice = m_Choices[mask];
+                choice = {};
+
+                for (auto i = 0; i < NumGemColors; i++)
+                {
+                    if (mask & (1U << i))
+                        choice.m_Indices[choice.m_Count++] = (uint8_t)i;
+                }
+            }
+        }
+
+        // Only uses raw 32-bit draws from rng, so the board is the same on every 
+        // platform given the same generator and seed. Picks map 16 random bits to 
+        // [0, count) with a multiply instead of a divide.
+        template <class Rng>
+        void Generate(Colors* outColors, Rng& rng)
+        {
+            const auto rows = outColors->Rows().m_I;
+            const auto cols = outColors->Cols().m_I;
+
+            for (auto& row : m_Rows)
+                row.resize(cols);
+
+            // Each draw is split in two 16-bit halves, one per cell.
+            auto bits = 0U;
+
+            for (auto r = 0; r < rows; r++)
+            {
+                auto row = m_Rows[r % 3].data();
+                auto below = m_Rows[(r + 2) % 3].data();
+                auto below2 = m_Rows[(r + 1) % 3].data();
+                auto out = outColors->RowData(r);
+
+                // The two cells to the left, kept out of memory. 0xFF never equals an index.
+                uint32_t left = 0xFF, left2 = 0xFE;
+
+                for (auto c = 0; c < cols; c++)
+                {
+                    auto forbidden = 0U;
+
+                    if (left == left2)
+                        forbidden |= 1U << left;
+
+                    if (r >= 2 && below[c] == below2[c])
+                        forbidden |= 1U << below[c];
+
+                    if ((c & 1) == 0)
+                        bits = (uint32_t)rng();
+                    else
+                        bits >>= 16;
+
+                    const auto& choice = m_Choices[AllColors & ~forbidden];
+                    auto index = choice.m_Indices[((bits & 0xFFFF) * choice.m_Count) >> 16];
+
+                    row[c] = index;
+                    out[c] = GemColors[index + 1];
+                    left2 = left;
+                    left = index;
+                }
+            }
+        }
+
+        // As above, but also makes sure the board has at least minValidMoves swaps that 
+        // match, by generating again. Returns false if maxAttempts boards were all short 
+        // of moves, which only happens on tiny boards.
+        template <class Rng>
+        bool Generate(Colors* outColors, Rng& rng, int minValidMoves, int maxAttempts = 32)
+        {
+            for (auto attempt = 0; attempt < maxAttempts; attempt++)
+            {
+                Generate(outColors, rng);
+
+                if (minValidMoves <= 0 || CountValidMoves(*outColors, minValidMoves) >= minValidMoves)
+                    return true;
+            }
+
+            return false;
+        }
+    };
+}
+
+#ifdef CatchAvailable__
+
+#include "m3Bitboard.hpp"
+#include "m3Random.hpp"
+
+TEST_CASE("Board generator", "[generator]")
+{
+    using namespace m3;
+    using namespace m3::BitboardTest;
+
+    BoardGenerator generator;
+
+    SECTION("No runs, every cell colored")
+    {
+        const int sizes[][2] = { { 1, 1 }, { 3, 3 }, { 8, 8 }, { 64, 64 }, { 17, 100 }, { 100, 5 } };
+
+        for (auto& size : sizes)
+        {
+            for (auto seed = 0U; seed < 8; seed++)
+            {
+                INFO("Board " << size[0] << "x" << size[1] << " seed " << seed);
+
+                BoardGenerator::Colors colors(size[0], size[1]);
+                Random rng(seed);
+                generator.Generate(&colors, rng);
+
+                REQUIRE(WalkerMatches(colors).Count() == 0);
+
+                for (auto r = 0; r < size[0]; r++)
+                    for (auto c = 0; c < size[1]; c++)
+                        REQUIRE(GemColorIndex(colors(r, c)) >= 0);
+            }
+        }
+    }
+
+    SECTION("Same seed, same board")
+    {
+        BoardGenerator::Colors a(40, 30), b(40, 30);
+        Random rngA(5), rngB(5);
+
+        generator.Generate(&a, rngA);
+        generator.Generate(&b, rngB);
+
+        for (auto r = 0; r < 40; r++)
+            for (auto c = 0; c < 30; c++)
+                REQUIRE(a(r, c) == b(r, c));
+    }
+
+    SECTION("Known board")
+    {
+        // From a reference implementation of the generator and m3::Random, row 0 first.
+        const char expected[] = 
+            "RRYYGYO"
+            "BROOROB"
+            "YBGOBBO"
+            "YRYBRGY";
+
+        BoardGenerator::Colors colors(4, 7);
+        Random rng(1);
+        generator.Generate(&colors, rng);
+
+        for (auto r = 0; r < 4; r++)
+            for (auto c = 0; c < 7; c++)
+                REQUIRE(colors(r, c) == GemColor(expected[r * 7 + c]));
+    }
+
+    SECTION("Valid moves are guaranteed")
+    {
+        for (auto seed = 0U; seed < 16; seed++)
+        {
+            BoardGenerator::Colors colors(8, 8);
+            Random rng(seed);
+
+            REQUIRE(generator.Generate(&colors, rng, 5));
+            REQUIRE(CountValidMoves(colors) >= 5);
+            REQUIRE(WalkerMatches(colors).Count() == 0);
+        }
+    }
+
+    SECTION("Valid moves are counted")
+    {
+        BoardGenerator::Colors colors(3, 3,
+            "BRO"
+            "RGY"
+            "OYG", 9);
+
+        REQUIRE(CountValidMoves(colors) == 0);
+
+        // Swapping (0, 1) and (1, 1) makes BBB in row 0.
+        colors(0, 2) = Blue;
+        colors(1, 1) = Blue;
+        colors(1, 0) = Green;
+        REQUIRE(CountValidMoves(colors) == 1);
+
+        // And swapping (1, 2) and (2, 2) makes BBB in column 2.
+        colors(2, 2) = Blue;
+        REQUIRE(CountValidMoves(colors) == 2);
+        REQUIRE(CountValidMoves(colors, 1) == 1);
+    }
+}
+
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+
+TEST_CASE("Generate vs fill and clear", "[.][benchmark][generator]")
+{
+    using namespace m3;
+
+    const auto n = 4096;
+    BoardGenerator generator;
+    BoardGenerator::Colors colors(n, n);
+    Random rng(0);
+
+    BENCHMARK("Match-free generate 4096x4096")
+    {
+        generator.Generate(&colors, rng);
+        return colors(0, 0);
+    };
+}
+
+#endif
+
+#endif
@@ -0,0 +1,476 @@
+#pragma once
+
+#include <cstring>
+#include <EASTL\array.h>
+#include <EASTL\type_traits.h>
+#include <EASTL\vector.h>
+
+#include "m3Types.hpp"
+#include "m3Board.hpp"
+#include "m3Bits.hpp"
+#include "m3Simd.hpp"
+
+namespace m3
+{
+    // A gem falling within its column.
+    struct FallMove
+    {
+        Col m_Col;
+        Row m_From;
+        Row m_To;
+    };
+
+    /*
+        Gravity for a whole board in one pass: every column is compacted toward row 0,
+        keeping its order, and the cells above are emptied. Columns have to be
+        contiguous, so boards are ColMajor, of bytes (colors) or 32-bit values (ids).
+
+        On AVX2 this is stream compaction: a block of 16 bytes or 8 ids is compared
+        against the empty value, and the kept lanes are shuffled together with a table
+        indexed by 8 bits of the keep mask, then stored at the write position. Stores
+        can spill junk past the kept lanes, but only over cells that were already read
+        and are rewritten later. Blocks below a column's first hole are skipped.
+
+        Records a FallMove per gem that moved, by column then by row, which is the order
+        Simulation records them in, and the number of holes per column.
+
+        Simulation doesn't run this. Its colors are RowMajor for the match kernels, and 
+        each of its moves also updates the hash, the dirty cells and the events, so it 
+        falls cell by cell, and only in columns with holes, see Simulation::ApplyGravity.
+        This is for ColMajor planes that settle all at once; the 4096x4096 benchmark 
+        below times the kernel alone, not a cascade step.
+
+        SSE2 has no byte shuffle (pshufb is SSSE3), so below AVX2 it is the scalar loop.
+    */
+    class GravityKernel
+    {
+    private:
+        SimdLevel m_Level;
+        bool m_RecordMoves;
+        eastl::vector<uint32_t> m_Holes;   // Per column.
+        eastl::vector<FallMove> m_Moves;
+
+        // Lane indices of the set bits of every 8-bit mask, in order. Bytes for pshufb,
+        // with 0x80 (zero) in unused lanes, and nibbles for permutevar8x32.
+        struct ShuffleTables
+        {
+            eastl::array<uint64_t, 256> m_Bytes;
+            eastl::array<uint32_t, 256> m_Nibbles;
+        };
+
+        static const ShuffleTables& Tables()
+        {
+            static const ShuffleTables tables = []()
+            {
+                ShuffleTables t;
+
+                for (auto mask = 0U; mask < 256; mask++)
+                {
+                    auto bytes = 0x8080808080808080ULL;
+                    auto nibbles = 0U;
+                    auto lane = 0U;
+
+                    for (auto bit = 0U; bit < 8; bit++)
+                    {
+                        if ((mask >> bit) & 1)
+                        {
+                            bytes = (bytes & ~(0xFFULL << (lane * 8))) | ((uint64_t)bit << (lane * 8));
+                            nibbles |= bit << (lane * 4);
+                            lane++;
+                        }
+                    }
+
+                    t.m_Bytes[mask] = bytes;
+                    t.m_Nibbles[mask] = nibbles;
+                }
+
+                return t;
+            }();
+
+            return tables;
+        }
+
+    public:
+        GravityKernel(SimdLevel level = DetectSimdLevel(), bool recordMoves = true) :
+            m_Level(eastl::min(level, DetectSimdLevel()) == SimdLevel::AVX2 ? SimdLevel::AVX2 : SimdLevel::Scalar),
+            m_RecordMoves(recordMoves)
+        { }
+
+        inline SimdLevel Level() const { return m_Level; }
+        inline const eastl::vector<uint32_t>& Holes() const { return m_Holes; }
+        inline const eastl::vector<FallMove>& Moves() const { return m_Moves; }
+
+        // Returns the number of holes, which are now at the top of their columns.
+        template <class T>
+        uint32_t Compact(DynamicBoard<T, ColMajor>* board, T empty)
+        {
+            return CompactCols(board, empty, 0, board->Cols());
+        }
+
+        // Only touches columns [c0, c1). Bands of columns can go to different threads,
+        // each with its own kernel. Holes() covers the whole width, Moves() only the band.
+        template <class T>
+        uint32_t CompactCols(DynamicBoard<T, ColMajor>* board, T empty, Col c0, Col c1)
+        {
+            static_assert(sizeof(T) == 1 || sizeof(T) == 4);
+            static_assert(eastl::is_trivially_copyable<T>::value);
+            assert(c0 >= 0 && c0 <= c1 && c1 <= board->Cols());
+
+            const auto rows = (uint32_t)board->Rows().m_I;
+            const auto pitch = board->Pitch();
+
+            m_Holes.resize(board->Cols().m_I);
+            m_Moves.clear();
+
+            auto moves = m_RecordMoves ? &m_Moves : nullptr;
+            auto total = 0U;
+
+            for (auto c = c0; c < c1; c = c + 1)
+            {
+                auto column = board->Data() + (size_t)c.m_I * pitch;
+                uint32_t write;
+
+                switch (m_Level)
+                {
+                #ifdef X86Available__
+                    case SimdLevel::AVX2:
+                        if constexpr (sizeof(T) == 1)
+                            write = CompactBytes_AVX2((uint8_t*)column, rows, (uint8_t&)empty, c, moves);
+                        else
+                            write = CompactIds_AVX2((uint32_t*)column, rows, (uint32_t&)empty, c, moves);
+                        break;
+                #endif
+                    default: write = Compact_Scalar(column, rows, empty, c, moves); break;
+                }
+
+                for (auto r = write; r < rows; r++)
+                    column[r] = empty;
+
+                m_Holes[c.m_I] = rows - write;
+                total += rows - write;
+            }
+
+            return total;
+        }
+
+    private:
+        template <class T>
+        static uint32_t Compact_Scalar(T* column, uint32_t rows, T empty, Col c, eastl::vector<FallMove>* moves)
+        {
+            auto write = 0U;
+
+            for (auto r = 0U; r < rows; r++)
+            {
+                if (memcmp(&column[r], &empty, sizeof(T)) == 0)
+                    continue;
+
+                if (write != r)
+                {
+                    column[write] = column[r];
+
+                    if (moves)
+                        moves->push_back({ c, (int)r, (int)write });
+                }
+
+                write++;
+            }
+
+            return write;
+        }
+
+        // One move per kept lane of a block that starts at row r, landing from write on.
+        static inline void RecordMoves(uint32_t keep, uint32_t r, uint32_t write, Col c, eastl::vector<FallMove>* moves)
+        {
+            for (; keep != 0; keep &= keep - 1, write++)
+            {
+                auto from = r + CountTrailingZeros(keep);
+                if (from != write)
+                    moves->push_back({ c, (int)from, (int)write });
+            }
+        }
+
+        // Keep mask of a block, minus the lanes past the end of the column.
+        static inline uint32_t ClipToRows(uint32_t keep, uint32_t r, uint32_t rows, uint32_t lanes)
+        {
+            return rows - r < lanes ? keep & (uint32_t)LowBits(rows - r) : keep;
+        }
+
+    #ifdef X86Available__
+        // Loads are aligned: boards align columns to 32 bytes and pad them to a multiple of
+        // 32 bytes, so a block never reads or writes past the column's storage.
+        TargetAvx2__
+        static uint32_t CompactBytes_AVX2(uint8_t* column, uint32_t rows, uint8_t empty, Col c, eastl::vector<FallMove>* moves)
+        {
+            const auto& table = Tables().m_Bytes;
+            const auto emptyV = _mm_set1_epi8((char)empty);
+            const auto highLanes = _mm_set_epi64x(0x0808080808080808LL, 0);
+
+            auto write = 0U;
+
+            for (auto r = 0U; r < rows; r += 16)
+            {
+                const auto v = _mm_load_si128((const __m128i*)(column + r));
+                auto keep = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, emptyV)) & 0xFFFF;
+                keep = ClipToRows(keep, r, rows, 16);
+
+                if (keep == 0xFFFF && write == r)
+                {
+                    write += 16;
+                    continue;
+                }
+
+                if (moves)
+                    RecordMoves(keep, r, write, c, moves);
+
+                const auto lo = keep & 0xFF;
+                const auto hi = keep >> 8;
+                const auto shuffle = _mm_add_epi8(_mm_set_epi64x((long long)table[hi], (long long)table[lo]), highLanes);
+                const auto packed = _mm_shuffle_epi8(v, shuffle);
+
+                _mm_storel_epi64((__m128i*)(column + write), packed);
+                write += PopCount(lo);
+                _mm_storel_epi64((__m128i*)(column + write), _mm_unpackhi_epi64(packed, packed));
+                write += PopCount(hi);
+            }
+
+            return write;
+        }
+
+        TargetAvx2__
+        static uint32_t CompactIds_AVX2(uint32_t* column, uint32_t rows, uint32_t empty, Col c, eastl::vector<FallMove>* moves)
+        {
+            const auto& table = Tables().m_Nibbles;
+            const auto emptyV = _mm256_set1_epi32((int)empty);
+            const auto shifts = _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28);
+            const auto lanes = _mm256_set1_epi32(7);
+
+            auto write = 0U;
+
+            for (auto r = 0U; r < rows; r += 8)
+            {
+                const auto v = _mm256_load_si256((const __m256i*)(column + r));
+                auto keep = ~(uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, emptyV))) & 0xFF;
+                keep = ClipToRows(keep, r, rows, 8);
+
+                if (keep == 0xFF && write == r)
+                {
+                    write += 8;
+                    continue;
+                }
+
+                if (moves)
+                    RecordMoves(keep, r, write, c, moves);
+
+                const auto shuffle = _mm256_and_si256(_mm256_srlv_epi32(_mm256_set1_epi32((int)table[keep]), shifts), lanes);
+                _mm256_storeu_si256((__m256i*)(column + write), _mm256_permutevar8x32_epi32(v, shuffle));
+                write += PopCount(keep);
+            }
+
+            return write;
+        }
+    #endif
+    };
+}
+
+#ifdef CatchAvailable__
+
+#include "m3Random.hpp"
+
+namespace m3::GravityTest
+{
+    // The cell by cell fall, as the reference.
+    template <class T>
+    void Fall(DynamicBoard<T, ColMajor>& board, T empty, eastl::vector<uint32_t>* outHoles)
+    {
+        outHoles->assign(board.Cols().m_I, 0);
+
+        for (auto c = 0; c < board.Cols().m_I; c++)
+        {
+            auto write = 0;
+            for (auto r = 0; r < board.Rows().m_I; r++)
+            {
+                if (board(r, c) != empty)
+                    board(write++, c) = board(r, c);
+            }
+
+            (*outHoles)[c] = board.Rows().m_I - write;
+
+            for (auto r = write; r < board.Rows().m_I; r++)
+                board(r, c) = empty;
+        }
+    }
+
+    template <class T>
+    DynamicBoard<T, ColMajor> RandomBoard(int rows, int cols, uint32_t seed, int holeOneIn, T empty)
+    {
+        Random random(seed);
+        DynamicBoard<T, ColMajor> board(rows, cols);
+
+        for (auto r = 0; r < rows; r++)
+        {
+            for (auto c = 0; c < cols; c++)
+            {
+                T value = T(1 + random() % 250);
+                if (value == empty)
+                    value = T(1);
+
+                board(r, c) = (holeOneIn > 0 && random() % holeOneIn == 0) ? empty : value;
+            }
+        }
+
+        return board;
+    }
+
+    template <class T>
+    bool SameCells(const DynamicBoard<T, ColMajor>& a, const DynamicBoard<T, ColMajor>& b)
+    {
+        for (auto c = 0; c < a.Cols().m_I; c++)
+            for (auto r = 0; r < a.Rows().m_I; r++)
+                if (a(r, c) != b(r, c))
+                    return false;
+        return true;
+    }
+
+    template <class T>
+    void Check(SimdLevel level, T empty)
+    {
+        const int sizes[][2] = { { 1, 1 }, { 7, 3 }, { 16, 4 }, { 17, 5 }, { 33, 9 }, { 64, 64 }, { 100, 31 }, { 255, 2 } };
+
+        GravityKernel kernel(level);
+
+        for (auto& size : sizes)
+        {
+            for (auto holeOneIn : { 0, 1, 2, 9 })
+            {
+                auto seed = (uint32_t)(size[0] * 31 + size[1] * 7 + holeOneIn);
+                auto board = RandomBoard<T>(size[0], size[1], seed, holeOneIn, empty);
+                auto expected = board;
+                auto replayed = board;
+
+                eastl::vector<uint32_t> holes;
+                Fall(expected, empty, &holes);
+
+                auto total = kernel.Compact(&board, empty);
+
+                INFO(ToString(level) << " " << size[0] << "x" << size[1] << " holes one in " << holeOneIn);
+                REQUIRE(SameCells(board, expected));
+                REQUIRE((kernel.Holes() == holes));
+
+                auto sum = 0U;
+                for (auto h : holes)
+                    sum += h;
+                REQUIRE(total == sum);
+
+                // Moves replay onto the original board, in order, and leave the same cells.
+                for (auto& move : kernel.Moves())
+                {
+                    REQUIRE(move.m_From > move.m_To);
+                    replayed(move.m_To, move.m_Col) = replayed(move.m_From, move.m_Col);
+                    replayed(move.m_From, move.m_Col) = empty;
+                }
+
+                for (auto c = 0; c < size[1]; c++)
+                    for (auto r = size[0] - (int)holes[c]; r < size[0]; r++)
+                        replayed(r, c) = empty;
+
+                REQUIRE(SameCells(replayed, expected));
+            }
+        }
+    }
+}
+
+TEST_CASE("Gravity kernel", "[gravity]")
+{
+    using namespace m3;
+    using namespace m3::GravityTest;
+
+    const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::AVX2 };
+
+    for (auto level : levels)
+    {
+        Check<GemColor>(level, InvalidColor);
+        Check<GemId>(level, InvalidGemId);
+    }
+
+    SECTION("SSE2 runs the scalar loop")
+    {
+        REQUIRE(GravityKernel(SimdLevel::SSE2).Level() == SimdLevel::Scalar);
+    }
+
+    SECTION("Full columns are left alone")
+    {
+        auto board = RandomBoard<GemColor>(40, 6, 1, 0, InvalidColor);
+        auto copy = board;
+
+        GravityKernel kernel;
+        REQUIRE(kernel.Compact(&board, InvalidColor) == 0);
+        REQUIRE(kernel.Moves().empty());
+        REQUIRE(SameCells(board, copy));
+    }
+
+    SECTION("Bands of columns")
+    {
+        auto board = RandomBoard<GemId>(50, 20, 2, 3, InvalidGemId);
+        auto expected = board;
+
+        eastl::vector<uint32_t> holes;
+        Fall(expected, InvalidGemId, &holes);
+
+        GravityKernel kernel;
+        kernel.CompactCols(&board, InvalidGemId, 0, 7);
+        kernel.CompactCols(&board, InvalidGemId, 7, 20);
+
+        REQUIRE(SameCells(board, expected));
+        REQUIRE((kernel.Holes() == holes));
+        REQUIRE(kernel.Moves().front().m_Col == 7);
+    }
+}
+
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+
+TEST_CASE("Gravity kernel on large boards", "[.][benchmark][gravity]")
+{
+    using namespace m3;
+    using namespace m3::GravityTest;
+
+    const int n = 4096;
+
+    // A hole in about one cell in 64, the rest above them all falls.
+    auto source = RandomBoard<GemColor>(n, n, 0, 64, InvalidColor);
+    auto board = source;
+    auto ids = RandomBoard<GemId>(n, n, 0, 64, InvalidGemId);
+    auto idsBoard = ids;
+
+    for (auto level : { SimdLevel::Scalar, SimdLevel::AVX2 })
+    {
+        GravityKernel kernel(level, false);
+        GravityKernel recording(level, true);
+        auto name = std::string(ToString(kernel.Level())) + " 4096x4096";
+
+        // Each run starts from the same holes, so the copy is timed too, see below.
+        BENCHMARK(name + " colors")
+        {
+            board.CopyFrom(source);
+            return kernel.Compact(&board, InvalidColor);
+        };
+
+        BENCHMARK(name + " colors + moves")
+        {
+            board.CopyFrom(source);
+            return recording.Compact(&board, InvalidColor);
+        };
+
+        BENCHMARK(name + " ids")
+        {
+            idsBoard.CopyFrom(ids);
+            return kernel.Compact(&idsBoard, InvalidGemId);
+        };
+    }
+
+    BENCHMARK("Copy only, colors") { board.CopyFrom(source); return board(0, 0); };
+    BENCHMARK("Copy only, ids") { idsBoard.CopyFrom(ids); return idsBoard(0, 0); };
+}
+
+#endif
+
+#endif
@@ -154,6 +154,42 @@ namespace m3
 
         return m;
     }
+
+    inline bool HasRun(const Matches& m, int n = 3)
+    {
+        return m.Row_0.Count() >= n || m.Row_1.Count() >= n 
+            || m.Col_0.Count() >= n || m.Col_1.Count() >= n;
+    }
+
+    // Number of adjacent swaps that would make a run, counting stops at limit.
+    template <class Values>
+    int CountValidMoves(const Values& values, int limit = eastl::numeric_limits<int>::max())
+    {
+        const auto rMax = values.Rows() - 1;
+        const auto cMax = values.Cols() - 1;
+        auto count = 0;
+
+        for (auto r = 0; r <= rMax.m_I; r++)
+        {
+            for (auto c = 0; c <= cMax.m_I; c++)
+            {
+                auto color = values(r, c);
+                if (color == InvalidColor)
+                    continue;
+
+                if (c < cMax.m_I && values(r, c + 1) != color && values(r, c + 1) != InvalidColor)
+                    count += HasRun(GetMatchesForSwap_Row(r, c, c + 1, values, rMax, cMax)) ? 1 : 0;
+
+                if (r < rMax.m_I && values(r + 1, c) != color && values(r + 1, c) != InvalidColor)
+                    count += HasRun(GetMatchesForSwap_Col(c, r, r + 1, values, rMax, cMax)) ? 1 : 0;
+
+                if (count >= limit)
+                    return count;
+            }
+        }
+
+        return count;
+    }
 }
 
 #ifdef CatchAvailable__
@@ -303,4 +339,195 @@ TEST_CASE("Matching functions", "[matching]")
     }
 }
 
+TEST_CASE("Matching on a dynamic board", "[matching]")
+{
+    using namespace m3;
+
+    const int Rows = 5;
+    const int Cols = 8;
+
+    const char colors_[] = 
+        /*  |        */
+        ___01234567
+        _4"BOOGYBRO"
+        _3"OBOOGYBR" // -
+        _2"ROBBOGYB" // -
+        _1"BBOBROGY"
+        _0"YBROBROG";
+
+    using GemColors = DynamicBoard<gem_color_t>;
+
+    GemColors colors(Rows, Cols);
+    GemColors::CreateInverted(colors_, sizeof(colors_), &colors);
+
+    auto m = GetMatchesForSwap_Col(1, 2, 3, colors, Rows - 1, Cols - 1);
+
+    REQUIRE(m.Row_0 == RowSpan { 2, 1, 3 });
+    REQUIRE(m.Row_1 == RowSpan { 3, 0, 3 });
+    REQUIRE(m.Col_0 == ColSpan { 1, 0, 2 });
+    REQUIRE(m.Col_1 == ColSpan { 1, 3, 4 });
+}
+
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+
+#include <EASTL\unique_ptr.h>
+#include <EASTL\vector.h>
+
+namespace m3::BoardBench
+{
+    template <class B>
+    uint32_t SumAll(const B& board)
+    {
+        uint32_t sum = 0;
+        for (auto r = 0; r < board.Rows().m_I; r++)
+            for (auto c = 0; c < board.Cols().m_I; c++)
+                sum += board(r, c);
+        return sum;
+    }
+
+    template <class B>
+    uint32_t LongestRowRuns(const B& board)
+    {
+        uint32_t longest = 0;
+        for (auto r = 0; r < board.Rows().m_I; r++)
+        {
+            for (auto c = 0; c < board.Cols().m_I; )
+            {
+                auto c1 = GetMatchingColsInRow_R(r, c, board(r, c), board, board.Cols() - 1);
+                longest = eastl::max(longest, (uint32_t)(c1.m_I - c + 1));
+                c = c1.m_I + 1;
+            }
+        }
+        return longest;
+    }
+
+    template <int N>
+    void Run()
+    {
+        using Fixed = Board<uint8_t, N, N>;
+        using Dynamic = DynamicBoard<uint8_t>;
+
+        // Too big for the stack at the larger sizes.
+        auto fixed = eastl::make_unique<Fixed>();
+        auto dynamic = Dynamic(N, N);
+
+        for (auto r = 0; r < N; r++)
+        {
+            for (auto c = 0; c < N; c++)
+            {
+                auto v = (uint8_t)(((r * 7) ^ (c * 13)) % 5);
+                (*fixed)(r, c) = v;
+                dynamic(r, c) = v;
+            }
+        }
+
+        BENCHMARK("Fixed " + std::to_string(N) + "x" + std::to_string(N) + " sum") { return SumAll(*fixed); };
+        BENCHMARK("Dynamic " + std::to_string(N) + "x" + std::to_string(N) + " sum") { return SumAll(dynamic); };
+        BENCHMARK("Fixed " + std::to_string(N) + "x" + std::to_string(N) + " row runs") { return LongestRowRuns(*fixed); };
+        BENCHMARK("Dynamic " + std::to_string(N) + "x" + std::to_string(N) + " row runs") { return LongestRowRuns(dynamic); };
+    }
+
+    // Same walks as Match3Game::FindAndClearFromWholeBoard, without the hash set.
+    template <class B>
+    uint32_t WholeBoardScan(const B& board, eastl::vector<uint8_t>& cleared)
+    {
+        const auto n = 3;
+        const auto rMax = board.Rows() - 1;
+        const auto cMax = board.Cols() - 1;
+
+        for (auto r = 0; r < board.Rows().m_I; r++)
+        {
+            for (auto c = 0; c < board.Cols().m_I; c++)
+            {
+                auto color = board(r, c);
+
+                auto c0 = GetMatchingColsInRow_L(r, c, color, board);
+                auto c1 = GetMatchingColsInRow_R(r, c, color, board, cMax);
+                auto r0 = GetMatchingRowsInCol_D(r, c, color, board);
+                auto r1 = GetMatchingRowsInCol_U(r, c, color, board, rMax);
+
+                if ((c1 - c0 + 1) >= n || (r1 - r0 + 1) >= n)
+                    cleared[board.Index(r, c)] = 1;
+            }
+        }
+
+        uint32_t count = 0;
+        for (auto i = 0U; i < cleared.size(); i++)
+            count += cleared[i];
+        return count;
+    }
+
+    // Punches holes in every column and compacts them like Match3Game::MakeGemsFall.
+    template <class B>
+    uint32_t FallAll(B& board)
+    {
+        uint32_t moved = 0;
+
+        for (auto c = 0; c < board.Cols().m_I; c++)
+        {
+            for (auto r = c % 4; r < board.Rows().m_I; r += 4)
+                board(r, c) = 0;
+
+            auto dr = 0;
+            for (auto r = 0; r < board.Rows().m_I; r++)
+            {
+                auto value = board(r, c);
+
+                if (value == 0)
+                    dr++;
+                else if (dr > 0)
+                {
+                    board(r - dr, c) = value;
+                    board(r, c) = 0;
+                    moved++;
+                }
+            }
+
+            // Refill.
+            for (auto r = board.Rows().m_I - dr; r < board.Rows().m_I; r++)
+                board(r, c) = (uint8_t)(1 + (r + c) % 5);
+        }
+
+        return moved;
+    }
+
+    template <class Layout>
+    void RunLayout(const char* name, int n)
+    {
+        using Colors = DynamicBoard<uint8_t, Layout>;
+
+        Colors board(n, n);
+        eastl::vector<uint8_t> cleared(board.Size());
+
+        for (auto r = 0; r < n; r++)
+            for (auto c = 0; c < n; c++)
+                board(r, c) = (uint8_t)(1 + ((r * 7) ^ (c * 13)) % 5);
+
+        auto size = std::to_string(n) + "x" + std::to_string(n);
+
+        BENCHMARK(std::string(name) + " " + size + " whole board scan") { return WholeBoardScan(board, cleared); };
+        BENCHMARK(std::string(name) + " " + size + " column falls") { return FallAll(board); };
+    }
+}
+
+TEST_CASE("Fixed vs dynamic board", "[.][benchmark][board]")
+{
+    m3::BoardBench::Run<8>();
+    m3::BoardBench::Run<64>();
+    m3::BoardBench::Run<512>();
+    m3::BoardBench::Run<4096>();
+}
+
+TEST_CASE("Board layouts", "[.][benchmark][board]")
+{
+    for (auto n : { 64, 512, 2048 })
+    {
+        m3::BoardBench::RunLayout<m3::RowMajor>("RowMajor", n);
+        m3::BoardBench::RunLayout<m3::ColMajor>("ColMajor", n);
+        m3::BoardBench::RunLayout<m3::Tiled8x8>("Tiled8x8", n);
+    }
+}
+
+#endif
+
 #endif
\ No newline at end of file
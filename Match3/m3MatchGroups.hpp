@@ -0,0 +1,412 @@
+#pragma once
+
+#include <EASTL\span.h>
+#include <EASTL\vector.h>
+
+#include "m3Types.hpp"
+#include "m3Span.hpp"
+#include "m3RunScanner.hpp"
+
+namespace m3
+{
+    enum class MatchShape : uint8_t
+    {
+        Line3,
+        Line4,
+        Line5,  // Five or more.
+        L,      // Two runs meeting at their ends.
+        T,      // The end of one run meets the middle of another.
+        Cross,  // Two runs crossing in their middles.
+    };
+
+    struct MatchGroup
+    {
+        GemColor m_Color;
+        MatchShape m_Shape;
+        uint8_t m_Longest;      // Longest run, capped at 255.
+        uint32_t m_Cells;       // Distinct cells.
+        Row m_PivotRow;         // Where a special gem would spawn: the deciding
+        Col m_PivotCol;         // intersection, or the middle of a line.
+        uint32_t m_FirstSpan;   // Into MatchGrouper::GroupSpans().
+        uint32_t m_SpanCount;
+    };
+
+    /*
+        Joins the runs from a RunScanner into connected groups, one per set of
+        intersecting runs, with a union-find over run indices, and classifies each group
+        by shape. Row runs are indices [0, rows), column runs [rows, rows + cols).
+
+        Crossings are found in a single top-down sweep that leans on the scanner's
+        order (column runs by end row, row runs by row) instead of a per-cell grid: only
+        the cells of row runs are visited, each once. After that everything is linear in
+        runs and crossings. It all lives in arenas that keep their capacity, so steady
+        state does not allocate.
+
+        Groups come out ordered by their lowest run index, ie. by their first row run
+        bottom up, then by column runs in the order they end.
+    */
+    class MatchGrouper
+    {
+    private:
+        eastl::vector<uint32_t> m_Parent;
+        eastl::vector<uint32_t> m_Group;        // Per run, its group.
+        eastl::vector<uint32_t> m_Active;       // Per column, the last column run reached by the sweep.
+        eastl::vector<uint32_t> m_GroupSpans;   // Run indices, grouped.
+        eastl::vector<eastl::pair<uint32_t, uint32_t>> m_Crossings; // Row run, column run.
+        eastl::vector<MatchGroup> m_Groups;
+
+        static constexpr uint32_t None = ~0U;
+
+    public:
+        inline const eastl::vector<MatchGroup>& Groups() const { return m_Groups; }
+        inline const eastl::vector<uint32_t>& GroupSpans() const { return m_GroupSpans; }
+
+        inline eastl::span<const uint32_t> Spans(const MatchGroup& group) const
+        {
+            return { m_GroupSpans.data() + group.m_FirstSpan, group.m_SpanCount };
+        }
+
+        // values(r, c) returns the GemColor of a cell, and is what runs were scanned from.
+        template <class Values>
+        uint32_t Group(const RunScanner& runs, const Values& values)
+        {
+            auto& rowRuns = runs.RowRuns();
+            auto& colRuns = runs.ColRuns();
+            const auto rowCount = (uint32_t)rowRuns.size();
+            const auto count = runs.RunCount();
+
+            m_Parent.resize(count);
+            for (auto i = 0U; i < count; i++)
+                m_Parent[i] = i;
+
+            m_Groups.clear();
+            m_Crossings.clear();
+            m_Group.assign(count, None);
+            m_Active.assign(values.Cols().m_I, None);
+
+            // Crossings, top down.
+            auto next = colRuns.size();
+
+            for (auto i = rowRuns.size(); i-- > 0; )
+            {
+                auto& row = rowRuns[i];
+
+                for (; next > 0 && colRuns[next - 1].Row_1() >= row.Row(); next--)
+                {
+                    assert(next == colRuns.size() || colRuns[next - 1].Row_1() <= colRuns[next].Row_1());
+                    m_Active[colRuns[next - 1].Col().m_I] = (uint32_t)(next - 1);
+                }
+
+                for (auto c = row.Col_0().m_I; c <= row.Col_1().m_I; c++)
+                {
+                    auto j = m_Active[c];
+                    if (j != None && colRuns[j].Row_0() <= row.Row())
+                    {
+                        m_Crossings.push_back({ (uint32_t)i, j });
+                        Union((uint32_t)i, rowCount + j);
+                    }
+                }
+            }
+
+            // Groups, numbered by their lowest run, which is their root.
+            for (auto i = 0U; i < count; i++)
+            {
+                auto root = Find(i);
+                if (root == i)
+                {
+                    m_Group[i] = (uint32_t)m_Groups.size();
+                    m_Groups.push_back({ InvalidColor, MatchShape::Line3, 0, 0, 0, 0, 0, 0 });
+                }
+
+                auto& group = m_Groups[m_Group[root]];
+                int length = i < rowCount ? rowRuns[i].Count().m_I : colRuns[i - rowCount].Count().m_I;
+
+                m_Group[i] = m_Group[root];
+                group.m_SpanCount++;
+                group.m_Cells += length;
+                group.m_Longest = (uint8_t)eastl::min(eastl::max((int)group.m_Longest, length), 255);
+            }
+
+            // Flat run lists, a counting sort by group.
+            auto first = 0U;
+            for (auto& group : m_Groups)
+            {
+                group.m_FirstSpan = first;
+                first += group.m_SpanCount;
+                group.m_SpanCount = 0;
+            }
+
+            m_GroupSpans.resize(count);
+            for (auto i = 0U; i < count; i++)
+            {
+                auto& group = m_Groups[m_Group[i]];
+                m_GroupSpans[group.m_FirstSpan + group.m_SpanCount++] = i;
+            }
+
+            // Lines, then the best crossing of each group, which counts one cell twice.
+            for (auto& group : m_Groups)
+            {
+                auto i = m_GroupSpans[group.m_FirstSpan];
+                Row r;
+                Col c;
+
+                if (i < rowCount)
+                {
+                    r = rowRuns[i].Row();
+                    c = (rowRuns[i].Col_0().m_I + rowRuns[i].Col_1().m_I) / 2;
+                }
+                else
+                {
+                    r = (colRuns[i - rowCount].Row_0().m_I + colRuns[i - rowCount].Row_1().m_I) / 2;
+                    c = colRuns[i - rowCount].Col();
+                }
+
+                group.m_Color = values(r, c);
+                group.m_Shape = LineShape(group.m_Longest);
+                group.m_PivotRow = r;
+                group.m_PivotCol = c;
+            }
+
+            for (auto [i, j] : m_Crossings)
+            {
+                auto& row = rowRuns[i];
+                auto& col = colRuns[j];
+                auto& group = m_Groups[m_Group[i]];
+
+                group.m_Cells--;
+
+                auto shape = CrossingShape(row, col);
+                if (group.m_Shape < MatchShape::L || shape > group.m_Shape)
+                {
+                    group.m_Shape = shape;
+                    group.m_PivotRow = row.Row();
+                    group.m_PivotCol = col.Col();
+                }
+            }
+
+            return (uint32_t)m_Groups.size();
+        }
+
+        static inline MatchShape LineShape(int length)
+        {
+            return length >= 5 ? MatchShape::Line5 : length == 4 ? MatchShape::Line4 : MatchShape::Line3;
+        }
+
+        static inline bool Crosses(const RowSpan& row, const ColSpan& col)
+        {
+            return row.Col_0() <= col.Col() && col.Col() <= row.Col_1()
+                && col.Row_0() <= row.Row() && row.Row() <= col.Row_1();
+        }
+
+        static inline MatchShape CrossingShape(const RowSpan& row, const ColSpan& col)
+        {
+            auto rowEnd = col.Col() == row.Col_0() || col.Col() == row.Col_1();
+            auto colEnd = row.Row() == col.Row_0() || row.Row() == col.Row_1();
+            return rowEnd && colEnd ? MatchShape::L : rowEnd || colEnd ? MatchShape::T : MatchShape::Cross;
+        }
+
+    private:
+        inline uint32_t Find(uint32_t i)
+        {
+            while (m_Parent[i] != i)
+            {
+                m_Parent[i] = m_Parent[m_Parent[i]];
+                i = m_Parent[i];
+            }
+
+            return i;
+        }
+
+        // The lower index is the root, so a group's root is its first run.
+        inline void Union(uint32_t a, uint32_t b)
+        {
+            a = Find(a);
+            b = Find(b);
+
+            if (a < b)
+                m_Parent[b] = a;
+            else if (b < a)
+                m_Parent[a] = b;
+        }
+    };
+}
+
+#ifdef CatchAvailable__
+
+TEST_CASE("Match groups", "[matchgroups][matching]")
+{
+    using namespace m3;
+
+    using Colors = DynamicBoard<GemColor>;
+
+    RunScanner scanner;
+    MatchGrouper grouper;
+
+    auto group = [&](const char* colors_, size_t size, int rows, int cols)
+    {
+        Colors colors(rows, cols);
+        Colors::CreateInverted(colors_, size, &colors);
+
+        scanner.Scan(colors);
+        grouper.Group(scanner, colors);
+        return grouper.Groups();
+    };
+
+    SECTION("Lines, by lowest run")
+    {
+        const char colors_[] =
+            _2"OOOOOB"
+            _1"BGYRRR"
+            _0"GGGGBY";
+
+        auto groups = group(colors_, sizeof(colors_), 3, 6);
+
+        REQUIRE(groups.size() == 3);
+        REQUIRE(groups[0].m_Shape == MatchShape::Line4);
+        REQUIRE(groups[0].m_Color == Green);
+        REQUIRE(groups[0].m_Cells == 4);
+        REQUIRE(groups[1].m_Shape == MatchShape::Line3);
+        REQUIRE(groups[1].m_Color == Red);
+        REQUIRE(groups[2].m_Shape == MatchShape::Line5);
+        REQUIRE(groups[2].m_Color == Orange);
+        REQUIRE(groups[2].m_PivotRow == 2);
+        REQUIRE(groups[2].m_PivotCol == 2);
+    }
+
+    SECTION("L")
+    {
+        const char colors_[] =
+            _2"BGGYO"
+            _1"BYRYR"
+            _0"BBBOY";
+
+        auto groups = group(colors_, sizeof(colors_), 3, 5);
+
+        REQUIRE(groups.size() == 1);
+        REQUIRE(groups[0].m_Shape == MatchShape::L);
+        REQUIRE(groups[0].m_Cells == 5);
+        REQUIRE(groups[0].m_PivotRow == 0);
+        REQUIRE(groups[0].m_PivotCol == 0);
+        REQUIRE(grouper.Spans(groups[0]).size() == 2);
+    }
+
+    SECTION("T")
+    {
+        const char colors_[] =
+            _2"GYRBOB"
+            _1"BORGYO"
+            _0"RRRRRB";
+
+        auto groups = group(colors_, sizeof(colors_), 3, 6);
+
+        REQUIRE(groups.size() == 1);
+        REQUIRE(groups[0].m_Shape == MatchShape::T);
+        REQUIRE(groups[0].m_Color == Red);
+        REQUIRE(groups[0].m_Cells == 7);
+        REQUIRE(groups[0].m_Longest == 5);
+        REQUIRE(groups[0].m_PivotRow == 0);
+        REQUIRE(groups[0].m_PivotCol == 2);
+    }
+
+    SECTION("Cross")
+    {
+        const char colors_[] =
+            _2"GYRBO"
+            _1"BRRRY"
+            _0"GORGB";
+
+        auto groups = group(colors_, sizeof(colors_), 3, 5);
+
+        REQUIRE(groups.size() == 1);
+        REQUIRE(groups[0].m_Shape == MatchShape::Cross);
+        REQUIRE(groups[0].m_Cells == 5);
+        REQUIRE(groups[0].m_PivotRow == 1);
+        REQUIRE(groups[0].m_PivotCol == 2);
+    }
+
+    SECTION("Same partition as joining every crossing pair")
+    {
+        for (auto seed = 0U; seed < 40; seed++)
+        {
+            auto colors = BitboardTest::RandomBoard(3 + seed % 17, 5 + seed % 29, seed, (seed & 1) != 0);
+
+            scanner.Scan(colors, 1 + seed % 3);
+            grouper.Group(scanner, colors);
+
+            auto& rowRuns = scanner.RowRuns();
+            auto& colRuns = scanner.ColRuns();
+            auto rowCount = (uint32_t)rowRuns.size();
+
+            eastl::vector<uint32_t> group(scanner.RunCount(), ~0U);
+            auto cells = 0U;
+
+            for (auto g = 0U; g < grouper.Groups().size(); g++)
+            {
+                cells += grouper.Groups()[g].m_Cells;
+                for (auto i : grouper.Spans(grouper.Groups()[g]))
+                {
+                    REQUIRE(group[i] == ~0U);
+                    group[i] = g;
+                }
+            }
+
+            // Quadratic reference: connected components over crossing pairs.
+            eastl::vector<uint32_t> reference(scanner.RunCount());
+            for (auto i = 0U; i < reference.size(); i++)
+                reference[i] = i;
+
+            for (auto changed = true; changed; )
+            {
+                changed = false;
+                for (auto i = 0U; i < rowCount; i++)
+                {
+                    for (auto j = 0U; j < colRuns.size(); j++)
+                    {
+                        auto& a = reference[i];
+                        auto& b = reference[rowCount + j];
+                        if (a != b && MatchGrouper::Crosses(rowRuns[i], colRuns[j]))
+                        {
+                            a = b = eastl::min(a, b);
+                            changed = true;
+                        }
+                    }
+                }
+            }
+
+            BoardMask mask(colors.Rows(), colors.Cols());
+            scanner.Mark(&mask);
+
+            INFO("Seed " << seed);
+            REQUIRE(cells == mask.Count());
+
+            for (auto i = 0U; i < reference.size(); i++)
+            {
+                REQUIRE(group[i] != ~0U);
+                REQUIRE(group[i] == group[reference[i]]);
+            }
+        }
+    }
+}
+
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+
+TEST_CASE("Match groups on large boards", "[.][benchmark][matchgroups]")
+{
+    using namespace m3;
+
+    for (auto n : { 64, 512, 2048 })
+    {
+        auto colors = BitboardTest::RandomBoard(n, n, 0, false);
+        auto size = std::to_string(n) + "x" + std::to_string(n);
+
+        RunScanner scanner;
+        MatchGrouper grouper;
+        scanner.Scan(colors);
+
+        BENCHMARK("Group " + size) { return grouper.Group(scanner, colors); };
+    }
+}
+
+#endif
+
+#endif
@@ -0,0 +1,342 @@
+#pragma once
+
+#include <EASTL\vector.h>
+
+#include "m3Types.hpp"
+#include "m3Board.hpp"
+#include "m3Simd.hpp"
+
+namespace m3
+{
+    /*
+        Finds every cell in a horizontal or vertical run of 3 or more on a packed byte grid,
+        32 (AVX2) or 16 (SSE2) cells at a time. A cell C is in a run if one of the 
+        3-cell windows containing it is all equal:
+
+            L2 L1 C R1 R2        (L2 == L1 == C) | (L1 == C == R1) | (C == R1 == R2)
+
+        and the same for the two rows on either side. InvalidColor never matches.
+        Out-of-board neighbours read InvalidColor, from a guarded copy of the row and 
+        from a guard row, so the body needs no edge cases. Writes 0xFF or 0 per cell.
+    */
+    class MatchRunKernel
+    {
+    public:
+        using Colors = DynamicBoard<GemColor>;
+        using Mask = DynamicBoard<uint8_t>;
+
+        static_assert(sizeof(GemColor) == 1);
+
+    private:
+        static const int Guard = 32;
+
+        SimdLevel m_Level;
+        eastl::vector<uint8_t> m_Row;       // Guard + pitch + Guard bytes.
+        eastl::vector<uint8_t> m_GuardRow;  // Pitch bytes of InvalidColor.
+
+    public:
+        MatchRunKernel(SimdLevel level = DetectSimdLevel()) : 
+            m_Level(eastl::min(level, DetectSimdLevel()))
+        { }
+
+        inline SimdLevel Level() const { return m_Level; }
+
+        void Find(const Colors& colors, Mask* outMask)
+        {
+            FindRows(colors, outMask, 0, colors.Rows());
+        }
+
+        // Only writes rows [r0, r1) of outMask, reading up to two rows past either end. 
+        // Bands of rows can go to different threads, each with its own kernel.
+        void FindRows(const Colors& colors, Mask* outMask, Row r0, Row r1)
+        {
+            assert(outMask->Rows() == colors.Rows() && outMask->Cols() == colors.Cols());
+            assert(outMask->Pitch() == colors.Pitch());
+            assert(r0 >= 0 && r0 <= r1 && r1 <= colors.Rows());
+
+            const auto pitch = colors.Pitch();
+            const auto rows = colors.Rows().m_I;
+            const auto cols = colors.Cols().m_I;
+
+            if (m_GuardRow.size() < pitch)
+            {
+                m_Row.resize(Guard + pitch + Guard);
+                m_GuardRow.resize(pitch);
+            }
+
+            eastl::fill(m_Row.begin(), m_Row.end(), InvalidColor.m_I);
+            eastl::fill(m_GuardRow.begin(), m_GuardRow.end(), InvalidColor.m_I);
+
+            auto rowAt = [&](int r) 
+            { 
+                return (r >= 0 && r < rows) ? (const uint8_t*)colors.RowData(r) : m_GuardRow.data(); 
+            };
+
+            for (auto r = r0.m_I; r < r1.m_I; r++)
+            {
+                auto row = m_Row.data() + Guard;
+                memcpy(row, colors.RowData(r), cols);
+
+                const uint8_t* neighbours[4] = { rowAt(r - 2), rowAt(r - 1), rowAt(r + 1), rowAt(r + 2) };
+                auto out = outMask->RowData(r);
+
+                switch (m_Level)
+                {
+                #ifdef X86Available__
+                    case SimdLevel::AVX2: FindRow_AVX2(row, neighbours, out, pitch); break;
+                    case SimdLevel::SSE2: FindRow_SSE2(row, neighbours, out, pitch); break;
+                #endif
+                    default: FindRow_Scalar(row, neighbours, out, pitch); break;
+                }
+            }
+        }
+
+    private:
+        static inline bool InRun(uint8_t a2, uint8_t a1, uint8_t c, uint8_t b1, uint8_t b2)
+        {
+            return (a2 == a1 && a1 == c) || (a1 == c && c == b1) || (c == b1 && b1 == b2);
+        }
+
+        static void FindRow_Scalar(const uint8_t* row, const uint8_t* const* n, uint8_t* out, uint32_t pitch)
+        {
+            for (auto c = 0; c < (int)pitch; c++)
+            {
+                const auto v = row[c];
+                const bool run = 
+                    InRun(row[c - 2], row[c - 1], v, row[c + 1], row[c + 2]) ||
+                    InRun(n[0][c], n[1][c], v, n[2][c], n[3][c]);
+
+                out[c] = (run && v != InvalidColor.m_I) ? 0xFF : 0;
+            }
+        }
+
+    #ifdef X86Available__
+        static void FindRow_SSE2(const uint8_t* row, const uint8_t* const* n, uint8_t* out, uint32_t pitch)
+        {
+            const auto invalid = _mm_set1_epi8((char)InvalidColor.m_I);
+
+            auto inRun = [](__m128i a2, __m128i a1, __m128i c, __m128i b1, __m128i b2)
+            {
+                const auto e1 = _mm_cmpeq_epi8(a1, c);
+                const auto f1 = _mm_cmpeq_epi8(c, b1);
+                return _mm_or_si128(
+                    _mm_or_si128(_mm_and_si128(_mm_cmpeq_epi8(a2, a1), e1), _mm_and_si128(e1, f1)),
+                    _mm_and_si128(f1, _mm_cmpeq_epi8(b1, b2)));
+            };
+
+            for (auto c = 0U; c < pitch; c += 16)
+            {
+                const auto v = _mm_loadu_si128((const __m128i*)(row + c));
+
+                const auto h = inRun(
+                    _mm_loadu_si128((const __m128i*)(row + c - 2)),
+                    _mm_loadu_si128((const __m128i*)(row + c - 1)),
+                    v,
+                    _mm_loadu_si128((const __m128i*)(row + c + 1)),
+                    _mm_loadu_si128((const __m128i*)(row + c + 2)));
+
+                const auto w = inRun(
+                    _mm_loadu_si128((const __m128i*)(n[0] + c)),
+                    _mm_loadu_si128((const __m128i*)(n[1] + c)),
+                    v,
+                    _mm_loadu_si128((const __m128i*)(n[2] + c)),
+                    _mm_loadu_si128((const __m128i*)(n[3] + c)));
+
+                const auto run = _mm_andnot_si128(_mm_cmpeq_epi8(v, invalid), _mm_or_si128(h, w));
+                _mm_store_si128((__m128i*)(out + c), run);
+            }
+        }
+
+        TargetAvx2__
+        static void FindRow_AVX2(const uint8_t* row, const uint8_t* const* n, uint8_t* out, uint32_t pitch)
+        {
+            const auto invalid = _mm256_set1_epi8((char)InvalidColor.m_I);
+
+            for (auto c = 0U; c < pitch; c += 32)
+            {
+                const auto v = _mm256_loadu_si256((const __m256i*)(row + c));
+
+                const auto l2 = _mm256_loadu_si256((const __m256i*)(row + c - 2));
+                const auto l1 = _mm256_loadu_si256((const __m256i*)(row + c - 1));
+                const auto r1 = _mm256_loadu_si256((const __m256i*)(row + c + 1));
+                const auto r2 = _mm256_loadu_si256((const __m256i*)(row + c + 2));
+
+                const auto el = _mm256_cmpeq_epi8(l1, v);
+                const auto er = _mm256_cmpeq_epi8(v, r1);
+                const auto h = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_and_si256(_mm256_cmpeq_epi8(l2, l1), el), _mm256_and_si256(el, er)),
+                    _mm256_and_si256(er, _mm256_cmpeq_epi8(r1, r2)));
+
+                const auto d2 = _mm256_loadu_si256((const __m256i*)(n[0] + c));
+                const auto d1 = _mm256_loadu_si256((const __m256i*)(n[1] + c));
+                const auto u1 = _mm256_loadu_si256((const __m256i*)(n[2] + c));
+                const auto u2 = _mm256_loadu_si256((const __m256i*)(n[3] + c));
+
+                const auto ed = _mm256_cmpeq_epi8(d1, v);
+                const auto eu = _mm256_cmpeq_epi8(v, u1);
+                const auto w = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_and_si256(_mm256_cmpeq_epi8(d2, d1), ed), _mm256_and_si256(ed, eu)),
+                    _mm256_and_si256(eu, _mm256_cmpeq_epi8(u1, u2)));
+
+                const auto run = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, invalid), _mm256_or_si256(h, w));
+                _mm256_store_si256((__m256i*)(out + c), run);
+            }
+        }
+    #endif
+    };
+}
+
+#ifdef CatchAvailable__
+
+#include "m3Bitboard.hpp"
+
+TEST_CASE("Match run kernel", "[kernel][matching]")
+{
+    using namespace m3;
+    using namespace m3::BitboardTest;
+
+    const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2 };
+
+    for (auto level : levels)
+    {
+        if (level > DetectSimdLevel())
+            continue;
+
+        DYNAMIC_SECTION("Same cells as the walkers, " << ToString(level))
+        {
+            const int sizes[][2] = { { 1, 1 }, { 2, 40 }, { 3, 3 }, { 8, 8 }, { 5, 31 }, { 9, 32 }, { 17, 33 }, { 64, 64 }, { 33, 130 }, { 130, 7 } };
+
+            MatchRunKernel kernel(level);
+            REQUIRE(kernel.Level() == level);
+
+            for (auto& size : sizes)
+            {
+                for (auto seed = 0U; seed < 8; seed++)
+                {
+                    auto colors = RandomBoard(size[0], size[1], seed, (seed & 1) != 0);
+
+                    MatchRunKernel::Mask mask(size[0], size[1]);
+                    kernel.Find(colors, &mask);
+
+                    auto expected = WalkerMatches(colors);
+
+                    INFO("Board " << size[0] << "x" << size[1] << " seed " << seed);
+                    for (auto r = 0; r < size[0]; r++)
+                        for (auto c = 0; c < size[1]; c++)
+                            REQUIRE((mask(r, c) != 0) == expected.Test(r, c));
+                }
+            }
+        }
+    }
+}
+
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+
+#include <EASTL\hash_map.h>
+
+namespace m3::BoardBench
+{
+    // Colors looked up the way Match3Game used to: GemId board, then id -> index -> color.
+    struct HashedColors
+    {
+        using Type = GemColor;
+
+        DynamicBoard<GemId> m_Ids;
+        eastl::hash_map<GemId, uint32_t> m_IdToIndex;
+        eastl::vector<GemColor> m_Colors;
+
+        HashedColors(const DynamicBoard<GemColor>& colors) : 
+            m_Ids(colors.Rows(), colors.Cols())
+        {
+            for (auto r = 0; r < colors.Rows().m_I; r++)
+            {
+                for (auto c = 0; c < colors.Cols().m_I; c++)
+                {
+                    GemId id = (uint32_t)m_Colors.size() + 1;
+                    m_Ids(r, c) = id;
+                    m_IdToIndex[id] = (uint32_t)m_Colors.size();
+                    m_Colors.push_back(colors(r, c));
+                }
+            }
+        }
+
+        inline Row Rows() const { return m_Ids.Rows(); }
+        inline Col Cols() const { return m_Ids.Cols(); }
+        inline uint32_t Index(Row r, Col c) const { return m_Ids.Index(r, c); }
+
+        inline GemColor operator() (Row r, Col c) const
+        {
+            auto id = m_Ids(r, c);
+            if (id == InvalidGemId)
+                return InvalidColor;
+
+            return m_Colors[m_IdToIndex.at(id)];
+        }
+    };
+}
+
+TEST_CASE("Hashed vs dense color board", "[.][benchmark][kernel]")
+{
+    using namespace m3;
+    using namespace m3::BitboardTest;
+
+    for (auto n : { 64, 256, 1024 })
+    {
+        auto colors = RandomBoard(n, n, 0, false);
+        auto hashed = BoardBench::HashedColors(colors);
+        auto size = std::to_string(n) + "x" + std::to_string(n);
+
+        eastl::vector<uint8_t> cleared(colors.Size());
+        MatchRunKernel kernel;
+        MatchRunKernel::Mask mask(n, n);
+
+        BENCHMARK("Hashed walkers " + size) { return BoardBench::WholeBoardScan(hashed, cleared); };
+        BENCHMARK("Dense walkers " + size) { return BoardBench::WholeBoardScan(colors, cleared); };
+        BENCHMARK("Dense kernel " + size) 
+        { 
+            kernel.Find(colors, &mask);
+            return mask(0, 0);
+        };
+    }
+}
+
+TEST_CASE("Match run kernel vs bitboards", "[.][benchmark][kernel]")
+{
+    using namespace m3;
+    using namespace m3::BitboardTest;
+
+    for (auto n : { 512, 2048, 4096 })
+    {
+        auto colors = RandomBoard(n, n, 0, false);
+        auto size = std::to_string(n) + "x" + std::to_string(n);
+
+        ColorBitboards bitboards(n, n);
+        BoardMask bits(n, n);
+        bitboards.Build(colors);
+
+        BENCHMARK("Bitboards " + size + " (find)") 
+        { 
+            bitboards.FindMatches(&bits);
+            return bits.WordsPerRow();
+        };
+
+        MatchRunKernel::Mask mask(n, n);
+
+        for (auto level : { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2 })
+        {
+            if (level > DetectSimdLevel())
+                continue;
+
+            MatchRunKernel kernel(level);
+            BENCHMARK(std::string("Kernel ") + ToString(level) + " " + size) 
+            { 
+                kernel.Find(colors, &mask);
+                return mask(0, 0);
+            };
+        }
+    }
+}
+
+#endif
+
+#endif
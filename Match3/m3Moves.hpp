@@ -0,0 +1,405 @@
+#pragma once
+
+#include <EASTL\vector.h>
+
+#include "m3Types.hpp"
+#include "m3Bits.hpp"
+#include "m3Bitboard.hpp"
+
+namespace m3
+{
+    struct Swap
+    {
+        Row m_R0;
+        Col m_C0;
+        Row m_R1;
+        Col m_C1;
+
+        inline bool IsAdjacent() const
+        {
+            auto dr = m_R1.m_I - m_R0.m_I;
+            auto dc = m_C1.m_I - m_C0.m_I;
+            return (dr * dr + dc * dc) == 1;
+        }
+    };
+
+    /*
+        Finds every adjacent swap that makes a run of 3, on per-color bit planes.
+
+        Say color X moves into cell t from its neighbour s. t must hold another color, 
+        and t is in a run afterwards if one of the pairs around it is X, not counting 
+        the pairs that use s, which now holds t's old color:
+
+                      U2                   H2L = L2 & L1    V2D = D2 & D1
+                      U1                   H2R = R1 & R2    V2U = U1 & U2
+            L2   L1   t   R1   R2          HM  = L1 & R1    VM  = D1 & U1
+                      D1
+                      D2                   From R1: H2L | V2D | V2U | VM, and so on.
+
+        Each of those is a whole row word of cells at once, shifted along the row or 
+        taken from the rows around it. A horizontal swap is kept as a bit at its left 
+        cell, a vertical one at its lower cell.
+    */
+    class MoveFinder
+    {
+    public:
+        using Word = BoardMask::Word;
+        static const int WordBits = BoardMask::WordBits;
+
+    private:
+        ColorBitboards m_Planes;
+        BoardMask m_Horizontal;
+        BoardMask m_Vertical;
+        eastl::vector<Word> m_Zero;      // A row of nothing, above and below the board.
+        eastl::vector<Word> m_Occupied;  // Scratch, one row.
+        eastl::vector<Word> m_FromLeft;  // Scratch, one row, bits at the right cell of the swap.
+
+    public:
+        template <class Values>
+        uint32_t FindAll(const Values& values, eastl::vector<Swap>* outMoves)
+        {
+            Build(values);
+
+            for (auto r = 0; r < m_Planes.Rows().m_I; r++)
+                FindInRow(r, false);
+
+            outMoves->clear();
+
+            for (auto r = 0; r < m_Planes.Rows().m_I; r++)
+            {
+                auto h = m_Horizontal.RowWords(r);
+                auto v = m_Vertical.RowWords(r);
+
+                // Row-major, a row's horizontal swaps before its vertical ones.
+                for (auto w = 0U; w < m_Planes.WordsPerRow(); w++)
+                {
+                    ForEachSetBit(h[w], [&](uint32_t bit) 
+                    { 
+                        auto c = (int)(w * WordBits + bit);
+                        outMoves->push_back({ r, c, r, c + 1 }); 
+                    });
+                }
+
+                for (auto w = 0U; w < m_Planes.WordsPerRow(); w++)
+                {
+                    ForEachSetBit(v[w], [&](uint32_t bit) 
+                    { 
+                        auto c = (int)(w * WordBits + bit);
+                        outMoves->push_back({ r, c, r + 1, c }); 
+                    });
+                }
+            }
+
+            return (uint32_t)outMoves->size();
+        }
+
+        // Stops at the first row with a move in it. Planes are built as the scan gets to
+        // them, row r needs rows up to r + 2.
+        template <class Values>
+        bool HasAny(const Values& values)
+        {
+            Resize(values);
+
+            const auto rows = (int)m_Planes.Rows().m_I;
+            for (auto r = 0; r < eastl::min(2, rows); r++)
+                m_Planes.BuildRow(values, r);
+
+            for (auto r = 0; r < rows; r++)
+            {
+                if (r + 2 < rows)
+                    m_Planes.BuildRow(values, r + 2);
+
+                if (FindInRow(r, true))
+                    return true;
+            }
+
+            return false;
+        }
+
+        // Swaps found by the last FindAll, as bits at the left (horizontal) or lower (vertical) cell.
+        inline const BoardMask& Horizontal() const { return m_Horizontal; }
+        inline const BoardMask& Vertical() const { return m_Vertical; }
+
+    private:
+        template <class Values>
+        void Build(const Values& values)
+        {
+            Resize(values);
+            m_Planes.Build(values);
+        }
+
+        template <class Values>
+        void Resize(const Values& values)
+        {
+            if (m_Planes.Rows() != values.Rows() || m_Planes.Cols() != values.Cols())
+            {
+                m_Planes.Resize(values.Rows(), values.Cols());
+                m_Horizontal.Resize(values.Rows(), values.Cols());
+                m_Vertical.Resize(values.Rows(), values.Cols());
+                m_Zero.assign(m_Planes.WordsPerRow(), 0ULL);
+                m_Occupied.resize(m_Planes.WordsPerRow());
+                m_FromLeft.resize(m_Planes.WordsPerRow());
+            }
+            else
+            {
+                m_Horizontal.Clear();
+                m_Vertical.Clear();
+            }
+        }
+
+        inline const Word* PlaneRow(int ci, int r) const
+        {
+            return (r >= 0 && r < m_Planes.Rows().m_I) ? m_Planes.RowWords(ci, r) : m_Zero.data();
+        }
+
+        // Bit c of the result is bit (c - k) of the row, ie. the cell k to the left.
+        static inline Word CellsLeft(const Word* bits, uint32_t w, int k)
+        {
+            return (bits[w] << k) | (w > 0 ? bits[w - 1] >> (WordBits - k) : 0ULL);
+        }
+
+        // Bit c of the result is bit (c + k) of the row, ie. the cell k to the right.
+        static inline Word CellsRight(const Word* bits, uint32_t w, uint32_t words, int k)
+        {
+            return (bits[w] >> k) | (w + 1 < words ? bits[w + 1] << (WordBits - k) : 0ULL);
+        }
+
+        // Moves into row r: horizontal ones go to row r, vertical ones to rows r and r - 1.
+        // With earlyOut, returns as soon as any is found.
+        bool FindInRow(int r, bool earlyOut)
+        {
+            const auto words = m_Planes.WordsPerRow();
+            auto occupied = m_Occupied.data();
+            auto fromLeft = m_FromLeft.data();
+            auto horizontal = m_Horizontal.RowWords(r);
+            auto vertical = m_Vertical.RowWords(r);
+            auto verticalBelow = r > 0 ? m_Vertical.RowWords(r - 1) : nullptr;
+            auto found = 0ULL;
+
+            for (auto w = 0U; w < words; w++)
+            {
+                occupied[w] = 0;
+                fromLeft[w] = 0;
+            }
+
+            for (auto ci = 0; ci < NumGemColors; ci++)
+            {
+                auto x = PlaneRow(ci, r);
+                for (auto w = 0U; w < words; w++)
+                    occupied[w] |= x[w];
+            }
+
+            for (auto ci = 0; ci < NumGemColors; ci++)
+            {
+                auto x = PlaneRow(ci, r);
+                auto d1 = PlaneRow(ci, r - 1);
+                auto d2 = PlaneRow(ci, r - 2);
+                auto u1 = PlaneRow(ci, r + 1);
+                auto u2 = PlaneRow(ci, r + 2);
+
+                for (auto w = 0U; w < words; w++)
+                {
+                    const auto l1 = CellsLeft(x, w, 1);
+                    const auto l2 = CellsLeft(x, w, 2);
+                    const auto r1 = CellsRight(x, w, words, 1);
+                    const auto r2 = CellsRight(x, w, words, 2);
+
+                    const auto h2l = l1 & l2;
+                    const auto h2r = r1 & r2;
+                    const auto hm = l1 & r1;
+                    const auto v2d = d1[w] & d2[w];
+                    const auto v2u = u1[w] & u2[w];
+                    const auto vm = d1[w] & u1[w];
+
+                    const auto target = occupied[w] & ~x[w];
+
+                    const auto fromRight = target & r1 & (h2l | v2d | v2u | vm);
+                    const auto fromLeft_ = target & l1 & (h2r | v2d | v2u | vm);
+                    const auto fromAbove = target & u1[w] & (v2d | h2l | h2r | hm);
+                    const auto fromBelow = target & d1[w] & (v2u | h2l | h2r | hm);
+
+                    horizontal[w] |= fromRight;
+                    fromLeft[w] |= fromLeft_;
+                    vertical[w] |= fromAbove;
+                    if (verticalBelow)
+                        verticalBelow[w] |= fromBelow;
+
+                    found |= fromRight | fromLeft_ | fromAbove | fromBelow;
+                }
+
+                if (earlyOut && found != 0)
+                    return true;
+            }
+
+            // A gem coming in from the left is the swap at the cell to the left.
+            for (auto w = 0U; w < words; w++)
+                horizontal[w] |= CellsRight(fromLeft, w, words, 1);
+
+            return found != 0;
+        }
+    };
+
+    // Allocates a MoveFinder every call, keep one around to scan every frame.
+    template <class Values>
+    eastl::vector<Swap> FindAllValidMoves(const Values& values)
+    {
+        MoveFinder finder;
+        eastl::vector<Swap> moves;
+        finder.FindAll(values, &moves);
+        return moves;
+    }
+
+    template <class Values>
+    bool HasAnyValidMove(const Values& values)
+    {
+        MoveFinder finder;
+        return finder.HasAny(values);
+    }
+}
+
+#ifdef CatchAvailable__
+
+#include "m3Match.hpp"
+
+namespace m3::MovesTest
+{
+    using Colors = DynamicBoard<GemColor>;
+
+    inline bool IsInRun(const Colors& colors, Row r, Col c)
+    {
+        auto color = colors(r, c);
+        auto rs = RowSpan { r, GetMatchingColsInRow_L(r, c, color, colors), GetMatchingColsInRow_R(r, c, color, colors, colors.Cols() - 1) };
+        auto cs = ColSpan { c, GetMatchingRowsInCol_D(r, c, color, colors), GetMatchingRowsInCol_U(r, c, color, colors, colors.Rows() - 1) };
+        return rs.Count() >= 3 || cs.Count() >= 3;
+    }
+
+    // Tries every swap on a copy, in the order MoveFinder lists them.
+    inline eastl::vector<Swap> BruteForceMoves(Colors colors)
+    {
+        eastl::vector<Swap> moves;
+
+        auto tryMove = [&](Swap s)
+        {
+            auto& a = colors(s.m_R0, s.m_C0);
+            auto& b = colors(s.m_R1, s.m_C1);
+            if (a == b || a == InvalidColor || b == InvalidColor)
+                return;
+
+            eastl::swap(a, b);
+            if (IsInRun(colors, s.m_R0, s.m_C0) || IsInRun(colors, s.m_R1, s.m_C1))
+                moves.push_back(s);
+            eastl::swap(a, b);
+        };
+
+        for (auto r = 0; r < colors.Rows().m_I; r++)
+        {
+            for (auto c = 0; c + 1 < colors.Cols().m_I; c++)
+                tryMove({ r, c, r, c + 1 });
+
+            if (r + 1 < colors.Rows().m_I)
+                for (auto c = 0; c < colors.Cols().m_I; c++)
+                    tryMove({ r, c, r + 1, c });
+        }
+
+        return moves;
+    }
+}
+
+TEST_CASE("Valid moves", "[moves]")
+{
+    using namespace m3;
+    using namespace m3::BitboardTest;
+    using namespace m3::MovesTest;
+
+    SECTION("Same moves as trying every swap")
+    {
+        const int sizes[][2] = { { 1, 1 }, { 1, 5 }, { 5, 1 }, { 3, 3 }, { 8, 8 }, { 9, 63 }, { 7, 64 }, { 6, 65 }, { 20, 130 }, { 70, 9 } };
+
+        MoveFinder finder;
+        eastl::vector<Swap> moves;
+
+        for (auto& size : sizes)
+        {
+            for (auto seed = 0U; seed < 8; seed++)
+            {
+                INFO("Board " << size[0] << "x" << size[1] << " seed " << seed);
+
+                auto colors = RandomBoard(size[0], size[1], seed, (seed & 1) != 0);
+                auto expected = BruteForceMoves(colors);
+
+                REQUIRE(finder.FindAll(colors, &moves) == expected.size());
+                for (auto i = 0U; i < moves.size(); i++)
+                {
+                    REQUIRE(moves[i].m_R0 == expected[i].m_R0);
+                    REQUIRE(moves[i].m_C0 == expected[i].m_C0);
+                    REQUIRE(moves[i].m_R1 == expected[i].m_R1);
+                    REQUIRE(moves[i].m_C1 == expected[i].m_C1);
+                }
+
+                REQUIRE(finder.HasAny(colors) == !expected.empty());
+                REQUIRE(CountValidMoves(colors) == (int)expected.size());
+            }
+        }
+    }
+
+    SECTION("Dead board")
+    {
+        // Diagonal stripes, row 0 first. No swap lines anything up.
+        DynamicBoard<GemColor> colors(4, 6,
+            "BROGYB"
+            "OGYBRO"
+            "YBROGY"
+            "ROGYBR", 24);
+
+        REQUIRE(BruteForceMoves(colors).empty());
+        REQUIRE(!HasAnyValidMove(colors));
+        REQUIRE(FindAllValidMoves(colors).empty());
+
+        // Now swapping (0, 0) and (0, 1) makes BBB down column 1.
+        colors(1, 1) = Blue;
+        auto moves = FindAllValidMoves(colors);
+        REQUIRE(HasAnyValidMove(colors));
+        REQUIRE(moves.size() == 1);
+        REQUIRE((moves[0].m_R0 == 0 && moves[0].m_C0 == 0 && moves[0].m_R1 == 0 && moves[0].m_C1 == 1));
+
+        // Back to the stripes, then swapping (0, 3) and (1, 3) makes GGG along row 1.
+        colors(1, 1) = Green;
+        colors(1, 2) = Green;
+        moves = FindAllValidMoves(colors);
+        REQUIRE(moves.size() == 1);
+        REQUIRE((moves[0].m_R0 == 0 && moves[0].m_C0 == 3 && moves[0].m_R1 == 1 && moves[0].m_C1 == 3));
+    }
+}
+
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+
+TEST_CASE("Bitboard vs per swap move finding", "[.][benchmark][moves]")
+{
+    using namespace m3;
+    using namespace m3::BitboardTest;
+
+    const auto n = 1024;
+    auto colors = RandomBoard(n, n, 0, false);
+
+    MoveFinder finder;
+    eastl::vector<Swap> moves;
+
+    BENCHMARK("CountValidMoves (GetMatchesForSwap) 1024x1024")
+    {
+        return CountValidMoves(colors);
+    };
+
+    BENCHMARK("MoveFinder::FindAll 1024x1024")
+    {
+        return finder.FindAll(colors, &moves);
+    };
+
+    BENCHMARK("MoveFinder::HasAny 1024x1024")
+    {
+        return finder.HasAny(colors);
+    };
+}
+
+#endif
+
+#endif
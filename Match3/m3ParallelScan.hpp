@@ -0,0 +1,128 @@
+#pragma once
+
+#include <EASTL\vector.h>
+
+#include "m3Board.hpp"
+#include "m3MatchKernel.hpp"
+#include "m3ThreadPool.hpp"
+
+namespace m3
+{
+    /*
+        Whole board match scan split into bands of rows, one band per task. A band writes 
+        only its own rows of the mask and reads two rows past either end, so bands overlap
+        by two rows of input and never in output. There is nothing to merge or lock, and 
+        the mask is byte for byte the one MatchRunKernel::Find gives.
+    */
+    class ParallelMatchScan
+    {
+    public:
+        using Colors = MatchRunKernel::Colors;
+        using Mask = MatchRunKernel::Mask;
+
+        // Small enough to balance, big enough that a task is worth handing out.
+        static const int MinBandRows = 32;
+
+    private:
+        ThreadPool* m_Pool;
+        eastl::vector<MatchRunKernel> m_Kernels; // One per worker, for their scratch rows.
+
+    public:
+        explicit ParallelMatchScan(ThreadPool* pool, SimdLevel level = DetectSimdLevel()) :
+            m_Pool(pool),
+            m_Kernels(pool->WorkerCount(), MatchRunKernel(level))
+        { }
+
+        inline uint32_t BandRows(Row rows) const
+        {
+            // About 4 bands per worker.
+            auto bandRows = (rows.m_I + 4 * (int)m_Pool->WorkerCount() - 1) / (4 * (int)m_Pool->WorkerCount());
+            return (uint32_t)eastl::max(bandRows, MinBandRows);
+        }
+
+        void Find(const Colors& colors, Mask* outMask)
+        {
+            const auto rows = (int)colors.Rows().m_I;
+            const auto bandRows = (int)BandRows(rows);
+            const auto bands = (uint32_t)((rows + bandRows - 1) / bandRows);
+
+            m_Pool->ParallelFor(bands, [&](uint32_t band, uint32_t worker)
+            {
+                auto r0 = (int)band * bandRows;
+                auto r1 = eastl::min(r0 + bandRows, rows);
+                m_Kernels[worker].FindRows(colors, outMask, r0, r1);
+            });
+        }
+    };
+}
+
+#ifdef CatchAvailable__
+
+#include "m3Bitboard.hpp"
+
+TEST_CASE("Parallel match scan", "[threads][kernel][matching]")
+{
+    using namespace m3;
+    using namespace m3::BitboardTest;
+
+    const int sizes[][2] = { { 1, 1 }, { 3, 70 }, { 33, 33 }, { 65, 8 }, { 200, 130 }, { 1000, 17 } };
+
+    for (auto threads : { 0U, 3U, 7U })
+    {
+        DYNAMIC_SECTION("Same mask as the serial scan, " << threads << " threads")
+        {
+            ThreadPool pool(threads);
+            ParallelMatchScan parallel(&pool);
+            MatchRunKernel serial;
+
+            for (auto& size : sizes)
+            {
+                for (auto seed = 0U; seed < 4; seed++)
+                {
+                    INFO("Board " << size[0] << "x" << size[1] << " seed " << seed);
+
+                    auto colors = RandomBoard(size[0], size[1], seed, (seed & 1) != 0);
+
+                    MatchRunKernel::Mask expected(size[0], size[1]);
+                    MatchRunKernel::Mask mask(size[0], size[1]);
+                    serial.Find(colors, &expected);
+                    parallel.Find(colors, &mask);
+
+                    REQUIRE(memcmp(mask.Data(), expected.Data(), expected.SizeInBytes()) == 0);
+                }
+            }
+        }
+    }
+}
+
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+
+TEST_CASE("Parallel vs serial whole board scan", "[.][benchmark][threads]")
+{
+    using namespace m3;
+    using namespace m3::BitboardTest;
+
+    const auto n = 4096;
+    auto colors = RandomBoard(n, n, 0, false);
+    MatchRunKernel::Mask mask(n, n);
+
+    MatchRunKernel serial;
+    ThreadPool pool;
+    ParallelMatchScan parallel(&pool);
+
+    BENCHMARK("Serial kernel 4096x4096")
+    {
+        serial.Find(colors, &mask);
+        return mask(0, 0);
+    };
+
+    BENCHMARK("Parallel kernel 4096x4096, all cores")
+    {
+        parallel.Find(colors, &mask);
+        return mask(0, 0);
+    };
+}
+
+#endif
+
+#endif
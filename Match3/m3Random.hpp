@@ -0,0 +1,377 @@
+#pragma once
+
+#include <EASTL\algorithm.h>
+#include <EASTL\span.h>
+
+#include "m3Types.hpp"
+#include "m3Simd.hpp"
+#include "m3Serialize.hpp"
+
+namespace m3
+{
+    /*
+        xoshiro128** in 4 interleaved lanes. Each step advances every lane once and gives 
+        4 draws, lane 0 first, so SSE2 steps all lanes in one go and the scalar path just 
+        loops over them. Both give the same sequence, and only integer shifts, adds and xors 
+        are involved, so a seed gives bit-identical output on every platform. 
+
+        State is 64 bytes, lanes are seeded with splitmix64. Satisfies the standard's 
+        UniformRandomBitGenerator, but prefer Fill and FillColors for batches.
+    */
+    class Random
+    {
+    public:
+        using result_type = uint32_t;
+
+        static const uint32_t Lanes = 4;
+
+        static constexpr result_type min() { return 0; }
+        static constexpr result_type max() { return 0xFFFFFFFF; }
+
+    private:
+        alignas(16) uint32_t m_State[4][Lanes]; // [word][lane]
+        alignas(16) uint32_t m_Draws[Lanes];
+        uint32_t m_Next = Lanes;
+        SimdLevel m_Level;
+
+    public:
+        explicit Random(uint64_t seed = 0, SimdLevel level = DetectSimdLevel()) :
+            m_Level(level > SimdLevel::SSE2 ? SimdLevel::SSE2 : level)
+        {
+            Seed(seed);
+        }
+
+        void Seed(uint64_t seed)
+        {
+            for (auto lane = 0U; lane < Lanes; lane++)
+            {
+                auto a = SplitMix64(seed);
+                auto b = SplitMix64(seed);
+
+                m_State[0][lane] = (uint32_t)a;
+                m_State[1][lane] = (uint32_t)(a >> 32);
+                m_State[2][lane] = (uint32_t)b;
+                m_State[3][lane] = (uint32_t)(b >> 32);
+            }
+
+            m_Next = Lanes;
+        }
+
+        // AVX2 has nothing to add with 4 lanes, it runs the SSE2 path.
+        inline SimdLevel Level() const { return m_Level; }
+
+        inline result_type operator()()
+        {
+            if (m_Next == Lanes)
+            {
+                Step(m_Draws);
+                m_Next = 0;
+            }
+
+            return m_Draws[m_Next++];
+        }
+
+        // Same draws as calling operator() out.size() times.
+        void Fill(eastl::span<uint32_t> out)
+        {
+            auto dst = out.data();
+            auto count = (uint32_t)out.size();
+
+            while (count > 0 && m_Next < Lanes)
+            {
+                *dst++ = m_Draws[m_Next++];
+                count--;
+            }
+
+            for (; count >= Lanes; count -= Lanes, dst += Lanes)
+                Step(dst);
+
+            for (; count > 0; count--)
+                *dst++ = (*this)();
+        }
+
+        // Uniform valid colors, two per draw: the low 16 bits pick the first, the high 16 bits
+        // the next one. A 16-bit half h picks GemColors[1 + ((h * NumGemColors) >> 16)].
+        // An odd count drops the last half.
+        void FillColors(eastl::span<GemColor> out)
+        {
+            static_assert(sizeof(GemColor) == 1);
+
+            const uint32_t Batch = 64;
+            alignas(16) uint32_t draws[Batch];
+
+            auto dst = (uint8_t*)out.data();
+            auto count = (uint32_t)out.size();
+
+            while (count > 0)
+            {
+                auto n = eastl::min(count, 2 * Batch);
+                auto drawCount = (n + 1) / 2;
+                Fill({ draws, drawCount });
+
+                auto i = 0U;
+            #ifdef X86Available__
+                if (m_Level >= SimdLevel::SSE2)
+                {
+                    for (; i + 16 <= n; i += 16)
+                        DrawsToColors_SSE2(draws + i / 2, dst + i);
+                }
+            #endif
+                for (; i < n; i++)
+                {
+                    auto half = (draws[i / 2] >> (16 * (i & 1))) & 0xFFFF;
+                    dst[i] = GemColors[1 + ((half * NumGemColors) >> 16)].m_I;
+                }
+
+                dst += n;
+                count -= n;
+            }
+        }
+
+        inline GemColor NextColor()
+        {
+            return GemColors[1 + ((((*this)() & 0xFFFF) * NumGemColors) >> 16)];
+        }
+
+        // Buffered draws included, the SIMD level is not: it doesn't change the output.
+        void Save(BinaryWriter& writer) const
+        {
+            writer.Write(m_State);
+            writer.Write(m_Draws);
+            writer.Write(m_Next);
+        }
+
+        bool Load(BinaryReader& reader)
+        {
+            reader.ReadBytes(m_State, sizeof(m_State));
+            reader.ReadBytes(m_Draws, sizeof(m_Draws));
+            m_Next = eastl::min(reader.Read<uint32_t>(), Lanes);
+            return reader.Ok();
+        }
+
+    private:
+        static inline uint64_t SplitMix64(uint64_t& x)
+        {
+            auto z = (x += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+        }
+
+        static inline uint32_t Rotl(uint32_t x, int k)
+        {
+            return (x << k) | (x >> (32 - k));
+        }
+
+        inline void Step(uint32_t* out)
+        {
+        #ifdef X86Available__
+            if (m_Level >= SimdLevel::SSE2)
+            {
+                Step_SSE2(out);
+                return;
+            }
+        #endif
+            Step_Scalar(out);
+        }
+
+        void Step_Scalar(uint32_t* out)
+        {
+            auto& s = m_State;
+
+            for (auto lane = 0U; lane < Lanes; lane++)
+            {
+                out[lane] = Rotl(s[1][lane] * 5, 7) * 9;
+
+                auto t = s[1][lane] << 9;
+
+                s[2][lane] ^= s[0][lane];
+                s[3][lane] ^= s[1][lane];
+                s[1][lane] ^= s[2][lane];
+                s[0][lane] ^= s[3][lane];
+                s[2][lane] ^= t;
+                s[3][lane] = Rotl(s[3][lane], 11);
+            }
+        }
+
+    #ifdef X86Available__
+        // x * 5 and x * 9 as shift and add, SSE2 has no 32-bit multiply.
+        void Step_SSE2(uint32_t* out)
+        {
+            auto s0 = _mm_load_si128((const __m128i*)m_State[0]);
+            auto s1 = _mm_load_si128((const __m128i*)m_State[1]);
+            auto s2 = _mm_load_si128((const __m128i*)m_State[2]);
+            auto s3 = _mm_load_si128((const __m128i*)m_State[3]);
+
+            auto x5 = _mm_add_epi32(_mm_slli_epi32(s1, 2), s1);
+            auto r7 = _mm_or_si128(_mm_slli_epi32(x5, 7), _mm_srli_epi32(x5, 25));
+            auto x9 = _mm_add_epi32(_mm_slli_epi32(r7, 3), r7);
+            _mm_storeu_si128((__m128i*)out, x9);
+
+            auto t = _mm_slli_epi32(s1, 9);
+
+            s2 = _mm_xor_si128(s2, s0);
+            s3 = _mm_xor_si128(s3, s1);
+            s1 = _mm_xor_si128(s1, s2);
+            s0 = _mm_xor_si128(s0, s3);
+            s2 = _mm_xor_si128(s2, t);
+            s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+
+            _mm_store_si128((__m128i*)m_State[0], s0);
+            _mm_store_si128((__m128i*)m_State[1], s1);
+            _mm_store_si128((__m128i*)m_State[2], s2);
+            _mm_store_si128((__m128i*)m_State[3], s3);
+        }
+
+        // 8 draws to 16 colors. In memory the 16-bit halves are already in color order.
+        static void DrawsToColors_SSE2(const uint32_t* draws, uint8_t* out)
+        {
+            const auto n = _mm_set1_epi16(NumGemColors);
+
+            auto i0 = _mm_mulhi_epu16(_mm_loadu_si128((const __m128i*)draws), n);
+            auto i1 = _mm_mulhi_epu16(_mm_loadu_si128((const __m128i*)(draws + 4)), n);
+
+            auto c0 = _mm_setzero_si128();
+            auto c1 = _mm_setzero_si128();
+
+            for (auto i = 0; i < NumGemColors; i++)
+            {
+                const auto index = _mm_set1_epi16((short)i);
+                const auto color = _mm_set1_epi16(GemColors[i + 1].m_I);
+
+                c0 = _mm_or_si128(c0, _mm_and_si128(_mm_cmpeq_epi16(i0, index), color));
+                c1 = _mm_or_si128(c1, _mm_and_si128(_mm_cmpeq_epi16(i1, index), color));
+            }
+
+            _mm_storeu_si128((__m128i*)out, _mm_packus_epi16(c0, c1));
+        }
+    #endif
+    };
+}
+
+#ifdef CatchAvailable__
+
+#include <EASTL\vector.h>
+
+TEST_CASE("Random", "[random]")
+{
+    using namespace m3;
+
+    const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE2 };
+
+    for (auto level : levels)
+    {
+        if (level > DetectSimdLevel())
+            continue;
+
+        DYNAMIC_SECTION("Known draws, " << ToString(level))
+        {
+            // From a reference implementation of splitmix64 seeding and xoshiro128**.
+            const uint32_t expected[] = 
+            { 
+                0x89F4BEFD, 0x90B608AC, 0xA14A5864, 0x7A0CD4BE, 
+                0x94E95A78, 0xEC96EB0D, 0x2F2635F2, 0x163412DD, 
+                0x7A8293BC, 0xD9E2B7F7, 0x60D0109C, 0x82CAC6D4 
+            };
+
+            Random random(12345, level);
+            for (auto value : expected)
+                REQUIRE(random() == value);
+        }
+
+        DYNAMIC_SECTION("Known colors, " << ToString(level))
+        {
+            const char expected[] = "OORROBBOBRYORBYO";
+
+            Random random(7, level);
+            GemColor colors[16];
+            random.FillColors(colors);
+
+            for (auto i = 0; i < 16; i++)
+                REQUIRE(colors[i] == GemColor(expected[i]));
+        }
+
+        DYNAMIC_SECTION("Batches match single draws, " << ToString(level))
+        {
+            const uint32_t counts[] = { 0, 1, 3, 4, 5, 17, 64, 129, 1000 };
+
+            Random single(99, SimdLevel::Scalar), batch(99, level);
+
+            for (auto count : counts)
+            {
+                eastl::vector<uint32_t> draws(count);
+                batch.Fill(draws);
+
+                for (auto draw : draws)
+                    REQUIRE(draw == single());
+            }
+
+            for (auto count : counts)
+            {
+                eastl::vector<GemColor> colors(count);
+                batch.FillColors(colors);
+
+                for (auto i = 0U; i < count; i += 2)
+                {
+                    auto draw = single();
+                    REQUIRE(colors[i] == GemColors[1 + (((draw & 0xFFFF) * NumGemColors) >> 16)]);
+                    if (i + 1 < count)
+                        REQUIRE(colors[i + 1] == GemColors[1 + (((draw >> 16) * NumGemColors) >> 16)]);
+                }
+            }
+        }
+    }
+
+    SECTION("Every color comes up about as often")
+    {
+        eastl::vector<GemColor> colors(100000);
+        Random random(3);
+        random.FillColors(colors);
+
+        int counts[NumGemColors] = {};
+        for (auto color : colors)
+        {
+            auto index = GemColorIndex(color);
+            REQUIRE(index >= 0);
+            counts[index]++;
+        }
+
+        for (auto count : counts)
+        {
+            REQUIRE(count > 100000 / NumGemColors - 1000);
+            REQUIRE(count < 100000 / NumGemColors + 1000);
+        }
+    }
+}
+
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+
+#include <random>
+
+TEST_CASE("Random vs mt19937", "[.][benchmark][random]")
+{
+    using namespace m3;
+
+    eastl::vector<GemColor> colors(1 << 16);
+
+    std::mt19937 mt(0);
+    std::uniform_int_distribution<uint16_t> distribution(1, NumGemColors);
+    Random random(0);
+
+    BENCHMARK("mt19937 + uniform_int_distribution, 64K colors")
+    {
+        for (auto& color : colors)
+            color = GemColors[distribution(mt)];
+        return colors[0];
+    };
+
+    BENCHMARK("Random::FillColors, 64K colors")
+    {
+        random.FillColors(colors);
+        return colors[0];
+    };
+}
+
+#endif
+
+#endif
@@ -0,0 +1,315 @@
+#pragma once
+
+#include <EASTL\vector.h>
+
+#include "m3Types.hpp"
+#include "m3Span.hpp"
+#include "m3Bitboard.hpp"
+
+namespace m3
+{
+    /*
+        Finds every maximal run of at least N same-colored cells in one pass over the
+        board. Rows are walked once, bottom up; columns are tracked alongside, one open
+        run per column, closed when a cell differs from the one below. Each cell is
+        compared with its left and lower neighbors only, so a run is found once, not
+        once per cell in it.
+
+        Runs go to two flat arenas that keep their capacity, so after the first call on
+        a board size nothing is allocated. Order is fixed:
+            row runs    by row, bottom up, then left to right,
+            column runs by the row above their top cell, bottom up, then left to right.
+        Invalid colors never form runs.
+    */
+    class RunScanner
+    {
+    private:
+        eastl::vector<RowSpan> m_RowRuns;
+        eastl::vector<ColSpan> m_ColRuns;
+        eastl::vector<Row> m_ColStart; // Per column, bottom row of the open run.
+        eastl::vector<GemColor> m_Rows; // Two rows, for layouts whose rows are not contiguous.
+
+    public:
+        inline const eastl::vector<RowSpan>& RowRuns() const { return m_RowRuns; }
+        inline const eastl::vector<ColSpan>& ColRuns() const { return m_ColRuns; }
+        inline uint32_t RunCount() const { return (uint32_t)(m_RowRuns.size() + m_ColRuns.size()); }
+
+        // values(r, c) returns the GemColor of a cell. Returns the number of runs.
+        template <class Values>
+        uint32_t Scan(const Values& values, int minRun = 3)
+        {
+            assert(minRun >= 1);
+
+            const auto rows = values.Rows().m_I;
+            const auto cols = values.Cols().m_I;
+
+            m_RowRuns.clear();
+            m_ColRuns.clear();
+            m_ColStart.assign(cols, Row(0));
+
+            if (rows == 0 || cols == 0)
+                return 0;
+
+            const GemColor* below = nullptr;
+
+            for (auto r = 0; r < rows; r++)
+            {
+                const GemColor* row;
+
+                if constexpr (Values::LayoutType::RowsAreContiguous)
+                {
+                    row = values.RowData(r);
+                }
+                else
+                {
+                    m_Rows.resize(2 * (size_t)cols);
+                    auto scratch = m_Rows.data() + (size_t)(r & 1) * cols;
+                    for (auto c = 0; c < cols; c++)
+                        scratch[c] = values(r, c);
+
+                    row = scratch;
+                }
+
+                ScanRow(row, below, r, cols, minRun);
+                below = row;
+            }
+
+            for (auto c = 0; c < cols; c++)
+                CloseColRun(c, rows, below[c], minRun);
+
+            return RunCount();
+        }
+
+        // Every cell in a run, ie. what to clear.
+        void Mark(BoardMask* outMask) const
+        {
+            outMask->Clear();
+
+            for (auto& run : m_RowRuns)
+                outMask->SetRange(run.Row(), run.Col_0(), run.Col_1());
+
+            for (auto& run : m_ColRuns)
+            {
+                for (auto r = run.Row_0(); r <= run.Row_1(); r = r + 1)
+                    outMask->Set(r, run.Col());
+            }
+        }
+
+    private:
+        // Row runs of one row, and closes the column runs that stop below it.
+        void ScanRow(const GemColor* row, const GemColor* below, int r, int cols, int minRun)
+        {
+            auto start = 0;
+
+            for (auto c = 1; c < cols; c++)
+            {
+                if (row[c] != row[c - 1])
+                {
+                    if (c - start >= minRun && row[start] != InvalidColor)
+                        m_RowRuns.push_back({ r, start, c - 1 });
+
+                    start = c;
+                }
+            }
+
+            if (cols - start >= minRun && row[start] != InvalidColor)
+                m_RowRuns.push_back({ r, start, cols - 1 });
+
+            if (below == nullptr)
+                return;
+
+            for (auto c = 0; c < cols; c++)
+            {
+                if (row[c] != below[c])
+                {
+                    CloseColRun(c, r, below[c], minRun);
+                    m_ColStart[c] = r;
+                }
+            }
+        }
+
+        // The open run of column c, of the given color, ends below row end.
+        inline void CloseColRun(int c, int end, GemColor color, int minRun)
+        {
+            auto start = m_ColStart[c];
+            if (end - start.m_I >= minRun && color != InvalidColor)
+                m_ColRuns.push_back({ c, start, end - 1 });
+        }
+    };
+}
+
+#ifdef CatchAvailable__
+
+#include "m3MatchKernel.hpp"
+
+TEST_CASE("Run scanner", "[runscanner][matching]")
+{
+    using namespace m3;
+    using namespace m3::BitboardTest;
+
+    SECTION("Known board")
+    {
+        const char colors_[] =
+               /*|*/
+            ___01234567
+            _4"BRBGYBRO"
+            _3"OYBOGYBR"
+            _2"BBBBBBYB" //--
+            _1"BRBBROGY"
+            _0"YBROBROG";
+
+        Colors colors(5, 8);
+        Colors::CreateInverted(colors_, sizeof(colors_), &colors);
+
+        RunScanner scanner;
+        REQUIRE(scanner.Scan(colors) == 2);
+        REQUIRE(scanner.RowRuns().size() == 1);
+        REQUIRE(scanner.RowRuns()[0] == RowSpan { 2, 0, 5 });
+        REQUIRE(scanner.ColRuns().size() == 1);
+        REQUIRE(scanner.ColRuns()[0] == ColSpan { 2, 1, 4 });
+
+        // Column runs come in the order they end.
+        REQUIRE(scanner.Scan(colors, 2) == 5);
+        REQUIRE(scanner.RowRuns()[0] == RowSpan { 1, 2, 3 });
+        REQUIRE(scanner.RowRuns()[1] == RowSpan { 2, 0, 5 });
+        REQUIRE(scanner.ColRuns()[0] == ColSpan { 0, 1, 2 });
+        REQUIRE(scanner.ColRuns()[1] == ColSpan { 3, 1, 2 });
+        REQUIRE(scanner.ColRuns()[2] == ColSpan { 2, 1, 4 });
+    }
+
+    SECTION("Same cells as the walkers, runs are maximal and ordered")
+    {
+        const int sizes[][2] = { { 1, 1 }, { 3, 3 }, { 8, 8 }, { 5, 63 }, { 9, 64 }, { 17, 65 }, { 64, 64 }, { 130, 7 } };
+
+        RunScanner scanner;
+
+        for (auto& size : sizes)
+        {
+            for (auto seed = 0U; seed < 8; seed++)
+            {
+                auto colors = RandomBoard(size[0], size[1], seed, (seed & 1) != 0);
+
+                for (auto n : { 1, 3, 4 })
+                {
+                    INFO("Board " << size[0] << "x" << size[1] << " seed " << seed << " run " << n);
+
+                    scanner.Scan(colors, n);
+
+                    BoardMask mask(size[0], size[1]);
+                    scanner.Mark(&mask);
+                    REQUIRE(SameCells(mask, WalkerMatches(colors, n)));
+
+                    for (auto i = 0U; i < scanner.RowRuns().size(); i++)
+                    {
+                        auto& run = scanner.RowRuns()[i];
+                        auto color = colors(run.Row(), run.Col_0());
+                        REQUIRE(run.Count() >= n);
+                        REQUIRE(colors(run.Row(), run.Col_1()) == color);
+                        REQUIRE((run.Col_0() == 0 || colors(run.Row(), run.Col_0() - 1) != color));
+                        REQUIRE((run.Col_1() == size[1] - 1 || colors(run.Row(), run.Col_1() + 1) != color));
+
+                        if (i > 0)
+                        {
+                            auto& prev = scanner.RowRuns()[i - 1];
+                            REQUIRE((prev.Row() < run.Row() || (prev.Row() == run.Row() && prev.Col_1() < run.Col_0())));
+                        }
+                    }
+
+                    for (auto& run : scanner.ColRuns())
+                    {
+                        auto color = colors(run.Row_0(), run.Col());
+                        REQUIRE(run.Count() >= n);
+                        REQUIRE((run.Row_0() == 0 || colors(run.Row_0() - 1, run.Col()) != color));
+                        REQUIRE((run.Row_1() == size[0] - 1 || colors(run.Row_1() + 1, run.Col()) != color));
+                    }
+                }
+            }
+        }
+    }
+
+    SECTION("Other layouts give the same runs")
+    {
+        auto colors = RandomBoard(21, 37, 5, true);
+
+        DynamicBoard<GemColor, Tiled8x8> tiled(colors.Rows(), colors.Cols());
+        for (auto r = 0; r < colors.Rows().m_I; r++)
+            for (auto c = 0; c < colors.Cols().m_I; c++)
+                tiled(r, c) = colors(r, c);
+
+        RunScanner scanner, tiledScanner;
+        scanner.Scan(colors);
+        tiledScanner.Scan(tiled);
+
+        REQUIRE((scanner.RowRuns() == tiledScanner.RowRuns()));
+        REQUIRE((scanner.ColRuns() == tiledScanner.ColRuns()));
+    }
+
+    SECTION("Nothing is allocated once the arenas have grown")
+    {
+        auto colors = RandomBoard(40, 40, 3, false);
+
+        RunScanner scanner;
+        scanner.Scan(colors);
+
+        auto rowRuns = scanner.RowRuns().data();
+        auto colRuns = scanner.ColRuns().data();
+        auto count = scanner.RunCount();
+
+        scanner.Scan(colors);
+        REQUIRE(scanner.RunCount() == count);
+        REQUIRE(scanner.RowRuns().data() == rowRuns);
+        REQUIRE(scanner.ColRuns().data() == colRuns);
+    }
+
+    SECTION("Set range")
+    {
+        BoardMask mask(3, 200);
+        mask.SetRange(1, 60, 130);
+        mask.SetRange(2, 5, 5);
+        mask.SetRange(0, 0, 199);
+
+        REQUIRE(mask.Count() == 71 + 1 + 200);
+        REQUIRE(!mask.Test(1, 59));
+        REQUIRE(mask.Test(1, 60));
+        REQUIRE(mask.Test(1, 130));
+        REQUIRE(!mask.Test(1, 131));
+        REQUIRE(mask.Test(2, 5));
+    }
+}
+
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+
+TEST_CASE("Run scanner vs walkers and kernel", "[.][benchmark][runscanner]")
+{
+    using namespace m3;
+    using namespace m3::BitboardTest;
+
+    for (auto n : { 64, 512, 2048 })
+    {
+        auto colors = RandomBoard(n, n, 0, false);
+        auto size = std::to_string(n) + "x" + std::to_string(n);
+
+        RunScanner scanner;
+        BoardMask mask(n, n);
+        MatchRunKernel kernel;
+        MatchRunKernel::Mask kernelMask(n, n);
+
+        BENCHMARK("Walkers " + size) { return WalkerMatches(colors).Count(); };
+        BENCHMARK("Run scanner " + size + " (spans)") { return scanner.Scan(colors); };
+        BENCHMARK("Run scanner " + size + " (spans + mask)")
+        {
+            scanner.Scan(colors);
+            scanner.Mark(&mask);
+            return mask.RowWords(0)[0];
+        };
+        BENCHMARK("Kernel " + size + " (mask only)")
+        {
+            kernel.Find(colors, &kernelMask);
+            return kernelMask(0, 0);
+        };
+    }
+}
+
+#endif
+
+#endif
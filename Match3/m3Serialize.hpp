@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <EASTL\type_traits.h>
+#include <EASTL\vector.h>
+
+namespace m3
+{
+    // Raw, native-endian snapshots of runtime state, for keyframes and save states.
+    // A snapshot is only meant to be read back by the same build, there is no versioning.
+    class BinaryWriter
+    {
+    private:
+        eastl::vector<uint8_t>& m_Out;
+
+    public:
+        explicit BinaryWriter(eastl::vector<uint8_t>* out) : m_Out(*out) {}
+
+        inline size_t Size() const { return m_Out.size(); }
+
+        void WriteBytes(const void* data, size_t size)
+        {
+            auto offset = m_Out.size();
+            m_Out.resize(offset + size);
+
+            if (size > 0)
+                memcpy(m_Out.data() + offset, data, size);
+        }
+
+        template <class T>
+        inline void Write(const T& value)
+        {
+            static_assert(eastl::is_trivially_copyable<T>::value);
+            WriteBytes(&value, sizeof(T));
+        }
+
+        // Count, then the elements.
+        template <class T>
+        void WriteVector(const eastl::vector<T>& values)
+        {
+            static_assert(eastl::is_trivially_copyable<T>::value);
+            Write((uint32_t)values.size());
+            WriteBytes(values.data(), sizeof(T) * values.size());
+        }
+    };
+
+    // Reads what BinaryWriter wrote. Reading past the end fails softly: the reader
+    // goes !Ok(), returns zeroes from then on and the caller checks once at the end.
+    class BinaryReader
+    {
+    private:
+        const uint8_t* m_Data;
+        size_t m_Size;
+        size_t m_Offset = 0;
+        bool m_Ok = true;
+
+    public:
+        BinaryReader(const void* data, size_t size) :
+            m_Data((const uint8_t*)data),
+            m_Size(size)
+        {}
+
+        inline bool Ok() const { return m_Ok; }
+        inline size_t Remaining() const { return m_Size - m_Offset; }
+
+        bool ReadBytes(void* data, size_t size)
+        {
+            if (!m_Ok || size > Remaining())
+            {
+                m_Ok = false;
+                memset(data, 0, size);
+                return false;
+            }
+
+            if (size > 0)
+                memcpy(data, m_Data + m_Offset, size);
+
+            m_Offset += size;
+            return true;
+        }
+
+        template <class T>
+        inline T Read()
+        {
+            static_assert(eastl::is_trivially_copyable<T>::value);
+            T value;
+            ReadBytes(&value, sizeof(T));
+            return value;
+        }
+
+        template <class T>
+        bool ReadVector(eastl::vector<T>* outValues)
+        {
+            static_assert(eastl::is_trivially_copyable<T>::value);
+
+            auto count = Read<uint32_t>();
+            if (!m_Ok || (size_t)count * sizeof(T) > Remaining())
+            {
+                m_Ok = false;
+                outValues->clear();
+                return false;
+            }
+
+            outValues->resize(count);
+            return ReadBytes(outValues->data(), sizeof(T) * count);
+        }
+    };
+
+    // 64-bit FNV-1a. Not for hash tables, just a cheap fingerprint to compare states with.
+    const uint64_t Fnv1a64Basis = 0xCBF29CE484222325ULL;
+
+    inline uint64_t Fnv1a64(const void* data, size_t size, uint64_t hash = Fnv1a64Basis)
+    {
+        auto bytes = (const uint8_t*)data;
+        for (auto i = 0U; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 0x100000001B3ULL;
+        }
+
+        return hash;
+    }
+}
+
+#ifdef CatchAvailable__
+
+TEST_CASE("Binary reader and writer", "[serialize]")
+{
+    using namespace m3;
+
+    eastl::vector<uint8_t> bytes;
+    BinaryWriter writer(&bytes);
+
+    eastl::vector<uint16_t> values = { 1, 2, 3, 0xFFFF };
+    writer.Write(uint32_t(0xDEADBEEF));
+    writer.WriteVector(values);
+    writer.Write(int8_t(-5));
+
+    REQUIRE(writer.Size() == 4 + 4 + 8 + 1);
+
+    SECTION("Round trip")
+    {
+        BinaryReader reader(bytes.data(), bytes.size());
+        eastl::vector<uint16_t> read;
+
+        REQUIRE(reader.Read<uint32_t>() == 0xDEADBEEF);
+        REQUIRE(reader.ReadVector(&read));
+        REQUIRE(reader.Read<int8_t>() == -5);
+        REQUIRE(reader.Ok());
+        REQUIRE(reader.Remaining() == 0);
+        REQUIRE((read == values));
+    }
+
+    SECTION("Truncated input fails softly")
+    {
+        BinaryReader reader(bytes.data(), 10);
+        eastl::vector<uint16_t> read;
+
+        REQUIRE(reader.Read<uint32_t>() == 0xDEADBEEF);
+        REQUIRE(!reader.ReadVector(&read));
+        REQUIRE(read.empty());
+        REQUIRE(reader.Read<int8_t>() == 0);
+        REQUIRE(!reader.Ok());
+    }
+
+    SECTION("Fnv1a64")
+    {
+        REQUIRE(Fnv1a64("", 0) == Fnv1a64Basis);
+        REQUIRE(Fnv1a64("a", 1) == 0xAF63DC4C8601EC8CULL);
+        REQUIRE(Fnv1a64("foobar", 6) == 0x85944171F73967E8ULL);
+    }
+}
+
+#endif
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define X86Available__
+#endif
+
+#ifdef X86Available__
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TargetAvx2__
+#else
+#include <cpuid.h>
+#define TargetAvx2__ __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace m3
+{
+    // Instruction sets the kernels can dispatch to at runtime.
+    enum class SimdLevel
+    {
+        Scalar,
+        SSE2,
+        AVX2
+    };
+
+    inline const char* ToString(SimdLevel level)
+    {
+        switch (level)
+        {
+            case SimdLevel::Scalar: return "Scalar";
+            case SimdLevel::SSE2: return "SSE2";
+            case SimdLevel::AVX2: return "AVX2";
+        }
+
+        return "Scalar";
+    }
+
+    // Best level the CPU and OS support. Checked once.
+    inline SimdLevel DetectSimdLevel()
+    {
+    #ifdef X86Available__
+        static const SimdLevel level = []()
+        {
+            int regs[4] = {};
+            auto cpuid = [&regs](int leaf)
+            {
+            #ifdef _MSC_VER
+                __cpuidex(regs, leaf, 0);
+            #else
+                __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+            #endif
+            };
+
+            cpuid(0);
+            const auto maxLeaf = regs[0];
+
+            cpuid(1);
+            const bool sse2 = (regs[3] & (1 << 26)) != 0;
+            const bool osxsave = (regs[2] & (1 << 27)) != 0;
+            const bool avx = (regs[2] & (1 << 28)) != 0;
+
+            bool avx2 = false;
+            if (maxLeaf >= 7 && osxsave && avx)
+            {
+            #ifdef _MSC_VER
+                const auto xcr0 = _xgetbv(0);
+            #else
+                uint32_t lo, hi;
+                __asm__ ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+                const auto xcr0 = ((uint64_t)hi << 32) | lo;
+            #endif
+                // The OS has to save YMM state.
+                if ((xcr0 & 6) == 6)
+                {
+                    cpuid(7);
+                    avx2 = (regs[1] & (1 << 5)) != 0;
+                }
+            }
+
+            return avx2 ? SimdLevel::AVX2 : (sse2 ? SimdLevel::SSE2 : SimdLevel::Scalar);
+        }();
+
+        return level;
+    #else
+        return SimdLevel::Scalar;
+    #endif
+    }
+}
@@ -0,0 +1,827 @@
+#pragma once
+
+#include <EASTL\algorithm.h>
+#include <EASTL\span.h>
+#include <EASTL\unique_ptr.h>
+#include <EASTL\vector.h>
+
+#include "m3Types.hpp"
+#include "m3Board.hpp"
+#include "m3Match.hpp"
+#include "m3MatchKernel.hpp"
+#include "m3DirtyCells.hpp"
+#include "m3Gravity.hpp"
+#include "m3Bitboard.hpp"
+#include "m3Generator.hpp"
+#include "m3Random.hpp"
+#include "m3Moves.hpp"
+#include "m3ParallelScan.hpp"
+#include "m3Serialize.hpp"
+#include "m3Zobrist.hpp"
+
+namespace m3
+{
+    struct Cell
+    {
+        Row m_Row;
+        Col m_Col;
+    };
+
+    // A new gem placed in an empty cell at the top of its column.
+    struct Spawn
+    {
+        Row m_Row;
+        Col m_Col;
+        GemColor m_Color;
+    };
+
+    // What happened while resolving, step by step. A step is one clear, then the 
+    // falls and spawns that follow it. Stored flat, each step keeps the end offsets 
+    // of its events, so nothing is allocated per step once the vectors have grown.
+    class CascadeEvents
+    {
+    private:
+        struct Step
+        {
+            uint32_t m_ClearedEnd;
+            uint32_t m_MovesEnd;
+            uint32_t m_SpawnsEnd;
+        };
+
+        eastl::vector<Step> m_Steps;
+        eastl::vector<Cell> m_Cleared;
+        eastl::vector<FallMove> m_Moves;
+        eastl::vector<Spawn> m_Spawns;
+
+    public:
+        void Clear()
+        {
+            m_Steps.clear();
+            m_Cleared.clear();
+            m_Moves.clear();
+            m_Spawns.clear();
+        }
+
+        inline uint32_t StepCount() const { return (uint32_t)m_Steps.size(); }
+        inline uint32_t ClearedCount() const { return (uint32_t)m_Cleared.size(); }
+
+        eastl::span<const Cell> Cleared(uint32_t step) const
+        {
+            auto begin = step > 0 ? m_Steps[step - 1].m_ClearedEnd : 0;
+            return { m_Cleared.data() + begin, m_Steps[step].m_ClearedEnd - begin };
+        }
+
+        eastl::span<const FallMove> Moves(uint32_t step) const
+        {
+            auto begin = step > 0 ? m_Steps[step - 1].m_MovesEnd : 0;
+            return { m_Moves.data() + begin, m_Steps[step].m_MovesEnd - begin };
+        }
+
+        eastl::span<const Spawn> Spawns(uint32_t step) const
+        {
+            auto begin = step > 0 ? m_Steps[step - 1].m_SpawnsEnd : 0;
+            return { m_Spawns.data() + begin, m_Steps[step].m_SpawnsEnd - begin };
+        }
+
+        // Cells recorded since the last EndStep.
+        eastl::span<const Cell> PendingCleared() const
+        {
+            auto begin = m_Steps.empty() ? 0 : m_Steps.back().m_ClearedEnd;
+            return { m_Cleared.data() + begin, m_Cleared.size() - begin };
+        }
+
+        // Recording, used by Simulation.
+        inline void AddCleared(Row r, Col c) { m_Cleared.push_back({ r, c }); }
+        inline void AddMove(Col c, Row from, Row to) { m_Moves.push_back({ c, from, to }); }
+        inline void AddSpawn(Row r, Col c, GemColor color) { m_Spawns.push_back({ r, c, color }); }
+
+        inline void EndStep()
+        {
+            m_Steps.push_back({ (uint32_t)m_Cleared.size(), (uint32_t)m_Moves.size(), (uint32_t)m_Spawns.size() });
+        }
+
+        void Save(BinaryWriter& writer) const
+        {
+            writer.WriteVector(m_Steps);
+            writer.WriteVector(m_Cleared);
+            writer.WriteVector(m_Moves);
+            writer.WriteVector(m_Spawns);
+        }
+
+        // All or nothing.
+        bool Load(BinaryReader& reader)
+        {
+            CascadeEvents loaded;
+            reader.ReadVector(&loaded.m_Steps);
+            reader.ReadVector(&loaded.m_Cleared);
+            reader.ReadVector(&loaded.m_Moves);
+            reader.ReadVector(&loaded.m_Spawns);
+
+            if (!reader.Ok() || !loaded.IsConsistent())
+                return false;
+
+            eastl::swap(m_Steps, loaded.m_Steps);
+            eastl::swap(m_Cleared, loaded.m_Cleared);
+            eastl::swap(m_Moves, loaded.m_Moves);
+            eastl::swap(m_Spawns, loaded.m_Spawns);
+            return true;
+        }
+
+        // Steps end in order and within the records, so Cleared() and co. stay in bounds.
+        bool IsConsistent() const
+        {
+            auto previous = Step { 0, 0, 0 };
+            for (auto& step : m_Steps)
+            {
+                if (step.m_ClearedEnd < previous.m_ClearedEnd || step.m_MovesEnd < previous.m_MovesEnd ||
+                    step.m_SpawnsEnd < previous.m_SpawnsEnd)
+                    return false;
+
+                previous = step;
+            }
+
+            return previous.m_ClearedEnd <= m_Cleared.size() && previous.m_MovesEnd <= m_Moves.size() &&
+                previous.m_SpawnsEnd <= m_Spawns.size();
+        }
+
+        // Every recorded cell is on a rows x cols board.
+        bool FitsBoard(Row rows, Col cols) const
+        {
+            auto onBoard = [rows, cols](Row r, Col c) { return r >= 0 && r < rows && c >= 0 && c < cols; };
+
+            return
+                eastl::all_of(m_Cleared.begin(), m_Cleared.end(), [&](const Cell& cell) { return onBoard(cell.m_Row, cell.m_Col); }) &&
+                eastl::all_of(m_Moves.begin(), m_Moves.end(), [&](const FallMove& move) { return onBoard(move.m_From, move.m_Col) && onBoard(move.m_To, move.m_Col); }) &&
+                eastl::all_of(m_Spawns.begin(), m_Spawns.end(), [&](const Spawn& spawn) { return onBoard(spawn.m_Row, spawn.m_Col); });
+        }
+    };
+
+    // Game rules without presentation: clear -> gravity -> refill -> re-match, run 
+    // synchronously to a fixed point. Owns the color board and nothing else.
+    class Simulation
+    {
+    public:
+        using Colors = DynamicBoard<GemColor>;
+
+    private:
+        Colors m_Colors;
+        Zobrist m_Zobrist;
+        uint64_t m_Hash = 0; // Of m_Colors, kept up to date on every write.
+        DirtyCells m_DirtyCells;
+        MatchRunKernel m_MatchKernel;
+        MatchRunKernel::Mask m_ClearMask;
+
+        // Holes of the step being applied. Gravity visits only the columns set in
+        // m_HoleCols, lowest first, and each from its own lowest hole.
+        BoardMask m_HoleCols;               // One row, a bit per column.
+        eastl::vector<Row> m_LowestHole;    // Per column, Rows() when the column has no holes.
+        eastl::vector<uint16_t> m_HoleCount;
+
+        Random m_Random;
+        BoardGenerator m_Generator;
+        MoveFinder m_MoveFinder;
+        eastl::unique_ptr<ParallelMatchScan> m_ParallelScan; // Only with a thread pool.
+        eastl::vector<GemColor> m_SpawnColors; // One column's worth.
+
+    public:
+        Simulation(Row rows, Col cols, uint32_t seed = 0) :
+            m_Colors(rows, cols),
+            m_DirtyCells(rows, cols),
+            m_ClearMask(rows, cols),
+            m_HoleCols(1, cols),
+            m_LowestHole(cols.m_I, rows),
+            m_HoleCount(cols.m_I, 0),
+            m_Random(seed),
+            m_SpawnColors(rows.m_I)
+        {
+            m_Colors.Fill(InvalidColor);
+        }
+
+        inline Row Rows() const { return m_Colors.Rows(); }
+        inline Col Cols() const { return m_Colors.Cols(); }
+        inline const Colors& GetColors() const { return m_Colors; }
+        inline GemColor operator() (Row r, Col c) const { return m_Colors(r, c); }
+
+        // Zobrist hash of the colors, for search, dedup and cycle detection. 
+        // Maintained as cells are written, so this is O(1) (O(board) with asserts on).
+        inline uint64_t Hash() const
+        {
+            assert(m_Hash == m_Zobrist.Hash(m_Colors));
+            return m_Hash;
+        }
+
+        // Restarts the random sequence. The board is left as is.
+        void Seed(uint64_t seed)
+        {
+            m_Random.Seed(seed);
+        }
+
+        inline const Random& GetRandom() const { return m_Random; }
+        inline void SetRandom(const Random& random) { m_Random = random; }
+
+        // Uniformly random colors. The board may well contain matches, see ResolveWholeBoard.
+        void FillRandom()
+        {
+            for (auto r = 0; r < Rows().m_I; r++)
+                m_Random.FillColors({ m_Colors.RowData(r), (size_t)Cols().m_I });
+
+            m_Hash = m_Zobrist.Hash(m_Colors);
+            m_DirtyCells.Clear();
+        }
+
+        // A board with no matches on it, and at least minValidMoves swaps that make one.
+        bool Generate(int minValidMoves = 0)
+        {
+            m_DirtyCells.Clear();
+            auto generated = m_Generator.Generate(&m_Colors, m_Random, minValidMoves);
+            m_Hash = m_Zobrist.Hash(m_Colors);
+            return generated;
+        }
+
+        // Whole board scans go wide on the pool from now on, nullptr to go back to 
+        // one thread. Only worth it on big boards. The pool has to outlive this.
+        void SetThreadPool(ThreadPool* pool)
+        {
+            m_ParallelScan.reset(pool ? new ParallelMatchScan(pool) : nullptr);
+        }
+
+        void SetColors(const Colors& colors)
+        {
+            assert(colors.Rows() == Rows() && colors.Cols() == Cols());
+            m_Colors = colors;
+            m_Hash = m_Zobrist.Hash(m_Colors);
+            m_DirtyCells.Clear();
+        }
+
+        // Eg. a board in a mapped snapshot.
+        void SetColors(const BoardRef<GemColor>& colors)
+        {
+            assert(colors.Rows() == Rows() && colors.Cols() == Cols());
+            m_Colors.CopyFrom(colors);
+            m_Hash = m_Zobrist.Hash(m_Colors);
+            m_DirtyCells.Clear();
+        }
+
+        void SetColor(Row r, Col c, GemColor color)
+        {
+            m_Hash ^= m_Zobrist.Change(r, c, m_Colors(r, c), color);
+            m_Colors(r, c) = color;
+            m_DirtyCells.MarkChanged(r, c);
+        }
+
+        // Scans everything, then resolves. Use after filling the board from scratch.
+        // Returns the number of steps.
+        uint32_t ResolveWholeBoard(CascadeEvents* outEvents)
+        {
+            m_DirtyCells.Clear();
+
+            if (m_ParallelScan)
+                m_ParallelScan->Find(m_Colors, &m_ClearMask);
+            else
+                m_MatchKernel.Find(m_Colors, &m_ClearMask);
+
+            for (auto r = 0; r < Rows().m_I; r++)
+            {
+                auto mask = m_ClearMask.RowData(r);
+                for (auto c = 0; c < Cols().m_I; c++)
+                {
+                    if (mask[c] != 0)
+                        outEvents->AddCleared(r, c);
+                }
+            }
+
+            return ApplyClears(outEvents) ? 1 + Resolve(outEvents) : 0;
+        }
+
+        // For hints and AI. Returns the number of moves.
+        uint32_t FindValidMoves(eastl::vector<Swap>* outMoves)
+        {
+            return m_MoveFinder.FindAll(m_Colors, outMoves);
+        }
+
+        // False on a dead board.
+        bool HasValidMove()
+        {
+            return m_MoveFinder.HasAny(m_Colors);
+        }
+
+        // Swaps two adjacent cells and resolves. If the swap makes no match it is undone 
+        // and nothing is recorded. Expects a board with no matches on it.
+        bool ApplySwap(const Swap& swap, CascadeEvents* outEvents)
+        {
+            assert(swap.IsAdjacent());
+            assert(m_Colors.IsWithinBounds(swap.m_R0, swap.m_C0) && m_Colors.IsWithinBounds(swap.m_R1, swap.m_C1));
+
+            auto& a = m_Colors(swap.m_R0, swap.m_C0);
+            auto& b = m_Colors(swap.m_R1, swap.m_C1);
+
+            if (a == b || a == InvalidColor || b == InvalidColor)
+                return false;
+
+            eastl::swap(a, b);
+
+            if (!IsInRun(swap.m_R0, swap.m_C0) && !IsInRun(swap.m_R1, swap.m_C1))
+            {
+                eastl::swap(a, b);
+                return false;
+            }
+
+            m_Hash ^= m_Zobrist.Change(swap.m_R0, swap.m_C0, b, a);
+            m_Hash ^= m_Zobrist.Change(swap.m_R1, swap.m_C1, a, b);
+
+            m_DirtyCells.MarkChanged(swap.m_R0, swap.m_C0);
+            m_DirtyCells.MarkChanged(swap.m_R1, swap.m_C1);
+            Resolve(outEvents);
+
+            return true;
+        }
+
+        // Colors and the random state, which is all there is between calls: holes and 
+        // dirty cells are only used while resolving. A loaded simulation continues exactly 
+        // like the saved one would have.
+        void Save(BinaryWriter& writer) const
+        {
+            m_Colors.Save(writer);
+            m_Random.Save(writer);
+        }
+
+        // All or nothing, fails on a board of another size.
+        bool Load(BinaryReader& reader)
+        {
+            Colors colors;
+            auto random = m_Random;
+            if (!Read(reader, &colors, &random))
+                return false;
+
+            m_Colors.Swap(colors);
+            m_Hash = m_Zobrist.Hash(m_Colors);
+            m_DirtyCells.Clear();
+            m_Random = random;
+            return true;
+        }
+
+        // Load() without changing anything, for callers that have more to check first.
+        // Apply with SetColors() and SetRandom().
+        bool Read(BinaryReader& reader, Colors* outColors, Random* outRandom) const
+        {
+            *outRandom = m_Random;
+            return outColors->Load(reader) && outColors->Rows() == Rows() && outColors->Cols() == Cols() &&
+                outRandom->Load(reader);
+        }
+
+        // Clears matches around changed cells until there are none. Returns the number of steps.
+        uint32_t Resolve(CascadeEvents* outEvents)
+        {
+            auto steps = 0U;
+
+            while (!m_DirtyCells.Empty())
+            {
+                auto clear = [outEvents](Row r, Col c) { outEvents->AddCleared(r, c); };
+
+                FindMatchesInDirtyCells(m_Colors, m_DirtyCells, clear);
+                m_DirtyCells.Clear();
+
+                if (!ApplyClears(outEvents))
+                    break;
+
+                steps++;
+            }
+
+            return steps;
+        }
+
+    private:
+        inline bool IsInRun(Row r, Col c) const
+        {
+            auto color = m_Colors(r, c);
+            auto c0 = GetMatchingColsInRow_L(r, c, color, m_Colors);
+            auto c1 = GetMatchingColsInRow_R(r, c, color, m_Colors, Cols() - 1);
+            auto r0 = GetMatchingRowsInCol_D(r, c, color, m_Colors);
+            auto r1 = GetMatchingRowsInCol_U(r, c, color, m_Colors, Rows() - 1);
+
+            return (c1 - c0 + 1) >= 3 || (r1 - r0 + 1) >= 3;
+        }
+
+        // Clears the cells recorded since the last step, lets gems fall, refills 
+        // and closes the step. Landed and spawned cells are marked dirty.
+        bool ApplyClears(CascadeEvents* outEvents)
+        {
+            auto cleared = outEvents->PendingCleared();
+            if (cleared.empty())
+                return false;
+
+            for (const auto& cell : cleared)
+            {
+                // A cell can be listed twice, the second time it is already a hole.
+                auto& color = m_Colors(cell.m_Row, cell.m_Col);
+                if (color == InvalidColor)
+                    continue;
+
+                m_Hash ^= m_Zobrist.Key(cell.m_Row, cell.m_Col, color);
+                color = InvalidColor;
+
+                auto& lowest = m_LowestHole[cell.m_Col.m_I];
+                lowest = eastl::min(lowest, cell.m_Row);
+                m_HoleCount[cell.m_Col.m_I]++;
+                m_HoleCols.Set(0, cell.m_Col);
+            }
+
+            auto words = m_HoleCols.RowWords(0);
+            for (auto w = 0U; w < m_HoleCols.WordsPerRow(); w++)
+            {
+                ForEachSetBit(words[w], [&](uint32_t bit) { ApplyGravity(w * BoardMask::WordBits + bit, outEvents); });
+                words[w] = 0;
+            }
+
+            outEvents->EndStep();
+
+            return true;
+        }
+
+        // Lets column c fall from its lowest hole and refills it from the top. Cell by cell 
+        // rather than GravityKernel: each move also goes to the hash, dirty cells and events.
+        void ApplyGravity(Col c, CascadeEvents* outEvents)
+        {
+            auto write = m_LowestHole[c.m_I];
+
+            // When the holes are all at the top there is nothing above them to fall.
+            if (write + m_HoleCount[c.m_I] < Rows())
+            {
+                for (auto r = write + 1; r < Rows(); r = r + 1)
+                {
+                    auto color = m_Colors(r, c);
+                    if (color == InvalidColor)
+                        continue;
+
+                    m_Hash ^= m_Zobrist.Key(write, c, color) ^ m_Zobrist.Key(r, c, color);
+                    m_Colors(write, c) = color;
+                    m_Colors(r, c) = InvalidColor;
+                    m_DirtyCells.MarkChanged(write, c);
+                    outEvents->AddMove(c, r, write);
+                    write = write + 1;
+                }
+            }
+
+            auto spawns = eastl::span<GemColor>(m_SpawnColors.data(), (Rows() - write).m_I);
+            m_Random.FillColors(spawns);
+
+            for (auto r = write; r < Rows(); r = r + 1)
+            {
+                auto color = spawns[(r - write).m_I];
+                m_Hash ^= m_Zobrist.Key(r, c, color);
+                m_Colors(r, c) = color;
+                m_DirtyCells.MarkChanged(r, c);
+                outEvents->AddSpawn(r, c, color);
+            }
+
+            m_LowestHole[c.m_I] = Rows();
+            m_HoleCount[c.m_I] = 0;
+        }
+    };
+}
+
+#ifdef CatchAvailable__
+
+#include "m3Bitboard.hpp"
+
+namespace m3::SimulationTest
+{
+    using Colors = DynamicBoard<GemColor>;
+
+    // Plays one step's events onto a board, the way a presentation layer would.
+    inline void ApplyStep(Colors& colors, const CascadeEvents& events, uint32_t step)
+    {
+        for (auto& cell : events.Cleared(step))
+            colors(cell.m_Row, cell.m_Col) = InvalidColor;
+
+        for (auto& move : events.Moves(step))
+        {
+            REQUIRE(colors(move.m_To, move.m_Col) == InvalidColor);
+            colors(move.m_To, move.m_Col) = colors(move.m_From, move.m_Col);
+            colors(move.m_From, move.m_Col) = InvalidColor;
+        }
+
+        for (auto& spawn : events.Spawns(step))
+        {
+            REQUIRE(colors(spawn.m_Row, spawn.m_Col) == InvalidColor);
+            colors(spawn.m_Row, spawn.m_Col) = spawn.m_Color;
+        }
+    }
+
+    inline bool SameColors(const Colors& a, const Colors& b)
+    {
+        for (auto r = 0; r < a.Rows().m_I; r++)
+            for (auto c = 0; c < a.Cols().m_I; c++)
+                if (a(r, c) != b(r, c))
+                    return false;
+        return true;
+    }
+
+    // Tries swaps in a fixed order until one is accepted.
+    inline bool ApplyFirstValidSwap(Simulation& sim, CascadeEvents* outEvents)
+    {
+        for (auto r = 0; r < sim.Rows().m_I; r++)
+        {
+            for (auto c = 0; c < sim.Cols().m_I; c++)
+            {
+                if (c + 1 < sim.Cols().m_I && sim.ApplySwap({ r, c, r, c + 1 }, outEvents))
+                    return true;
+                if (r + 1 < sim.Rows().m_I && sim.ApplySwap({ r, c, r + 1, c }, outEvents))
+                    return true;
+            }
+        }
+        return false;
+    }
+}
+
+TEST_CASE("Simulation", "[simulation]")
+{
+    using namespace m3;
+    using namespace m3::BitboardTest;
+    using namespace m3::SimulationTest;
+
+    SECTION("Steps replay to the final board and match whole board scans")
+    {
+        const int sizes[][2] = { { 8, 8 }, { 3, 3 }, { 16, 40 }, { 40, 9 } };
+
+        for (auto& size : sizes)
+        {
+            for (auto seed = 0U; seed < 6; seed++)
+            {
+                INFO("Board " << size[0] << "x" << size[1] << " seed " << seed);
+
+                auto colors = RandomBoard(size[0], size[1], seed, false);
+
+                Simulation sim(size[0], size[1], seed);
+                sim.SetColors(colors);
+
+                CascadeEvents events;
+                auto steps = sim.ResolveWholeBoard(&events);
+                REQUIRE(steps == events.StepCount());
+
+                for (auto step = 0U; step < steps; step++)
+                {
+                    auto expected = WalkerMatches(colors);
+                    auto cleared = BoardMask(size[0], size[1]);
+                    for (auto& cell : events.Cleared(step))
+                        cleared.Set(cell.m_Row, cell.m_Col);
+
+                    INFO("Step " << step);
+                    REQUIRE(SameCells(cleared, expected));
+
+                    ApplyStep(colors, events, step);
+                }
+
+                REQUIRE(SameColors(colors, sim.GetColors()));
+                REQUIRE(WalkerMatches(colors).Count() == 0);
+
+                for (auto r = 0; r < size[0]; r++)
+                    for (auto c = 0; c < size[1]; c++)
+                        REQUIRE(colors(r, c) != InvalidColor);
+            }
+        }
+    }
+
+    SECTION("Same events with a thread pool")
+    {
+        ThreadPool pool(3);
+        auto colors = RandomBoard(300, 70, 1, false);
+
+        Simulation serial(300, 70, 1), parallel(300, 70, 1);
+        serial.SetColors(colors);
+        parallel.SetColors(colors);
+        parallel.SetThreadPool(&pool);
+
+        CascadeEvents a, b;
+        REQUIRE(serial.ResolveWholeBoard(&a) == parallel.ResolveWholeBoard(&b));
+        REQUIRE(a.ClearedCount() == b.ClearedCount());
+        REQUIRE(SameColors(serial.GetColors(), parallel.GetColors()));
+    }
+
+    SECTION("Swaps without a match are rejected")
+    {
+        Simulation sim(3, 3);
+        sim.SetColors(Colors(3, 3, 
+            "BRB"
+            "RBR"
+            "GYG", 9));
+
+        CascadeEvents events;
+        REQUIRE(!sim.ApplySwap({ 0, 0, 0, 1 }, &events));
+        REQUIRE(!sim.ApplySwap({ 2, 0, 2, 1 }, &events));
+        REQUIRE(events.StepCount() == 0);
+        REQUIRE(sim(0, 0) == Blue);
+        REQUIRE(sim(0, 1) == Red);
+
+        REQUIRE(sim.ApplySwap({ 0, 1, 1, 1 }, &events));
+        REQUIRE(events.StepCount() >= 1);
+        // Both rows match after the swap: BBB over RRR.
+        REQUIRE(events.Cleared(0).size() == 6);
+        REQUIRE(events.Cleared(0)[0].m_Row == 0);
+        REQUIRE(events.Cleared(0)[5].m_Row == 1);
+    }
+
+    SECTION("Swaps resolve to a stable board and are deterministic")
+    {
+        Simulation a(8, 8, 7), b(8, 8, 7);
+        a.FillRandom();
+        b.FillRandom();
+
+        CascadeEvents ea, eb;
+        a.ResolveWholeBoard(&ea);
+        b.ResolveWholeBoard(&eb);
+
+        for (auto i = 0; i < 50; i++)
+        {
+            ea.Clear();
+            eb.Clear();
+            auto swapped = ApplyFirstValidSwap(a, &ea);
+            REQUIRE(swapped == ApplyFirstValidSwap(b, &eb));
+            if (!swapped)
+            {
+                REQUIRE(!a.HasValidMove());
+                break;
+            }
+
+            eastl::vector<Swap> moves;
+            REQUIRE(a.FindValidMoves(&moves) == (uint32_t)CountValidMoves(a.GetColors()));
+            REQUIRE(a.HasValidMove() == !moves.empty());
+
+            REQUIRE(ea.StepCount() == eb.StepCount());
+            REQUIRE(ea.ClearedCount() == eb.ClearedCount());
+            REQUIRE(SameColors(a.GetColors(), b.GetColors()));
+            REQUIRE(WalkerMatches(a.GetColors()).Count() == 0);
+
+            REQUIRE(a.Hash() == Zobrist().Hash(a.GetColors()));
+            REQUIRE(a.Hash() == b.Hash());
+        }
+    }
+
+    SECTION("Gravity only visits columns with holes")
+    {
+        // No runs in the background, then a column of Os in the middle of column 0 and a
+        // row of Os along the top right.
+        const GemColor background[] = { Red, Green, Blue, Yellow };
+
+        Colors colors(6, 10);
+        for (auto r = 0; r < 6; r++)
+            for (auto c = 0; c < 10; c++)
+                colors(r, c) = background[(r + 2 * c) % 4];
+
+        for (auto r = 2; r <= 4; r++)
+            colors(r, 0) = Orange;
+        for (auto c = 7; c <= 9; c++)
+            colors(5, c) = Orange;
+
+        Simulation sim(6, 10, 3);
+        sim.SetColors(colors);
+
+        CascadeEvents events;
+        REQUIRE(sim.ResolveWholeBoard(&events) >= 1);
+        REQUIRE(events.Cleared(0).size() == 6);
+
+        // Only the gem above the column of Os falls, the top row has nothing above it.
+        REQUIRE(events.Moves(0).size() == 1);
+        REQUIRE(events.Moves(0)[0].m_Col == 0);
+        REQUIRE(events.Moves(0)[0].m_From == 5);
+        REQUIRE(events.Moves(0)[0].m_To == 2);
+
+        // Spawns by column, bottom up in each.
+        auto spawns = events.Spawns(0);
+        REQUIRE(spawns.size() == 6);
+        REQUIRE(spawns[0].m_Col == 0);
+        REQUIRE(spawns[0].m_Row == 3);
+        REQUIRE(spawns[2].m_Row == 5);
+        REQUIRE(spawns[3].m_Col == 7);
+        REQUIRE(spawns[5].m_Col == 9);
+    }
+
+    SECTION("The hash follows single cell writes")
+    {
+        Simulation sim(6, 6, 2);
+        sim.Generate();
+
+        auto hash = sim.Hash();
+        auto color = sim(2, 3);
+        sim.SetColor(2, 3, color == Red ? Blue : Red);
+        REQUIRE(sim.Hash() != hash);
+        REQUIRE(sim.Hash() == Zobrist().Hash(sim.GetColors()));
+
+        sim.SetColor(2, 3, color);
+        REQUIRE(sim.Hash() == hash);
+    }
+
+    SECTION("A loaded snapshot continues like the original")
+    {
+        Simulation a(10, 12, 3);
+        a.FillRandom();
+
+        CascadeEvents ea;
+        a.ResolveWholeBoard(&ea);
+        ApplyFirstValidSwap(a, &ea);
+
+        eastl::vector<uint8_t> bytes;
+        BinaryWriter writer(&bytes);
+        a.Save(writer);
+        ea.Save(writer);
+
+        Simulation b(10, 12, 99);
+        CascadeEvents eb;
+        BinaryReader reader(bytes.data(), bytes.size());
+        REQUIRE(b.Load(reader));
+        REQUIRE(eb.Load(reader));
+        REQUIRE(reader.Remaining() == 0);
+        REQUIRE(SameColors(a.GetColors(), b.GetColors()));
+        REQUIRE(a.Hash() == b.Hash());
+        REQUIRE(ea.StepCount() == eb.StepCount());
+
+        for (auto i = 0; i < 20; i++)
+        {
+            ea.Clear();
+            eb.Clear();
+            auto swapped = ApplyFirstValidSwap(a, &ea);
+            REQUIRE(swapped == ApplyFirstValidSwap(b, &eb));
+            REQUIRE(ea.ClearedCount() == eb.ClearedCount());
+            REQUIRE(SameColors(a.GetColors(), b.GetColors()));
+        }
+
+        Simulation wrongSize(10, 11);
+        BinaryReader again(bytes.data(), bytes.size());
+        REQUIRE(!wrongSize.Load(again));
+
+        BinaryReader truncated(bytes.data(), 64);
+        REQUIRE(!b.Load(truncated));
+
+        // Good colors and a cut short random: nothing changes.
+        Simulation c(10, 12, 5);
+        c.FillRandom();
+        auto hash = c.Hash();
+        BinaryReader colorsOnly(bytes.data(), 4 + a.GetColors().SizeInBytes() + 8);
+        REQUIRE(!c.Load(colorsOnly));
+        REQUIRE(c.Hash() == hash);
+
+        // Steps that run past the records are rejected, and so are cells off the board.
+        BinaryReader eventsReader(bytes.data(), bytes.size());
+        REQUIRE(b.Load(eventsReader));
+        auto eventsOffset = bytes.size() - eventsReader.Remaining();
+
+        CascadeEvents ec;
+        REQUIRE(ec.Load(eventsReader));
+        REQUIRE(ec.StepCount() > 0);
+
+        auto corrupt = bytes;
+        uint32_t end = 1000000;
+        memcpy(corrupt.data() + eventsOffset + 4, &end, sizeof(end));
+        BinaryReader corruptReader(corrupt.data() + eventsOffset, corrupt.size() - eventsOffset);
+        REQUIRE(!ec.Load(corruptReader));
+        REQUIRE(ec.StepCount() > 0);
+
+        REQUIRE(ec.FitsBoard(10, 12));
+        REQUIRE(!ec.FitsBoard(2, 2));
+    }
+}
+
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+
+TEST_CASE("Simulation throughput", "[.][benchmark][simulation]")
+{
+    using namespace m3;
+
+    Simulation sim(8, 8, 1);
+    sim.FillRandom();
+
+    CascadeEvents events;
+    sim.ResolveWholeBoard(&events);
+
+    std::mt19937 gen(1);
+
+    BENCHMARK("Resolve one random valid swap 8x8")
+    {
+        // Random adjacent swaps until one matches; rejected swaps are part of the cost.
+        // A board that seems to have no moves left is refilled.
+        for (auto attempt = 0;; attempt++)
+        {
+            if (attempt == 1000)
+            {
+                events.Clear();
+                sim.FillRandom();
+                sim.ResolveWholeBoard(&events);
+                attempt = 0;
+            }
+
+            auto r = (int)(gen() % 8), c = (int)(gen() % 8);
+            auto horizontal = (gen() & 1) != 0;
+            auto swap = horizontal ? Swap { r, c, r, (c + 1) % 8 } : Swap { r, c, (r + 1) % 8, c };
+            if (!swap.IsAdjacent())
+                continue;
+
+            events.Clear();
+            if (sim.ApplySwap(swap, &events))
+                return events.StepCount();
+        }
+    };
+}
+
+#endif
+
+#endif
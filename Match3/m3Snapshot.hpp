@@ -0,0 +1,651 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <EASTL\span.h>
+#include <EASTL\vector.h>
+
+#include "m3Types.hpp"
+#include "m3Board.hpp"
+#include "m3Serialize.hpp"
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace m3
+{
+    /*
+        Snapshot file: a header, a table of sections, then the sections themselves, each
+        at a SnapshotAlignment multiple. Boards are stored with their padding, byte for byte
+        like a DynamicBoard, and arrays like an eastl::vector's storage, so a mapped file is
+        used in place: opening one is a few header checks, the rest is page faults.
+        Copying out of it, like Match3Game::LoadSnapshot does, is O(size) as usual.
+
+        Native endianness. A snapshot from a machine of the other endianness fails the
+        magic check, one from an older build fails the version check.
+    */
+    const uint32_t SnapshotMagic = 0x4E53334D; // "M3SN"
+    const uint32_t SnapshotVersion = 1;
+    const uint32_t SnapshotAlignment = 64;
+
+    static_assert(SnapshotAlignment % DynamicBoard<GemId>::PitchAlignment == 0);
+
+    // Four characters, eg. SnapshotTag("COLR").
+    constexpr uint32_t SnapshotTag(const char (&tag)[5])
+    {
+        return (uint32_t)(uint8_t)tag[0]
+            | ((uint32_t)(uint8_t)tag[1] << 8)
+            | ((uint32_t)(uint8_t)tag[2] << 16)
+            | ((uint32_t)(uint8_t)tag[3] << 24);
+    }
+
+    struct SnapshotHeader
+    {
+        uint32_t m_Magic;
+        uint32_t m_Version;
+        uint32_t m_SectionCount;
+        uint32_t m_Alignment;
+        uint64_t m_FileSize;
+    };
+
+    // Rows, Cols and Pitch are 0 for anything but boards.
+    struct SnapshotSection
+    {
+        uint32_t m_Tag;
+        uint32_t m_ElementSize;
+        int32_t m_Rows;
+        int32_t m_Cols;
+        uint32_t m_Pitch;
+        uint32_t m_Reserved;
+        uint64_t m_Offset;
+        uint64_t m_Size;
+    };
+
+    static_assert(sizeof(SnapshotHeader) == 24 && sizeof(SnapshotSection) == 40);
+
+    // Collects sections, then writes them in one go. Nothing is copied until Save,
+    // so boards and arrays must stay alive and unchanged until then.
+    class SnapshotWriter
+    {
+    private:
+        struct Pending
+        {
+            SnapshotSection m_Section;
+            const void* m_Data;
+            int m_Blob;          // Index into m_Blobs, or -1 for m_Data.
+            int m_Pieces = -1;   // Index into m_Pieces, or -1 for m_Data.
+        };
+
+        struct Pieces
+        {
+            eastl::vector<const void*> m_Data;
+            size_t m_Size; // Of each piece.
+        };
+
+        eastl::vector<Pending> m_Sections;
+        eastl::vector<eastl::vector<uint8_t>> m_Blobs;
+        eastl::vector<Pieces> m_Pieces;
+
+    public:
+        void AddBytes(uint32_t tag, const void* data, size_t size, uint32_t elementSize = 1)
+        {
+            assert(Find(tag) == nullptr);
+            m_Sections.push_back({ { tag, elementSize, 0, 0, 0, 0, 0, size }, data, -1 });
+        }
+
+        template <class T>
+        void AddArray(uint32_t tag, const eastl::vector<T>& values)
+        {
+            static_assert(eastl::is_trivially_copyable<T>::value);
+            AddBytes(tag, values.data(), sizeof(T) * values.size(), sizeof(T));
+        }
+
+        template <class T, class Layout>
+        void AddBoard(uint32_t tag, const DynamicBoard<T, Layout>& board)
+        {
+            AddBytes(tag, board.Data(), board.SizeInBytes(), sizeof(T));
+
+            auto& section = m_Sections.back().m_Section;
+            section.m_Rows = board.Rows().m_I;
+            section.m_Cols = board.Cols().m_I;
+            section.m_Pitch = board.Pitch();
+        }
+
+        // One section from equal-sized pieces back to back, eg. the same array of every 
+        // chunk of a GemChunks. Like AddBytes, the pieces are only read by Save.
+        void AddPieces(uint32_t tag, eastl::vector<const void*> pieces, size_t pieceSize, uint32_t elementSize = 1)
+        {
+            AddBytes(tag, nullptr, pieceSize * pieces.size(), elementSize);
+            m_Pieces.push_back({ eastl::move(pieces), pieceSize });
+            m_Sections.back().m_Pieces = (int)m_Pieces.size() - 1;
+        }
+
+        // Copies object.Save(BinaryWriter&) output, for state that isn't plain arrays.
+        // Reading it back is a BinaryReader over the mapped section.
+        template <class S>
+        void AddObject(uint32_t tag, const S& object)
+        {
+            m_Blobs.emplace_back();
+            BinaryWriter writer(&m_Blobs.back());
+            object.Save(writer);
+
+            AddBytes(tag, nullptr, m_Blobs.back().size());
+            m_Sections.back().m_Blob = (int)m_Blobs.size() - 1;
+        }
+
+        bool Save(const char* path) const
+        {
+            auto file = fopen(path, "wb");
+            if (!file)
+                return false;
+
+            auto ok = Emit([file](const void* data, size_t size)
+            {
+                return size == 0 || fwrite(data, 1, size, file) == size;
+            });
+
+            return (fclose(file) == 0) && ok;
+        }
+
+        bool Save(eastl::vector<uint8_t>* out) const
+        {
+            out->clear();
+            BinaryWriter writer(out);
+
+            return Emit([&writer](const void* data, size_t size)
+            {
+                writer.WriteBytes(data, size);
+                return true;
+            });
+        }
+
+    private:
+        const Pending* Find(uint32_t tag) const
+        {
+            for (auto& pending : m_Sections)
+            {
+                if (pending.m_Section.m_Tag == tag)
+                    return &pending;
+            }
+            return nullptr;
+        }
+
+        static inline uint64_t AlignUp(uint64_t offset)
+        {
+            return (offset + SnapshotAlignment - 1) & ~(uint64_t)(SnapshotAlignment - 1);
+        }
+
+        template <class Write>
+        bool Emit(Write&& write) const
+        {
+            // Lay out first, so the table can go out ahead of the data.
+            eastl::vector<SnapshotSection> table;
+            table.reserve(m_Sections.size());
+
+            auto offset = (uint64_t)sizeof(SnapshotHeader) + sizeof(SnapshotSection) * m_Sections.size();
+            for (auto& pending : m_Sections)
+            {
+                auto section = pending.m_Section;
+                section.m_Offset = AlignUp(offset);
+                offset = section.m_Offset + section.m_Size;
+                table.push_back(section);
+            }
+
+            SnapshotHeader header = { SnapshotMagic, SnapshotVersion, (uint32_t)table.size(), SnapshotAlignment, offset };
+
+            if (!write(&header, sizeof(header)) || !write(table.data(), sizeof(SnapshotSection) * table.size()))
+                return false;
+
+            static const uint8_t zeroes[SnapshotAlignment] = {};
+            offset = sizeof(SnapshotHeader) + sizeof(SnapshotSection) * table.size();
+
+            for (auto i = 0U; i < table.size(); i++)
+            {
+                auto& pending = m_Sections[i];
+                auto data = pending.m_Blob >= 0 ? m_Blobs[pending.m_Blob].data() : pending.m_Data;
+
+                if (!write(zeroes, (size_t)(table[i].m_Offset - offset)))
+                    return false;
+
+                if (pending.m_Pieces >= 0)
+                {
+                    auto& pieces = m_Pieces[pending.m_Pieces];
+                    for (auto piece : pieces.m_Data)
+                    {
+                        if (!write(piece, pieces.m_Size))
+                            return false;
+                    }
+                }
+                else if (!write(data, (size_t)table[i].m_Size))
+                    return false;
+
+                offset = table[i].m_Offset + table[i].m_Size;
+            }
+
+            return true;
+        }
+    };
+
+    // Read-only file mapping. Empty if the file couldn't be opened or is empty.
+    class MappedFile
+    {
+    private:
+        const uint8_t* m_Data = nullptr;
+        size_t m_Size = 0;
+    #ifdef _WIN32
+        HANDLE m_Mapping = nullptr;
+    #endif
+
+    public:
+        MappedFile() = default;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator= (const MappedFile&) = delete;
+
+        ~MappedFile()
+        {
+            Close();
+        }
+
+        inline const uint8_t* Data() const { return m_Data; }
+        inline size_t Size() const { return m_Size; }
+
+        bool Open(const char* path)
+        {
+            Close();
+
+        #ifdef _WIN32
+            auto file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+                return false;
+
+            LARGE_INTEGER size = {};
+            if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+                m_Mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+            // The mapping keeps the file open.
+            CloseHandle(file);
+
+            if (m_Mapping)
+            {
+                m_Data = (const uint8_t*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+                m_Size = m_Data ? (size_t)size.QuadPart : 0;
+            }
+        #else
+            auto fd = open(path, O_RDONLY);
+            if (fd < 0)
+                return false;
+
+            struct stat info = {};
+            if (fstat(fd, &info) == 0 && info.st_size > 0)
+            {
+                auto data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data != MAP_FAILED)
+                {
+                    m_Data = (const uint8_t*)data;
+                    m_Size = (size_t)info.st_size;
+                }
+            }
+
+            // The mapping keeps the file open.
+            close(fd);
+        #endif
+
+            if (m_Data == nullptr)
+                Close();
+
+            return m_Data != nullptr;
+        }
+
+        void Close()
+        {
+        #ifdef _WIN32
+            if (m_Data)
+                UnmapViewOfFile(m_Data);
+            if (m_Mapping)
+                CloseHandle(m_Mapping);
+            m_Mapping = nullptr;
+        #else
+            if (m_Data)
+                munmap((void*)m_Data, m_Size);
+        #endif
+
+            m_Data = nullptr;
+            m_Size = 0;
+        }
+    };
+
+    // Sections of a snapshot, in place. Boards and arrays point into the mapping,
+    // so they are only valid while the snapshot is open.
+    class Snapshot
+    {
+    private:
+        MappedFile m_File;
+        const uint8_t* m_Data = nullptr;
+        size_t m_Size = 0;
+        const SnapshotSection* m_Sections = nullptr;
+        uint32_t m_SectionCount = 0;
+
+    public:
+        bool Open(const char* path)
+        {
+            Close();
+            return m_File.Open(path) && Validate(m_File.Data(), m_File.Size());
+        }
+
+        // Over bytes the caller keeps alive, eg. a snapshot saved to memory.
+        // Must be SnapshotAlignment aligned for boards to be usable in place.
+        bool Open(const void* data, size_t size)
+        {
+            Close();
+            return Validate((const uint8_t*)data, size);
+        }
+
+        void Close()
+        {
+            m_File.Close();
+            m_Data = nullptr;
+            m_Size = 0;
+            m_Sections = nullptr;
+            m_SectionCount = 0;
+        }
+
+        inline bool IsOpen() const { return m_Data != nullptr; }
+        inline uint32_t SectionCount() const { return m_SectionCount; }
+
+        const SnapshotSection* Find(uint32_t tag) const
+        {
+            for (auto i = 0U; i < m_SectionCount; i++)
+            {
+                if (m_Sections[i].m_Tag == tag)
+                    return &m_Sections[i];
+            }
+            return nullptr;
+        }
+
+        eastl::span<const uint8_t> Bytes(uint32_t tag) const
+        {
+            auto section = Find(tag);
+            if (!section)
+                return {};
+
+            return { m_Data + section->m_Offset, (size_t)section->m_Size };
+        }
+
+        // Empty if missing or if the elements aren't Ts.
+        template <class T>
+        eastl::span<const T> Array(uint32_t tag) const
+        {
+            eastl::span<const T> values;
+            FindArray(tag, &values);
+            return values;
+        }
+
+        // As above, but tells a missing section from an empty one.
+        template <class T>
+        bool FindArray(uint32_t tag, eastl::span<const T>* outValues) const
+        {
+            auto section = Find(tag);
+            if (!section || section->m_ElementSize != sizeof(T) || section->m_Size % sizeof(T) != 0)
+                return false;
+
+            *outValues = { (const T*)(m_Data + section->m_Offset), (size_t)(section->m_Size / sizeof(T)) };
+            return true;
+        }
+
+        // Empty if missing, or if it isn't a DynamicBoard<T, Layout>'s storage.
+        template <class T, class Layout = RowMajor>
+        BoardRef<T, Layout> Board(uint32_t tag) const
+        {
+            using Dynamic = DynamicBoard<T, Layout>;
+
+            auto section = Find(tag);
+            if (!section || section->m_ElementSize != sizeof(T) || section->m_Rows <= 0 || section->m_Cols <= 0)
+                return {};
+
+            auto rows = (uint32_t)section->m_Rows;
+            auto cols = (uint32_t)section->m_Cols;
+            auto pitch = Layout::Stride(rows, cols, Dynamic::PitchGranularity);
+
+            if (section->m_Pitch != pitch || section->m_Size != sizeof(T) * Layout::Size(rows, cols, pitch))
+                return {};
+
+            auto data = m_Data + section->m_Offset;
+            if ((uintptr_t)data % Dynamic::PitchAlignment != 0)
+                return {};
+
+            return { (const T*)data, Row(section->m_Rows), Col(section->m_Cols), pitch };
+        }
+
+        // For sections added with SnapshotWriter::AddObject.
+        BinaryReader Reader(uint32_t tag) const
+        {
+            auto bytes = Bytes(tag);
+            return { bytes.data(), bytes.size() };
+        }
+
+    private:
+        bool Validate(const uint8_t* data, size_t size)
+        {
+            if (data == nullptr || size < sizeof(SnapshotHeader))
+                return false;
+
+            auto header = (const SnapshotHeader*)data;
+            if (header->m_Magic != SnapshotMagic || header->m_Version != SnapshotVersion || header->m_FileSize > size)
+                return false;
+
+            auto tableEnd = sizeof(SnapshotHeader) + (uint64_t)sizeof(SnapshotSection) * header->m_SectionCount;
+            if (tableEnd > size)
+                return false;
+
+            auto sections = (const SnapshotSection*)(data + sizeof(SnapshotHeader));
+            for (auto i = 0U; i < header->m_SectionCount; i++)
+            {
+                auto& section = sections[i];
+                if (section.m_Offset < tableEnd || section.m_Offset % SnapshotAlignment != 0
+                    || section.m_Size > size || section.m_Offset > size - section.m_Size)
+                    return false;
+            }
+
+            m_Data = data;
+            m_Size = size;
+            m_Sections = sections;
+            m_SectionCount = header->m_SectionCount;
+
+            return true;
+        }
+    };
+}
+
+#ifdef CatchAvailable__
+
+#include "m3Random.hpp"
+#include "m3Moves.hpp"
+
+TEST_CASE("Snapshot", "[snapshot]")
+{
+    using namespace m3;
+
+    const auto ColorsTag = SnapshotTag("COLR");
+    const auto IdsTag = SnapshotTag("GIDS");
+    const auto RowsTag = SnapshotTag("GROW");
+    const auto RandomTag = SnapshotTag("RAND");
+
+    DynamicBoard<GemColor> colors(37, 45);
+    Random random(5);
+    for (auto r = 0; r < colors.Rows().m_I; r++)
+        random.FillColors({ colors.RowData(r), (size_t)colors.Cols().m_I });
+
+    DynamicBoard<GemId, Tiled8x8> ids(20, 13);
+    for (auto r = 0; r < ids.Rows().m_I; r++)
+        for (auto c = 0; c < ids.Cols().m_I; c++)
+            ids(r, c) = r * 100 + c;
+
+    eastl::vector<Row> rows = { 1, 2, 3, 5, 8 };
+
+    const auto PiecesTag = SnapshotTag("PCES");
+    const uint32_t piece0[] = { 1, 2, 3 }, piece1[] = { 4, 5, 6 };
+    const auto EmptyTag = SnapshotTag("EMTY");
+    const eastl::vector<Row> noRows;
+
+    SnapshotWriter writer;
+    writer.AddBoard(ColorsTag, colors);
+    writer.AddBoard(IdsTag, ids);
+    writer.AddArray(RowsTag, rows);
+    writer.AddObject(RandomTag, random);
+    writer.AddPieces(PiecesTag, { piece0, piece1 }, sizeof(piece0), sizeof(uint32_t));
+    writer.AddArray(EmptyTag, noRows);
+
+    eastl::vector<uint8_t> bytes;
+    REQUIRE(writer.Save(&bytes));
+
+    // eastl::vector only guarantees the default alignment, boards need more.
+    eastl::vector<uint64_t> aligned((bytes.size() + SnapshotAlignment) / 8);
+    auto base = (uint8_t*)aligned.data() + (SnapshotAlignment - (uintptr_t)aligned.data() % SnapshotAlignment) % SnapshotAlignment;
+    memcpy(base, bytes.data(), bytes.size());
+
+    SECTION("Sections read in place")
+    {
+        Snapshot snapshot;
+        REQUIRE(snapshot.Open(base, bytes.size()));
+        REQUIRE(snapshot.SectionCount() == 6);
+
+        auto mappedColors = snapshot.Board<GemColor>(ColorsTag);
+        REQUIRE(!mappedColors.Empty());
+        REQUIRE((const uint8_t*)mappedColors.Data() >= base);
+        REQUIRE((const uint8_t*)mappedColors.Data() < base + bytes.size());
+        REQUIRE(mappedColors.Pitch() == colors.Pitch());
+        REQUIRE(memcmp(mappedColors.Data(), colors.Data(), colors.SizeInBytes()) == 0);
+
+        // Algorithms that take any board work on it directly.
+        REQUIRE(CountValidMoves(mappedColors) == CountValidMoves(colors));
+
+        auto mappedIds = snapshot.Board<GemId, Tiled8x8>(IdsTag);
+        REQUIRE(!mappedIds.Empty());
+        REQUIRE(mappedIds(19, 12) == ids(19, 12));
+        REQUIRE(mappedIds(7, 9) == GemId(709));
+
+        // Wrong type or layout.
+        REQUIRE(snapshot.Board<GemId>(IdsTag).Empty());
+        REQUIRE(snapshot.Board<GemColor>(IdsTag).Empty());
+        REQUIRE(snapshot.Array<uint32_t>(RowsTag).empty());
+
+        auto mappedRows = snapshot.Array<Row>(RowsTag);
+        REQUIRE(mappedRows.size() == 5);
+        REQUIRE(mappedRows[4] == 8);
+
+        Random loaded(99);
+        auto reader = snapshot.Reader(RandomTag);
+        REQUIRE(loaded.Load(reader));
+        REQUIRE(loaded() == random());
+
+        DynamicBoard<GemColor> copy;
+        copy.CopyFrom(mappedColors);
+        REQUIRE(memcmp(copy.Data(), colors.Data(), colors.SizeInBytes()) == 0);
+
+        auto pieces = snapshot.Array<uint32_t>(PiecesTag);
+        REQUIRE(pieces.size() == 6);
+        for (auto i = 0U; i < 6; i++)
+            REQUIRE(pieces[i] == i + 1);
+
+        REQUIRE(snapshot.Find(SnapshotTag("NONE")) == nullptr);
+        REQUIRE(snapshot.Array<Row>(SnapshotTag("NONE")).empty());
+
+        // Empty is not missing.
+        eastl::span<const Row> found;
+        REQUIRE(snapshot.FindArray(EmptyTag, &found));
+        REQUIRE(found.empty());
+        REQUIRE(!snapshot.FindArray(SnapshotTag("NONE"), &found));
+
+        eastl::span<const uint32_t> wrongType;
+        REQUIRE(!snapshot.FindArray(EmptyTag, &wrongType));
+    }
+
+    SECTION("Bad headers and truncated files are rejected")
+    {
+        Snapshot snapshot;
+        REQUIRE(!snapshot.Open(base, sizeof(SnapshotHeader) - 1));
+        REQUIRE(!snapshot.Open(base, bytes.size() - 1));
+
+        ((SnapshotHeader*)base)->m_Version = SnapshotVersion + 1;
+        REQUIRE(!snapshot.Open(base, bytes.size()));
+
+        ((SnapshotHeader*)base)->m_Version = SnapshotVersion;
+        ((SnapshotHeader*)base)->m_Magic = 0x4D33534E;
+        REQUIRE(!snapshot.Open(base, bytes.size()));
+        REQUIRE(!snapshot.IsOpen());
+    }
+
+    SECTION("Mapped from a file")
+    {
+        const char* path = "m3SnapshotTest.bin";
+        REQUIRE(writer.Save(path));
+
+        Snapshot snapshot;
+        REQUIRE(snapshot.Open(path));
+
+        auto mappedColors = snapshot.Board<GemColor>(ColorsTag);
+        REQUIRE(!mappedColors.Empty());
+        REQUIRE(memcmp(mappedColors.Data(), colors.Data(), colors.SizeInBytes()) == 0);
+
+        snapshot.Close();
+        remove(path);
+
+        REQUIRE(!snapshot.Open(path));
+    }
+}
+
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+
+TEST_CASE("Snapshot open", "[.][benchmark][snapshot]")
+{
+    using namespace m3;
+
+    const char* path = "m3SnapshotBenchmark.bin";
+    const auto tag = SnapshotTag("GIDS");
+
+    {
+        DynamicBoard<GemId> ids(4096, 4096);
+        ids.Fill(InvalidGemId);
+
+        SnapshotWriter writer;
+        writer.AddBoard(tag, ids);
+        REQUIRE(writer.Save(path));
+    }
+
+    BENCHMARK("Open 4096x4096 ids")
+    {
+        Snapshot snapshot;
+        snapshot.Open(path);
+        return snapshot.Board<GemId>(tag).Data() != nullptr;
+    };
+
+    BENCHMARK("Open 4096x4096 ids and touch a cell per page")
+    {
+        Snapshot snapshot;
+        snapshot.Open(path);
+        auto ids = snapshot.Board<GemId>(tag);
+
+        auto sum = 0U;
+        for (auto r = 0; r < ids.Rows().m_I; r++)
+            sum += ids(r, 0).m_I;
+        return sum;
+    };
+
+    remove(path);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,719 @@
+#pragma once
+
+#include <EASTL\algorithm.h>
+#include <EASTL\hash_set.h>
+#include <EASTL\sort.h>
+#include <EASTL\unique_ptr.h>
+#include <EASTL\vector.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+
+#include "m3Types.hpp"
+#include "m3Match.hpp"
+#include "m3Moves.hpp"
+#include "m3Simulation.hpp"
+#include "m3ThreadPool.hpp"
+
+namespace m3
+{
+    // What resolving one swap did.
+    struct MoveOutcome
+    {
+        uint32_t m_Cleared; // Gems, over all steps.
+        uint32_t m_Steps;   // 1 for a plain match, more for cascades.
+    };
+
+    // Scores one resolved move, higher is better. Line scores are the sum over their moves.
+    // Called from worker threads, so it may only read the board it is given.
+    using SolverHeuristic = float (*)(const Simulation& after, const MoveOutcome& outcome);
+
+    // Gems cleared, with cascades worth a bit extra.
+    inline float ClearedHeuristic(const Simulation&, const MoveOutcome& outcome)
+    {
+        return (float)outcome.m_Cleared + 2.0f * (float)(outcome.m_Steps - 1);
+    }
+
+    // Also keeps the board playable: a few valid moves left are worth something,
+    // a dead board is heavily penalized.
+    inline float MobilityHeuristic(const Simulation& after, const MoveOutcome& outcome)
+    {
+        const auto Enough = 4;
+        auto moves = CountValidMoves(after.GetColors(), Enough);
+        return ClearedHeuristic(after, outcome) + (moves == 0 ? -100.0f : 0.5f * moves);
+    }
+
+    /*
+        Lock-free transposition table keyed by board hash. An entry is one 64-bit word:
+        24 check bits from the top of the hash, the depth and the line score. Stores
+        keep whichever entry is better, by CAS: shallower first, then higher score, then
+        the higher word. That is a total order, so after a batch of concurrent stores a
+        slot holds the same entry whatever order they ran in, and searches stay
+        deterministic across thread counts.
+        False positives take a 24-bit check collision on top of a slot collision.
+    */
+    class TranspositionTable
+    {
+    private:
+        eastl::vector<std::atomic<uint64_t>> m_Slots; // 0 is empty.
+        uint64_t m_Mask = 0;
+
+        static inline uint64_t Pack(uint64_t hash, uint32_t depth, float score)
+        {
+            uint32_t bits;
+            memcpy(&bits, &score, sizeof(bits));
+            return (hash & 0xFFFFFF0000000000ULL) | ((uint64_t)(eastl::min(depth, 254U) + 1) << 32) | bits;
+        }
+
+        static inline uint32_t Depth(uint64_t entry) { return (uint32_t)((entry >> 32) & 0xFF) - 1; }
+
+        static inline float Score(uint64_t entry)
+        {
+            auto bits = (uint32_t)entry;
+            float score;
+            memcpy(&score, &bits, sizeof(score));
+            return score;
+        }
+
+        static inline bool Better(uint64_t a, uint64_t b)
+        {
+            if (Depth(a) != Depth(b))
+                return Depth(a) < Depth(b);
+            if (Score(a) != Score(b))
+                return Score(a) > Score(b);
+            return a > b;
+        }
+
+    public:
+        // Rounded up to a power of two.
+        explicit TranspositionTable(uint32_t slots = 1 << 16)
+        {
+            auto size = 1U;
+            while (size < slots)
+                size <<= 1;
+
+            m_Slots = eastl::vector<std::atomic<uint64_t>>(size);
+            m_Mask = size - 1;
+            Clear();
+        }
+
+        inline uint32_t SlotCount() const { return (uint32_t)m_Slots.size(); }
+
+        // Not thread-safe.
+        void Clear()
+        {
+            for (auto& slot : m_Slots)
+                slot.store(0, std::memory_order_relaxed);
+        }
+
+        void Store(uint64_t hash, uint32_t depth, float score)
+        {
+            auto& slot = m_Slots[hash & m_Mask];
+            auto entry = Pack(hash, depth, score);
+            auto old = slot.load(std::memory_order_relaxed);
+
+            while ((old == 0 || Better(entry, old)) &&
+                !slot.compare_exchange_weak(old, entry, std::memory_order_relaxed))
+            {}
+        }
+
+        // True if the position was reached before, no deeper and with at least this score.
+        bool Dominates(uint64_t hash, uint32_t depth, float score) const
+        {
+            auto entry = m_Slots[hash & m_Mask].load(std::memory_order_relaxed);
+            return entry != 0
+                && (entry & 0xFFFFFF0000000000ULL) == (hash & 0xFFFFFF0000000000ULL)
+                && Depth(entry) <= depth
+                && Score(entry) >= score;
+        }
+    };
+
+    struct SolverSettings
+    {
+        uint32_t m_Depth = 3;      // Moves to look ahead.
+        uint32_t m_BeamWidth = 16; // Lines kept per depth.
+        uint32_t m_Branching = 8;  // Swaps tried per line, the biggest immediate matches first. 0 for all.
+        uint32_t m_Hints = 3;      // Best first moves to report.
+        SolverHeuristic m_Heuristic = ClearedHeuristic;
+    };
+
+    struct SolverHint
+    {
+        Swap m_Swap;
+        float m_Score;    // Best line starting with this swap.
+        uint32_t m_Depth; // Length of that line.
+    };
+
+    struct SolverResult
+    {
+        eastl::vector<Swap> m_Line; // Best line, first move first. Empty on a dead board.
+        float m_Score = 0;
+        eastl::vector<SolverHint> m_Hints; // Best first, at most SolverSettings::m_Hints.
+        uint32_t m_Depth = 0;     // Depths completed before the deadline.
+        uint64_t m_Resolved = 0;  // Swaps resolved.
+        uint64_t m_Pruned = 0;    // Lines dropped by the transposition table.
+        bool m_TimedOut = false;
+    };
+
+    /*
+        Beam search over move sequences. Each depth expands every line in the beam as a
+        task on the pool: valid swaps come from the bitboard move finder, are ranked by
+        their immediate matches (GetMatchesForSwap_*) and the best m_Branching are
+        resolved with cascades, refills and all, on the worker's own Simulation. Children
+        that the transposition table has seen no deeper and no worse are dropped, the
+        rest are ranked by line score and the best m_BeamWidth distinct boards go on.
+
+        Refills come from the board's own Random, as they would in play, so a line is
+        exactly what the game would do. Only the beam's boards are kept: a child's board
+        is rebuilt from its parent's once it has made the beam.
+
+        A depth that runs past the deadline is thrown away, the result is from the last
+        complete one. Results don't depend on the number of threads.
+    */
+    class Solver
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+    private:
+        struct Node
+        {
+            Swap m_Swap;
+            uint32_t m_Parent; // In the previous depth's beam.
+            uint32_t m_First;  // First move of the line, index in depth 1's beam.
+            float m_Score;
+            uint64_t m_Hash;
+        };
+
+        struct State
+        {
+            Simulation::Colors m_Colors;
+            Random m_Random;
+        };
+
+        struct Candidate
+        {
+            Swap m_Swap;
+            int m_Immediate;
+            uint32_t m_Order;
+        };
+
+        // Per worker, on its own cache lines.
+        struct alignas(64) Scratch
+        {
+            eastl::unique_ptr<Simulation> m_Board;
+            CascadeEvents m_Events;
+            eastl::vector<Swap> m_Moves;
+            eastl::vector<Candidate> m_Candidates;
+            eastl::vector<Node> m_Children;
+            uint64_t m_Resolved = 0;
+            uint64_t m_Pruned = 0;
+        };
+
+        ThreadPool* m_Pool;
+        TranspositionTable m_Table;
+        eastl::vector<Scratch, CacheLineAllocator> m_Scratch;
+
+        eastl::vector<eastl::vector<Node>> m_Beams; // Per depth, [0] is the root.
+        eastl::vector<State> m_States;              // Boards of the last beam.
+        eastl::vector<State> m_NextStates;
+        eastl::vector<Node> m_Children;             // All workers', merged.
+        eastl::hash_set<uint64_t> m_Seen;
+
+        std::atomic<bool> m_TimedOut { false };
+
+    public:
+        explicit Solver(ThreadPool* pool, uint32_t tableSlots = 1 << 16) :
+            m_Pool(pool),
+            m_Table(tableSlots),
+            m_Scratch(pool->WorkerCount())
+        {}
+
+        inline const TranspositionTable& Table() const { return m_Table; }
+
+        // root should have no matches on it, eg. after Generate or a resolved swap.
+        SolverResult Solve(const Simulation& root, const SolverSettings& settings, Clock::time_point deadline)
+        {
+            Reset(root);
+
+            SolverResult result;
+
+            for (auto depth = 1U; depth <= settings.m_Depth; depth++)
+            {
+                if (Clock::now() >= deadline || !ExpandBeam(depth, settings, deadline))
+                {
+                    result.m_TimedOut = true;
+                    break;
+                }
+
+                if (m_Beams.back().empty())
+                    break;
+
+                result.m_Depth = depth;
+            }
+
+            for (auto& scratch : m_Scratch)
+            {
+                result.m_Resolved += scratch.m_Resolved;
+                result.m_Pruned += scratch.m_Pruned;
+            }
+
+            // Depths past the last complete one were discarded in ExpandBeam.
+            auto deepest = (uint32_t)m_Beams.size() - 1;
+            while (deepest > 0 && m_Beams[deepest].empty())
+                deepest--;
+
+            if (deepest == 0)
+                return result;
+
+            // Beams are sorted best first.
+            auto& best = m_Beams[deepest][0];
+            result.m_Score = best.m_Score;
+            result.m_Line.resize(deepest);
+
+            auto index = 0U;
+            for (auto depth = deepest; depth > 0; depth--)
+            {
+                auto& node = m_Beams[depth][index];
+                result.m_Line[depth - 1] = node.m_Swap;
+                index = node.m_Parent;
+            }
+
+            CollectHints(deepest, settings.m_Hints, &result.m_Hints);
+
+            return result;
+        }
+
+        SolverResult Solve(const Simulation& root, const SolverSettings& settings, Clock::duration budget)
+        {
+            return Solve(root, settings, Clock::now() + budget);
+        }
+
+    private:
+        void Reset(const Simulation& root)
+        {
+            for (auto& scratch : m_Scratch)
+            {
+                if (!scratch.m_Board || scratch.m_Board->Rows() != root.Rows() || scratch.m_Board->Cols() != root.Cols())
+                    scratch.m_Board.reset(new Simulation(root.Rows(), root.Cols()));
+
+                scratch.m_Resolved = 0;
+                scratch.m_Pruned = 0;
+            }
+
+            m_Table.Clear();
+            m_Table.Store(root.Hash(), 0, 0.0f);
+            m_TimedOut = false;
+
+            m_Beams.resize(1);
+            m_Beams[0].clear();
+            m_Beams[0].push_back({ {}, 0, 0, 0.0f, root.Hash() });
+
+            m_States.resize(1);
+            m_States[0].m_Colors = root.GetColors();
+            m_States[0].m_Random = root.GetRandom();
+        }
+
+        static inline void Load(Simulation& board, const State& state)
+        {
+            board.SetColors(BoardRef<GemColor>(state.m_Colors));
+            board.SetRandom(state.m_Random);
+        }
+
+        // Cells the swap would match right away, before any cascade.
+        static int ImmediateMatches(const Simulation& board, const Swap& swap)
+        {
+            const auto rMax = board.Rows() - 1;
+            const auto cMax = board.Cols() - 1;
+
+            auto m = swap.m_R0 == swap.m_R1
+                ? GetMatchesForSwap_Row(swap.m_R0, swap.m_C0, swap.m_C1, board.GetColors(), rMax, cMax)
+                : GetMatchesForSwap_Col(swap.m_C0, swap.m_R0, swap.m_R1, board.GetColors(), rMax, cMax);
+
+            auto count = 0;
+            for (auto n : { m.Row_0.Count().m_I, m.Row_1.Count().m_I, m.Col_0.Count().m_I, m.Col_1.Count().m_I })
+                count += n >= 3 ? n : 0;
+
+            return count;
+        }
+
+        // False if the deadline passed while expanding.
+        bool ExpandBeam(uint32_t depth, const SolverSettings& settings, Clock::time_point deadline)
+        {
+            auto& beam = m_Beams[depth - 1];
+
+            for (auto& scratch : m_Scratch)
+                scratch.m_Children.clear();
+
+            m_Pool->ParallelFor((uint32_t)beam.size(), [&](uint32_t task, uint32_t worker)
+            {
+                if (m_TimedOut.load(std::memory_order_relaxed) || Clock::now() >= deadline)
+                {
+                    m_TimedOut.store(true, std::memory_order_relaxed);
+                    return;
+                }
+
+                ExpandNode(depth, task, settings, m_Scratch[worker]);
+            });
+
+            if (m_TimedOut)
+                return false;
+
+            // Merge in an order that doesn't depend on which worker did what.
+            m_Children.clear();
+            for (auto& scratch : m_Scratch)
+                m_Children.insert(m_Children.end(), scratch.m_Children.begin(), scratch.m_Children.end());
+
+            eastl::sort(m_Children.begin(), m_Children.end(), [](const Node& a, const Node& b)
+            {
+                if (a.m_Score != b.m_Score)
+                    return a.m_Score > b.m_Score;
+                if (a.m_Parent != b.m_Parent)
+                    return a.m_Parent < b.m_Parent;
+                if (a.m_Swap.m_R0 != b.m_Swap.m_R0)
+                    return a.m_Swap.m_R0 < b.m_Swap.m_R0;
+                if (a.m_Swap.m_C0 != b.m_Swap.m_C0)
+                    return a.m_Swap.m_C0 < b.m_Swap.m_C0;
+                return a.m_Swap.m_R1 < b.m_Swap.m_R1;
+            });
+
+            // Best child per board.
+            m_Beams.emplace_back();
+            auto& next = m_Beams.back();
+            m_Seen.clear();
+
+            for (auto& child : m_Children)
+            {
+                if (next.size() == settings.m_BeamWidth)
+                    break;
+
+                if (m_Seen.insert(child.m_Hash).second)
+                    next.push_back(child);
+            }
+
+            if (depth == 1)
+            {
+                for (auto i = 0U; i < next.size(); i++)
+                    next[i].m_First = i;
+            }
+
+            // Rebuild the survivors' boards, unless this was the last depth.
+            if (depth < settings.m_Depth)
+            {
+                m_NextStates.resize(next.size());
+
+                m_Pool->ParallelFor((uint32_t)next.size(), [&](uint32_t task, uint32_t worker)
+                {
+                    auto& scratch = m_Scratch[worker];
+                    auto& node = next[task];
+
+                    Load(*scratch.m_Board, m_States[node.m_Parent]);
+                    scratch.m_Events.Clear();
+                    scratch.m_Board->ApplySwap(node.m_Swap, &scratch.m_Events);
+
+                    m_NextStates[task].m_Colors = scratch.m_Board->GetColors();
+                    m_NextStates[task].m_Random = scratch.m_Board->GetRandom();
+                });
+
+                eastl::swap(m_States, m_NextStates);
+            }
+
+            // Probes of this depth are done, its children are visible to the next.
+            m_Pool->ParallelFor((uint32_t)next.size(), [&](uint32_t task, uint32_t)
+            {
+                m_Table.Store(next[task].m_Hash, depth, next[task].m_Score);
+            });
+
+            return true;
+        }
+
+        void ExpandNode(uint32_t depth, uint32_t index, const SolverSettings& settings, Scratch& scratch)
+        {
+            auto& parent = m_Beams[depth - 1][index];
+            auto& state = m_States[index];
+            auto& board = *scratch.m_Board;
+
+            Load(board, state);
+
+            if (board.FindValidMoves(&scratch.m_Moves) == 0)
+                return;
+
+            scratch.m_Candidates.clear();
+            for (auto i = 0U; i < scratch.m_Moves.size(); i++)
+            {
+                auto& swap = scratch.m_Moves[i];
+                scratch.m_Candidates.push_back({ swap, ImmediateMatches(board, swap), i });
+            }
+
+            auto count = (uint32_t)scratch.m_Candidates.size();
+            if (settings.m_Branching > 0 && settings.m_Branching < count)
+            {
+                count = settings.m_Branching;
+                eastl::partial_sort(scratch.m_Candidates.begin(), scratch.m_Candidates.begin() + count, scratch.m_Candidates.end(),
+                    [](const Candidate& a, const Candidate& b)
+                    {
+                        return a.m_Immediate != b.m_Immediate ? a.m_Immediate > b.m_Immediate : a.m_Order < b.m_Order;
+                    });
+            }
+
+            for (auto i = 0U; i < count; i++)
+            {
+                auto& swap = scratch.m_Candidates[i].m_Swap;
+
+                if (i > 0)
+                    Load(board, state);
+
+                scratch.m_Events.Clear();
+                if (!board.ApplySwap(swap, &scratch.m_Events))
+                    continue;
+
+                scratch.m_Resolved++;
+
+                MoveOutcome outcome = { scratch.m_Events.ClearedCount(), scratch.m_Events.StepCount() };
+                auto score = parent.m_Score + settings.m_Heuristic(board, outcome);
+                auto hash = board.Hash();
+
+                if (m_Table.Dominates(hash, depth, score))
+                {
+                    scratch.m_Pruned++;
+                    continue;
+                }
+
+                scratch.m_Children.push_back({ swap, index, parent.m_First, score, hash });
+            }
+        }
+
+        // Best line per first move, from the deepest depth each first move reached.
+        void CollectHints(uint32_t deepest, uint32_t count, eastl::vector<SolverHint>* outHints) const
+        {
+            auto& firsts = m_Beams[1];
+            outHints->clear();
+
+            for (auto& first : firsts)
+                outHints->push_back({ first.m_Swap, first.m_Score, 1 });
+
+            for (auto depth = 2U; depth <= deepest; depth++)
+            {
+                for (auto& node : m_Beams[depth])
+                {
+                    auto& hint = (*outHints)[node.m_First];
+                    if (depth > hint.m_Depth || node.m_Score > hint.m_Score)
+                    {
+                        hint.m_Score = node.m_Score;
+                        hint.m_Depth = depth;
+                    }
+                }
+            }
+
+            eastl::stable_sort(outHints->begin(), outHints->end(), [](const SolverHint& a, const SolverHint& b)
+            {
+                return a.m_Depth != b.m_Depth ? a.m_Depth > b.m_Depth : a.m_Score > b.m_Score;
+            });
+
+            if (outHints->size() > count)
+                outHints->resize(count);
+        }
+    };
+}
+
+#ifdef CatchAvailable__
+
+#include "m3Bitboard.hpp"
+
+namespace m3::SolverTest
+{
+    // Plays a line on a copy of the board's colors and random state, returns the summed score.
+    inline float PlayLine(const Simulation& root, const eastl::vector<Swap>& line, SolverHeuristic heuristic)
+    {
+        Simulation board(root.Rows(), root.Cols());
+        board.SetColors(root.GetColors());
+        board.SetRandom(root.GetRandom());
+
+        CascadeEvents events;
+        auto score = 0.0f;
+
+        for (auto& swap : line)
+        {
+            events.Clear();
+            REQUIRE(board.ApplySwap(swap, &events));
+            score += heuristic(board, { events.ClearedCount(), events.StepCount() });
+        }
+
+        return score;
+    }
+}
+
+TEST_CASE("Solver", "[solver][threads]")
+{
+    using namespace m3;
+    using namespace m3::SolverTest;
+
+    const auto NoDeadline = std::chrono::hours(1);
+
+    SECTION("Lines replay to their score and beat greedy play")
+    {
+        ThreadPool pool(2);
+        Solver solver(&pool);
+
+        for (auto seed = 0U; seed < 5; seed++)
+        {
+            Simulation root(10, 10, seed);
+            root.Generate(3);
+
+            SolverSettings settings;
+            settings.m_Depth = 3;
+            settings.m_BeamWidth = 8;
+
+            auto result = solver.Solve(root, settings, NoDeadline);
+
+            REQUIRE(!result.m_TimedOut);
+            REQUIRE(result.m_Depth == result.m_Line.size());
+            REQUIRE(!result.m_Line.empty());
+            REQUIRE(result.m_Resolved > 0);
+            REQUIRE(result.m_Score == PlayLine(root, result.m_Line, settings.m_Heuristic));
+
+            // Depth 1 with full branching is the best single move.
+            settings.m_Depth = 1;
+            settings.m_Branching = 0;
+            auto greedy = solver.Solve(root, settings, NoDeadline);
+            REQUIRE(greedy.m_Line.size() == 1);
+
+            eastl::vector<Swap> moves;
+            Simulation copy(10, 10);
+            copy.SetColors(root.GetColors());
+            copy.SetRandom(root.GetRandom());
+            copy.FindValidMoves(&moves);
+
+            for (auto& swap : moves)
+                REQUIRE(PlayLine(root, { swap }, ClearedHeuristic) <= greedy.m_Score);
+
+            REQUIRE(!result.m_Hints.empty());
+            REQUIRE(result.m_Hints.size() <= 3);
+            REQUIRE(result.m_Hints[0].m_Score == result.m_Score);
+            REQUIRE(result.m_Hints[0].m_Depth == result.m_Depth);
+        }
+    }
+
+    SECTION("Results do not depend on the thread count")
+    {
+        ThreadPool inline_(0), wide(4);
+        Solver a(&inline_), b(&wide);
+
+        SolverSettings settings;
+        settings.m_Depth = 4;
+        settings.m_BeamWidth = 12;
+        settings.m_Heuristic = MobilityHeuristic;
+
+        for (auto seed = 10U; seed < 14; seed++)
+        {
+            Simulation root(12, 9, seed);
+            root.Generate(3);
+
+            auto ra = a.Solve(root, settings, NoDeadline);
+            auto rb = b.Solve(root, settings, NoDeadline);
+
+            REQUIRE(ra.m_Score == rb.m_Score);
+            REQUIRE(ra.m_Line.size() == rb.m_Line.size());
+            REQUIRE(ra.m_Resolved == rb.m_Resolved);
+            REQUIRE(ra.m_Pruned == rb.m_Pruned);
+
+            for (auto i = 0U; i < ra.m_Line.size(); i++)
+            {
+                REQUIRE(ra.m_Line[i].m_R0 == rb.m_Line[i].m_R0);
+                REQUIRE(ra.m_Line[i].m_C0 == rb.m_Line[i].m_C0);
+                REQUIRE(ra.m_Line[i].m_R1 == rb.m_Line[i].m_R1);
+                REQUIRE(ra.m_Line[i].m_C1 == rb.m_Line[i].m_C1);
+            }
+        }
+    }
+
+    SECTION("A passed deadline returns no line")
+    {
+        ThreadPool pool(1);
+        Solver solver(&pool);
+
+        Simulation root(8, 8, 3);
+        root.Generate(3);
+
+        auto result = solver.Solve(root, SolverSettings(), Solver::Clock::now());
+        REQUIRE(result.m_TimedOut);
+        REQUIRE(result.m_Depth == 0);
+        REQUIRE(result.m_Line.empty());
+    }
+
+    SECTION("Dead boards have no line")
+    {
+        ThreadPool pool(0);
+        Solver solver(&pool);
+
+        Simulation root(4, 6);
+        root.SetColors(Simulation::Colors(4, 6,
+            "BROGYB"
+            "OGYBRO"
+            "YBROGY"
+            "ROGYBR", 24));
+
+        auto result = solver.Solve(root, SolverSettings(), NoDeadline);
+        REQUIRE(!result.m_TimedOut);
+        REQUIRE(result.m_Line.empty());
+        REQUIRE(result.m_Hints.empty());
+    }
+
+    SECTION("The table keeps the better entry whatever the store order")
+    {
+        TranspositionTable a(64), b(64);
+        const uint64_t h = 0xABCDEF0123456789ULL;
+
+        a.Store(h, 3, 10.0f);
+        a.Store(h, 2, 5.0f);
+        a.Store(h, 2, 7.0f);
+        b.Store(h, 2, 7.0f);
+        b.Store(h, 2, 5.0f);
+        b.Store(h, 3, 10.0f);
+
+        for (auto* table : { &a, &b })
+        {
+            REQUIRE(table->Dominates(h, 2, 7.0f));
+            REQUIRE(!table->Dominates(h, 2, 7.5f));
+            REQUIRE(table->Dominates(h, 3, 6.0f));
+            REQUIRE(!table->Dominates(h, 1, 0.0f));
+            REQUIRE(!table->Dominates(h ^ (1ULL << 63), 5, 0.0f));
+        }
+    }
+}
+
+#ifdef CATCH_CONFIG_ENABLE_BENCHMARKING
+
+TEST_CASE("Solver throughput", "[.][benchmark][solver]")
+{
+    using namespace m3;
+
+    ThreadPool pool;
+    Solver solver(&pool);
+
+    Simulation root(8, 8, 1);
+    root.Generate(3);
+
+    SolverSettings settings;
+    settings.m_Depth = 4;
+    settings.m_BeamWidth = 32;
+
+    auto result = solver.Solve(root, settings, std::chrono::hours(1));
+    WARN(pool.WorkerCount() << " workers: " << result.m_Resolved << " swaps resolved, " << result.m_Pruned << " pruned");
+
+    BENCHMARK("8x8, depth 4, beam 32")
+    {
+        return solver.Solve(root, settings, std::chrono::hours(1)).m_Score;
+    };
+
+    BENCHMARK("8x8, 5 ms budget")
+    {
+        settings.m_Depth = 50;
+        return solver.Solve(root, settings, std::chrono::milliseconds(5)).m_Depth;
+    };
+}
+
+#endif
+
+#endif
@@ -0,0 +1,302 @@
+#pragma once
+
+#include <EASTL\vector.h>
+
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+
+namespace m3
+{
+    /*
+        EASTL allocator that puts every block on a cache line. The default one frees with a
+        plain delete[], so it can't hand out over-aligned memory it could free again, and
+        the game's operator new[] ignores the alignment EASTL asks for. Containers of
+        alignas(64) per-worker data use this one instead.
+    */
+    class CacheLineAllocator
+    {
+    public:
+        static const size_t Alignment = 64;
+
+        CacheLineAllocator(const char* = nullptr) {}
+        CacheLineAllocator(const CacheLineAllocator&, const char*) {}
+
+        inline void* allocate(size_t n, int = 0)
+        {
+            return ::operator new(n, std::align_val_t(Alignment));
+        }
+
+        inline void* allocate(size_t n, size_t alignment, size_t offset, int = 0)
+        {
+            assert(alignment <= Alignment && offset == 0);
+            return allocate(n);
+        }
+
+        inline void deallocate(void* p, size_t)
+        {
+            ::operator delete(p, std::align_val_t(Alignment));
+        }
+
+        inline const char* get_name() const { return "CacheLineAllocator"; }
+        inline void set_name(const char*) {}
+    };
+
+    inline bool operator== (const CacheLineAllocator&, const CacheLineAllocator&) { return true; }
+    inline bool operator!= (const CacheLineAllocator&, const CacheLineAllocator&) { return false; }
+
+    /*
+        Persistent worker threads for data-parallel loops. ParallelFor splits the tasks 
+        into one contiguous range per worker. A worker takes tasks from the front of its 
+        own range, and once that is empty steals the back half of someone else's. Each 
+        range is a (begin, end) pair in one 64-bit atomic on its own cache line, so 
+        workers only touch each other's when stealing.
+
+        The calling thread works too, as worker 0, so a pool with no threads just runs 
+        the loop inline. Tasks should write to disjoint memory; which worker runs which 
+        task is not deterministic, anything that depends on it should be indexed by task.
+    */
+    class ThreadPool
+    {
+    private:
+        struct alignas(64) TaskRange
+        {
+            std::atomic<uint64_t> m_Bounds { 0 }; // end << 32 | begin
+
+            static inline uint64_t Pack(uint32_t begin, uint32_t end) { return ((uint64_t)end << 32) | begin; }
+            static inline uint32_t Begin(uint64_t bounds) { return (uint32_t)bounds; }
+            static inline uint32_t End(uint64_t bounds) { return (uint32_t)(bounds >> 32); }
+        };
+
+        eastl::vector<std::thread> m_Threads;
+        eastl::vector<TaskRange, CacheLineAllocator> m_Ranges; // One per worker.
+
+        std::mutex m_Mutex;
+        std::condition_variable m_Wake;
+        std::condition_variable m_Done;
+
+        // The current loop. Published under m_Mutex, tasks are claimed without it.
+        const void* m_Fn = nullptr;
+        void (*m_Invoke)(const void* fn, uint32_t task, uint32_t worker) = nullptr;
+        uint32_t m_Generation = 0;
+        uint32_t m_Busy = 0;
+        bool m_Quit = false;
+
+    public:
+        // threads extra workers besides the caller. Defaults to one per remaining core.
+        explicit ThreadPool(uint32_t threads = DefaultThreadCount()) :
+            m_Ranges(threads + 1)
+        {
+            m_Threads.reserve(threads);
+            for (auto i = 0U; i < threads; i++)
+                m_Threads.push_back(std::thread([this, i]() { WorkerLoop(i + 1); }));
+        }
+
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                m_Quit = true;
+            }
+
+            m_Wake.notify_all();
+
+            for (auto& thread : m_Threads)
+                thread.join();
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator= (const ThreadPool&) = delete;
+
+        static uint32_t DefaultThreadCount()
+        {
+            auto cores = std::thread::hardware_concurrency();
+            return cores > 1 ? cores - 1 : 0;
+        }
+
+        // Including the calling thread.
+        inline uint32_t WorkerCount() const { return (uint32_t)m_Threads.size() + 1; }
+
+        // Calls fn(task, worker) for every task in [0, count) and returns when all are done.
+        // worker is in [0, WorkerCount()). Not reentrant.
+        template <class Fn>
+        void ParallelFor(uint32_t count, const Fn& fn)
+        {
+            if (count == 0)
+                return;
+
+            if (m_Threads.empty() || count == 1)
+            {
+                for (auto task = 0U; task < count; task++)
+                    fn(task, 0U);
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                m_Fn = &fn;
+                m_Invoke = [](const void* f, uint32_t task, uint32_t worker) { (*(const Fn*)f)(task, worker); };
+
+                const auto workers = WorkerCount();
+                for (auto i = 0U; i < workers; i++)
+                {
+                    auto begin = (uint32_t)((uint64_t)count * i / workers);
+                    auto end = (uint32_t)((uint64_t)count * (i + 1) / workers);
+                    m_Ranges[i].m_Bounds.store(TaskRange::Pack(begin, end), std::memory_order_relaxed);
+                }
+
+                m_Busy = (uint32_t)m_Threads.size();
+                m_Generation++;
+            }
+
+            m_Wake.notify_all();
+
+            RunTasks(0);
+
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_Done.wait(lock, [this]() { return m_Busy == 0; });
+            m_Fn = nullptr;
+        }
+
+    private:
+        void RunTasks(uint32_t worker)
+        {
+            auto& own = m_Ranges[worker].m_Bounds;
+
+            for (;;)
+            {
+                uint32_t task;
+                while (PopFront(own, &task))
+                    m_Invoke(m_Fn, task, worker);
+
+                if (!Steal(worker))
+                    break;
+            }
+        }
+
+        static bool PopFront(std::atomic<uint64_t>& range, uint32_t* outTask)
+        {
+            auto bounds = range.load(std::memory_order_acquire);
+
+            for (;;)
+            {
+                auto begin = TaskRange::Begin(bounds);
+                auto end = TaskRange::End(bounds);
+                if (begin >= end)
+                    return false;
+
+                if (range.compare_exchange_weak(bounds, TaskRange::Pack(begin + 1, end), std::memory_order_acq_rel))
+                {
+                    *outTask = begin;
+                    return true;
+                }
+            }
+        }
+
+        // Moves the back half of the first non-empty range found into the worker's own, 
+        // which is empty. False once every range looked empty.
+        bool Steal(uint32_t worker)
+        {
+            const auto workers = WorkerCount();
+
+            for (auto i = 1U; i < workers; i++)
+            {
+                auto& victim = m_Ranges[(worker + i) % workers].m_Bounds;
+                auto bounds = victim.load(std::memory_order_acquire);
+
+                for (;;)
+                {
+                    auto begin = TaskRange::Begin(bounds);
+                    auto end = TaskRange::End(bounds);
+                    if (begin >= end)
+                        break;
+
+                    auto take = (end - begin + 1) / 2;
+                    if (victim.compare_exchange_weak(bounds, TaskRange::Pack(begin, end - take), std::memory_order_acq_rel))
+                    {
+                        m_Ranges[worker].m_Bounds.store(TaskRange::Pack(end - take, end), std::memory_order_release);
+                        return true;
+                    }
+                }
+            }
+
+            return false;
+        }
+
+        void WorkerLoop(uint32_t worker)
+        {
+            uint32_t seen = 0;
+
+            for (;;)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(m_Mutex);
+                    m_Wake.wait(lock, [&]() { return m_Quit || m_Generation != seen; });
+
+                    if (m_Quit)
+                        return;
+
+                    seen = m_Generation;
+                }
+
+                RunTasks(worker);
+
+                {
+                    std::lock_guard<std::mutex> lock(m_Mutex);
+                    if (--m_Busy == 0)
+                        m_Done.notify_one();
+                }
+            }
+        }
+    };
+}
+
+#ifdef CatchAvailable__
+
+TEST_CASE("Thread pool", "[threads]")
+{
+    using namespace m3;
+
+    for (auto threads : { 0U, 1U, 3U, 8U })
+    {
+        DYNAMIC_SECTION("Every task runs once, " << threads << " threads")
+        {
+            ThreadPool pool(threads);
+            REQUIRE(pool.WorkerCount() == threads + 1);
+
+            for (auto count : { 0U, 1U, 7U, 1000U })
+            {
+                eastl::vector<uint32_t> runs(count, 0U);
+                std::atomic<uint32_t> badWorker { 0 };
+
+                pool.ParallelFor(count, [&](uint32_t task, uint32_t worker)
+                {
+                    runs[task]++;
+                    if (worker >= pool.WorkerCount())
+                        badWorker++;
+                });
+
+                for (auto run : runs)
+                    REQUIRE(run == 1);
+                REQUIRE(badWorker == 0);
+            }
+        }
+    }
+
+    SECTION("Cache line allocator")
+    {
+        struct alignas(64) Line { uint8_t m_Bytes[64]; };
+
+        eastl::vector<Line, CacheLineAllocator> lines;
+        for (auto i = 0; i < 50; i++)
+        {
+            lines.emplace_back();
+            REQUIRE((uintptr_t)lines.data() % 64 == 0);
+        }
+    }
+}
+
+#endif
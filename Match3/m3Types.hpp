@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cassert>
 #include <cstdint>
 #include <EASTL\numeric_limits.h>
 #include <EASTL\type_traits.h>
@@ -77,6 +78,23 @@ namespace m3
 {
     const GemId InvalidGemId = 0xFFFFFFFF;//eastl::numeric_limits<uint16_t>::max();
 
+    // A GemId is a generational handle: the low bits are a slot, the high bits count 
+    // how many times that slot has been reused, so a stale id never matches a live gem.
+    // Generation 0xFF is never handed out, so no valid id equals InvalidGemId. 8 bits 
+    // wrap quickly, see GemPool::IsAlive, but 24 slot bits are what a 4096x4096 board needs.
+    const uint32_t GemIdSlotBits = 24;
+    const uint32_t GemIdSlotMask = (1U << GemIdSlotBits) - 1;
+    const uint32_t GemIdMaxGeneration = 0xFE;
+
+    inline GemId MakeGemId(uint32_t slot, uint32_t generation) 
+    { 
+        assert(slot <= GemIdSlotMask && generation <= GemIdMaxGeneration);
+        return (int)((generation << GemIdSlotBits) | slot); 
+    }
+
+    inline uint32_t GemIdSlot(GemId id) { return id.m_I & GemIdSlotMask; }
+    inline uint32_t GemIdGeneration(GemId id) { return id.m_I >> GemIdSlotBits; }
+
     const GemColor InvalidColor = ' ';
     const GemColor Blue = GemColor('B');
     const GemColor Red = GemColor('R');
@@ -86,6 +104,21 @@ namespace m3
 
     const GemColor GemColors[] = 
     { InvalidColor, Blue, Red, Orange, Green, Yellow };
+
+    // Number of valid colors, ie. excluding InvalidColor.
+    const int NumGemColors = sizeof(GemColors) / sizeof(GemColor) - 1;
+
+    // Index of a valid color in [0, NumGemColors), or -1 for anything else.
+    inline int GemColorIndex(GemColor color)
+    {
+        for (auto i = 1; i <= NumGemColors; i++)
+        {
+            if (GemColors[i] == color)
+                return i - 1;
+        }
+
+        return -1;
+    }
 }
 
 namespace eastl
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+
+#include "m3Types.hpp"
+
+namespace m3
+{
+    // Zobrist hashing over (cell, color). A board hashes to the XOR of one key per
+    // occupied cell, so writing a cell updates the hash with two XORs, one for the color
+    // that leaves and one for the color that arrives. Empty cells have no key.
+    // Keys are computed by mixing the cell and color rather than looked up: a table
+    // would take rows * cols * NumGemColors words, 640 MB on a 4096x4096 board.
+    // Keys depend on the row and column only, not on the board's size, layout or pitch.
+    class Zobrist
+    {
+    private:
+        uint64_t m_Seed;
+
+    public:
+        explicit Zobrist(uint64_t seed = 0x5A0B8157C0DE5EEDULL) : m_Seed(seed) {}
+
+        inline uint64_t Key(Row r, Col c, GemColor color) const
+        {
+            if (color == InvalidColor)
+                return 0;
+
+            // splitmix64's finalizer, over the packed cell and color.
+            auto z = m_Seed
+                ^ ((uint64_t)(uint16_t)r.m_I << 40)
+                ^ ((uint64_t)(uint16_t)c.m_I << 16)
+                ^ color.m_I;
+
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+        }
+
+        // What hash ^= Change(...) does to a hash when a cell goes from one color to another.
+        inline uint64_t Change(Row r, Col c, GemColor from, GemColor to) const
+        {
+            return Key(r, c, from) ^ Key(r, c, to);
+        }
+
+        // From scratch, O(board). values(r, c) returns the GemColor of a cell.
+        template <class Values>
+        uint64_t Hash(const Values& values) const
+        {
+            auto hash = 0ULL;
+
+            for (auto r = 0; r < values.Rows().m_I; r++)
+                for (auto c = 0; c < values.Cols().m_I; c++)
+                    hash ^= Key(r, c, values(r, c));
+
+            return hash;
+        }
+    };
+}
+
+#ifdef CatchAvailable__
+
+#include "m3Board.hpp"
+#include "m3Random.hpp"
+
+TEST_CASE("Zobrist hashing", "[zobrist]")
+{
+    using namespace m3;
+
+    Zobrist zobrist;
+    Random random(11);
+
+    DynamicBoard<GemColor> colors(12, 9);
+    for (auto r = 0; r < colors.Rows().m_I; r++)
+        random.FillColors({ colors.RowData(r), (size_t)colors.Cols().m_I });
+
+    auto hash = zobrist.Hash(colors);
+
+    SECTION("Incremental updates match recomputing")
+    {
+        for (auto i = 0; i < 1000; i++)
+        {
+            Row r = random() % colors.Rows().m_I;
+            Col c = random() % colors.Cols().m_I;
+            auto color = (random() % 4 == 0) ? InvalidColor : random.NextColor();
+
+            hash ^= zobrist.Change(r, c, colors(r, c), color);
+            colors(r, c) = color;
+
+            REQUIRE(hash == zobrist.Hash(colors));
+        }
+    }
+
+    SECTION("Cells, colors and empty cells")
+    {
+        REQUIRE(zobrist.Key(3, 4, InvalidColor) == 0);
+        REQUIRE(zobrist.Key(3, 4, Red) != zobrist.Key(4, 3, Red));
+        REQUIRE(zobrist.Key(3, 4, Red) != zobrist.Key(3, 4, Blue));
+        REQUIRE(zobrist.Key(3, 4, Red) != Zobrist(1).Key(3, 4, Red));
+
+        // Swapping two different colors changes the hash, swapping back restores it.
+        auto a = colors(0, 0);
+        auto b = colors(0, 1);
+        colors(0, 0) = b;
+        colors(0, 1) = a;
+        REQUIRE((a == b) == (zobrist.Hash(colors) == hash));
+
+        colors(0, 0) = a;
+        colors(0, 1) = b;
+        REQUIRE(zobrist.Hash(colors) == hash);
+
+        // Same cells, other layout.
+        DynamicBoard<GemColor, Tiled8x8> tiled(colors.Rows(), colors.Cols());
+        for (auto r = 0; r < colors.Rows().m_I; r++)
+            for (auto c = 0; c < colors.Cols().m_I; c++)
+                tiled(r, c) = colors(r, c);
+
+        REQUIRE(zobrist.Hash(tiled) == hash);
+    }
+}
+
+#endif